@@ -132,9 +132,23 @@ LIST(APPEND COMMON_LIBS ${TinyXML_LIBRARIES})
 #
 #----------------------------------------------------------------------------
 #
+#--- Tasking backend
+#     AUTO uses TBB and/or OpenMP when they are found, NATIVE uses the built-in
+#     work-stealing thread pool, SERIAL runs everything on the calling thread
+#
+SET(TASKING_BACKEND "AUTO" CACHE STRING "Tasking backend")
+SET_PROPERTY(CACHE TASKING_BACKEND PROPERTY STRINGS AUTO TBB OMP NATIVE SERIAL)
+MESSAGE(STATUS "Tasking backend ${TASKING_BACKEND}")
+#
 #--- TBB
 #
-FIND_PACKAGE(TBB)
+IF (TASKING_BACKEND STREQUAL "AUTO" OR TASKING_BACKEND STREQUAL "TBB")
+    IF (TASKING_BACKEND STREQUAL "TBB")
+        FIND_PACKAGE(TBB REQUIRED)
+    ELSE ()
+        FIND_PACKAGE(TBB)
+    ENDIF ()
+ENDIF ()
 IF (TBB_FOUND)
     INCLUDE_DIRECTORIES(${TBB_INCLUDE_DIR})
     LIST(APPEND COMMON_LIBS ${TBB_LIBRARY})
@@ -146,7 +160,13 @@ ENDIF ()
 #
 #--- OpenMP
 #
-FIND_PACKAGE(OpenMP)
+IF (TASKING_BACKEND STREQUAL "AUTO" OR TASKING_BACKEND STREQUAL "OMP")
+    IF (TASKING_BACKEND STREQUAL "OMP")
+        FIND_PACKAGE(OpenMP REQUIRED)
+    ELSE ()
+        FIND_PACKAGE(OpenMP)
+    ENDIF ()
+ENDIF ()
 IF (OPENMP_FOUND)
     SET(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${OpenMP_C_FLAGS}")
     SET(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${OpenMP_CXX_FLAGS}")
@@ -157,6 +177,20 @@ IF (OPENMP_FOUND)
     ENDIF()
 ENDIF ()
 #
+#--- Native thread pool
+#
+IF (TASKING_BACKEND STREQUAL "NATIVE")
+    SET(THREADS_PREFER_PTHREAD_FLAG ON)
+    FIND_PACKAGE(Threads REQUIRED)
+    LIST(APPEND COMMON_LIBS ${CMAKE_THREAD_LIBS_INIT})
+    IF (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        SET(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -pthread")
+    ENDIF ()
+    ADD_DEFINITIONS(-DUSE_NATIVE_TASKING)
+ELSEIF (TASKING_BACKEND STREQUAL "SERIAL")
+    ADD_DEFINITIONS(-DUSE_MULTI_THREADING=0)
+ENDIF ()
+#
 #--- MPI
 #
 OPTION(ENABLE_MPI "Enable MPI" ON)
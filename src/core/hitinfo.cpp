@@ -36,6 +36,7 @@ void HitInfo::Init()
   duvw[1] = Point3(0.0f);
   node = NULL;
   mtlID = 0;
+  primID = -1;
   hasFrontHit = true;
   hasTexture = false;
   hasDiffuseHit = false;
@@ -41,6 +41,7 @@ class HitInfo {
   Point3 uvw;         // texture coordinate at the hit point
   Point3 duvw[2];     // derivatives of the texture coordinate
   int mtlID;          // sub-material index
+  int primID;         // primitive index within the object (face for meshes)
   const Node *node;   // the object node that was hit, false if the ray hits the back side
   bool hasFrontHit;   // true if the ray hits the front side,
   bool hasTexture;
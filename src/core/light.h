@@ -39,6 +39,15 @@ class Light : public ItemBase {
  public:
   virtual Color3f Illuminate(const Point3 &p, const Point3 &N) const = 0;
   virtual Point3 Direction(const Point3 &p) const = 0;
+  // Light arriving at p if nothing is in the way, together with the shadow
+  // ray that decides it. Soft lights return a single random sample. Lights
+  // that resolve visibility themselves set tMax to 0.
+  virtual Color3f SampleUnoccluded(const Point3 &p, const Point3 &N,
+                                   Ray &shadowRay, float &tMax) const
+  {
+    tMax = 0.f;
+    return Illuminate(p, N);
+  }
   virtual bool IsAmbient() const { return false; }
   // OpenGL Extensions
   virtual void SetViewportLight(int lightID) const {}
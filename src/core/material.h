@@ -31,8 +31,44 @@
 
 #include "core/setup.h"
 #include "core/items.h"
+#include "core/ray.h"
+#include <vector>
 
 namespace qaray {
+//
+// Deferred work of a shading point, filled by Material::Scatter for the
+// wavefront integrator. Weights are relative to the incoming path.
+//
+struct ShadowRequest {
+  Color3f contrib; // light reaching the eye if the shadow ray is unoccluded
+  Ray ray;
+  float tMax;
+};
+struct ScatterRay {
+  DiffRay ray;
+  Color3f weight;     // BxDF / PDF of the sampled direction
+  Color3f absorption; // applied to the radiance of the next hit if it is a
+                      // back hit, i.e. when the ray travels inside
+  bool diffuseHit;    // hasDiffuseHit flag of the next hit
+};
+struct ScatterRecord {
+  Color3f radiance; // emitted and gathered light, already resolved
+  std::vector<ShadowRequest> shadows;
+  std::vector<ScatterRay> rays;
+  void Clear()
+  {
+    radiance = Color3f(0.f);
+    shadows.clear();
+    rays.clear();
+  }
+  //! a light sample from Light::SampleUnoccluded, tMax <= 0 means the
+  //! visibility is already included in 'contrib'
+  void AddLight(const Color3f &contrib, const Ray &ray, float tMax)
+  {
+    if (tMax > 0.f) { shadows.push_back({contrib, ray, tMax}); }
+    else { radiance += contrib; }
+  }
+};
 class Material : public ItemBase {
  public:
   static int maxBounce;
@@ -48,6 +84,23 @@ class Material : public ItemBase {
   //              refraction.
   virtual Color3f Shade(const DiffRay &ray, const DiffHitInfo &hInfo,
                         const LightList &lights, int bounceCount) const = 0;
+  //
+  // Same estimator as Shade, but instead of tracing shadow rays and
+  // recursing, the shadow rays and the continuation rays are returned in
+  // 'rec'. Returns false if the material does not support it, Shade is
+  // called instead.
+  //
+  virtual bool Scatter(const DiffRay &ray, const DiffHitInfo &hInfo,
+                       const LightList &lights, int bounceCount,
+                       ScatterRecord &rec) const { return false; }
+  //
+  // Reflectance at the hit point, a feature of the denoiser. Materials that
+  // do not know it are white, which turns off the albedo demodulation.
+  //
+  virtual Color3f Albedo(const DiffHitInfo &hInfo) const
+  {
+    return Color3f(1.f);
+  }
   // OpenGL Extensions
   virtual void SetViewportMaterial(int subMtlID) const {}
   // Photon Extensions
@@ -0,0 +1,16 @@
+//------------------------------------------------------------------------------
+///
+/// \file       partition.cpp
+/// \author     Qi WU
+///
+/// \brief Meshes split over the processes of a data-distributed render
+///
+//------------------------------------------------------------------------------
+
+#include "partition.h"
+
+namespace qaray {
+static MeshPartition *meshPartition = nullptr;
+MeshPartition *GetMeshPartition() { return meshPartition; }
+void SetMeshPartition(MeshPartition *partition) { meshPartition = partition; }
+}
@@ -0,0 +1,44 @@
+//------------------------------------------------------------------------------
+///
+/// \file       partition.h
+/// \author     Qi WU
+///
+/// \brief Meshes split over the processes of a data-distributed render.
+///        Every process streams the OBJ files itself and keeps only the
+///        faces of its own spatial part (see TriMesh::LoadPartFromFileObj),
+///        so no process ever holds a whole mesh. The few exchanges this
+///        needs go through a MeshPartition. Its calls are collective over
+///        all the parts, which holds as all processes load the same scene.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_PARTITION_H
+#define QARAY_PARTITION_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+class MeshPartition {
+ public:
+  virtual ~MeshPartition() = default;
+  virtual size_t NumParts() const = 0;
+  //! The part kept by this process, in [0, NumParts())
+  virtual size_t Part() const = 0;
+  //! True on all parts when 'ok' is true on all of them
+  virtual bool AllOk(bool ok) = 0;
+  //! 'values' holds 'dim' floats for each of the 'ids'. Values of the same
+  //! id are added up over the parts, every part gets the sums of its ids.
+  virtual void SumShared(const std::vector<uint64_t> &ids,
+                         std::vector<float> &values, size_t dim) = 0;
+};
+///--------------------------------------------------------------------------//
+//! Null unless the meshes are split, whole meshes are loaded then
+MeshPartition *GetMeshPartition();
+void SetMeshPartition(MeshPartition *partition);
+}
+
+#endif //QARAY_PARTITION_H
@@ -47,7 +47,7 @@ Point3 Sampler::UniformBall(qaFLOAT radius)
     Get3f(r1, r2, r3);
     p.x = (2.f * r1 - 1.f) * radius;
     p.y = (2.f * r2 - 1.f) * radius;
-    p.z = (2.f * r2 - 1.f) * radius;
+    p.z = (2.f * r3 - 1.f) * radius;
   } while (length(p) > radius);
   return p;
 }
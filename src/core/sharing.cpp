@@ -0,0 +1,16 @@
+//------------------------------------------------------------------------------
+///
+/// \file       sharing.cpp
+/// \author     Qi WU
+///
+/// \brief Read-only scene data shared by the processes of a host
+///
+//------------------------------------------------------------------------------
+
+#include "sharing.h"
+
+namespace qaray {
+static NodeSharing *nodeSharing = nullptr;
+NodeSharing *GetNodeSharing() { return nodeSharing; }
+void SetNodeSharing(NodeSharing *sharing) { nodeSharing = sharing; }
+}
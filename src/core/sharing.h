@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+///
+/// \file       sharing.h
+/// \author     Qi WU
+///
+/// \brief Read-only scene data shared by the processes of a host. When
+///        several MPI ranks run on one host, one of them (the loader) reads
+///        and builds the meshes, BVHs, textures and photon maps, and the
+///        others map the copy of the loader instead of holding their own.
+///        Every call of a NodeSharing is collective over the ranks of the
+///        host, so all ranks have to share the same items in the same
+///        order, which holds as they load the same scene.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_SHARING_H
+#define QARAY_SHARING_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+class NodeSharing {
+ public:
+  virtual ~NodeSharing() = default;
+  //! True on the rank that loads the shared data of its host
+  virtual bool IsLoader() const = 0;
+  //! Read a file on the loaders only, the other ranks never read the
+  //! files of the shared data
+  virtual bool ReadFile(const char *filename, std::vector<char> &data) = 0;
+  //! The loader passes its 'bytes' of 'data', the others null and 0. All
+  //! ranks get the shared copy, which stays valid until it is released,
+  //! and its size in 'bytes'. Null when the loader passed nothing.
+  virtual const char *Share(const void *data, size_t &bytes) = 0;
+  //! Free a copy returned by Share
+  virtual void Release(const char *shared) = 0;
+};
+///--------------------------------------------------------------------------//
+//! Null unless the renderer shares the scene between the ranks of a host
+NodeSharing *GetNodeSharing();
+void SetNodeSharing(NodeSharing *sharing);
+///--------------------------------------------------------------------------//
+//! Arrays packed one after the other into a block to be shared. Every
+//! array is preceded by its length and starts on a 16 byte boundary, so
+//! that it can be used in place.
+class SharedBlockWriter {
+ public:
+  template<typename T>
+  void Put(const T *src, size_t count)
+  {
+    const uint64_t n = count;
+    Append(&n, sizeof(n));
+    Append(src, count * sizeof(T));
+  }
+  template<typename T>
+  void Put(const std::vector<T> &src) { Put(src.data(), src.size()); }
+  const std::vector<char> &Data() const { return data; }
+ private:
+  void Append(const void *src, size_t bytes)
+  {
+    data.resize((data.size() + 15) / 16 * 16, 0);
+    const size_t offset = data.size();
+    data.resize(offset + bytes);
+    if (bytes > 0) { memcpy(data.data() + offset, src, bytes); }
+  }
+  std::vector<char> data;
+};
+//! Reads the arrays of a SharedBlockWriter in the order they were put
+class SharedBlockReader {
+ public:
+  SharedBlockReader(const char *data, size_t bytes)
+      : data(data), bytes(data ? bytes : 0) {}
+  //! Null and 'count' 0 when the array is empty or the block too short,
+  //! in which case Good() turns false
+  template<typename T>
+  const T *Get(size_t &count)
+  {
+    count = 0;
+    const auto *n = static_cast<const uint64_t *>(Next(sizeof(uint64_t)));
+    if (n == nullptr) { return nullptr; }
+    const auto *array = static_cast<const T *>(Next(*n * sizeof(T)));
+    if (array != nullptr) { count = static_cast<size_t>(*n); }
+    return *n > 0 ? array : nullptr;
+  }
+  bool Good() const { return good; }
+ private:
+  const void *Next(size_t size)
+  {
+    pos = (pos + 15) / 16 * 16;
+    if (!good || pos > bytes || size > bytes - pos) {
+      good = false;
+      return nullptr;
+    }
+    const char *p = data + pos;
+    pos += size;
+    return p;
+  }
+  const char *data;
+  size_t bytes, pos = 0;
+  bool good = true;
+};
+}
+
+#endif //QARAY_SHARING_H
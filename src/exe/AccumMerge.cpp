@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+///
+/// \file       AccumMerge.cpp
+/// \author     Qi WU
+///
+/// \brief Add up accumulation files (see fb/accumfile.h) and tonemap the
+///        result. The files are read one after the other, only the merged
+///        sums are kept in memory, so any number of runs can be combined.
+///        The runs should use different seeds (-seed), samples of runs with
+///        the same seed are identical.
+///
+///        accum_merge [-o image.png] [-acc merged.acc] [-srgb 0|1]
+///                    [-threads n] run0.acc run1.acc ...
+///
+//------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "fb/accumfile.h"
+#include "fb/framebuffer.h"
+#include "tasking/parallel_range.h"
+
+using namespace qaray;
+
+int main(int argc, char **argv)
+{
+  std::string output = "colorBuffer_merged.png", accumOutput;
+  bool useSRGB = true;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i) {
+    std::string str(argv[i]);
+    if (str == "-o" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (str == "-acc" && i + 1 < argc) {
+      accumOutput = argv[++i];
+    } else if (str == "-srgb" && i + 1 < argc) {
+      useSRGB = std::atoi(argv[++i]) != 0;
+    } else if (str == "-threads" && i + 1 < argc) {
+      tasking::set_num_of_threads(static_cast<size_t>(std::atoi(argv[++i])));
+    } else {
+      inputs.push_back(str);
+    }
+  }
+  if (inputs.empty()) {
+    fprintf(stderr, "Usage: %s [-o image.png] [-acc merged.acc] [-srgb 0|1] "
+                    "[-threads n] run0.acc run1.acc ...\n", argv[0]);
+    return -1;
+  }
+  tasking::init();
+  AccumFileView view;
+  AccumFileHeader geometry;
+  FrameBuffer merged;
+  bool hasM2 = true;
+  std::set<std::pair<qaUINT, qaUINT>> runs; // seed and rank
+  for (size_t f = 0; f < inputs.size(); ++f) {
+    if (!view.Open(inputs[f])) { return -1; }
+    const AccumFileHeader &h = view.Header();
+    if (f == 0) {
+      geometry = h;
+      merged.Init(h.width, h.height);
+      merged.AllocateAccumulationBuffer();
+    } else if (h.width != geometry.width || h.height != geometry.height ||
+        h.x0 != geometry.x0 || h.y0 != geometry.y0 ||
+        h.imageWidth != geometry.imageWidth ||
+        h.imageHeight != geometry.imageHeight) {
+      fprintf(stderr, "Error: %s does not cover the region of %s\n",
+              inputs[f].c_str(), inputs[0].c_str());
+      return -1;
+    }
+    if (!runs.insert(std::make_pair(h.seed, h.mpiRank)).second) {
+      fprintf(stderr, "Warning: %s was rendered with the seed %u of an "
+                      "earlier file\n", inputs[f].c_str(), h.seed);
+    }
+    hasM2 = hasM2 && h.hasM2;
+    const Color3f *sum = view.Sum();
+    const qaUINT *count = view.Count();
+    const qaFLOAT *m2 = view.M2();
+    Color3f *accum = merged.GetAccumulation();
+    qaUINT *accumCount = merged.GetAccumulationCount();
+    qaFLOAT *accumM2 = merged.GetAccumulationM2();
+    const size_t n = size_t(h.width) * h.height;
+    tasking::parallel_for(tasking::blocked_range<size_t>(0, n, 4096),
+                          [&](const tasking::blocked_range<size_t> &r) {
+      for (size_t i = r.begin(); i < r.end(); ++i) {
+        accum[i] += sum[i];
+        accumCount[i] += count[i];
+        if (m2 != nullptr) { accumM2[i] += m2[i]; }
+      }
+    });
+    view.Close();
+  }
+  //! the sample-count image is scaled by the largest count
+  const qaUINT *accumCount = merged.GetAccumulationCount();
+  qaUINT sppMax = 1;
+  uint64_t numSamples = 0;
+  for (size_t i = 0; i < size_t(geometry.width) * geometry.height; ++i) {
+    sppMax = MAX(sppMax, accumCount[i]);
+    numSamples += accumCount[i];
+  }
+  merged.ResolveAccumulation(useSRGB, sppMax);
+  if (!merged.SaveImage(output.c_str())) {
+    fprintf(stderr, "Error: failed to write %s\n", output.c_str());
+    return -1;
+  }
+  if (!accumOutput.empty() &&
+      !WriteAccumFile(accumOutput, geometry, merged.GetAccumulation(),
+                      merged.GetAccumulationCount(),
+                      hasM2 ? merged.GetAccumulationM2() : nullptr)) {
+    fprintf(stderr, "Error: failed to write %s\n", accumOutput.c_str());
+    return -1;
+  }
+  printf("merged %zu files, %.2f spp on average, %u spp at most\n",
+         inputs.size(),
+         numSamples / static_cast<double>(geometry.width * geometry.height),
+         sppMax);
+  return 0;
+}
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+///
+/// \file       ParallelForBench.cpp
+/// \author     Qi WU
+///
+/// \brief Scheduling overhead of the tasking loops. A saxpy kernel is run
+///        through the std::function based parallel_for and through the
+///        templated range loops with different grain sizes and partitioners.
+///
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "tasking/parallel_range.h"
+
+using namespace qaray;
+
+template<typename F>
+static double Measure(int repeat, const F &f)
+{
+  f(); // warm up
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int r = 0; r < repeat; ++r) { f(); }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count() / repeat;
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = size_t(1) << 22;
+  int repeat = 10;
+  for (int i = 1; i < argc; ++i) {
+    std::string str(argv[i]);
+    if (str == "-threads" && i + 1 < argc) {
+      tasking::set_num_of_threads(static_cast<size_t>(std::atoi(argv[++i])));
+    } else if (str == "-n" && i + 1 < argc) {
+      n = static_cast<size_t>(std::atoll(argv[++i]));
+    } else if (str == "-repeat" && i + 1 < argc) {
+      repeat = std::atoi(argv[++i]);
+    }
+  }
+  repeat = repeat > 0 ? repeat : 1;
+  tasking::init();
+  std::vector<float> x(n, 1.f), y(n, 0.f);
+  const float a = 0.5f;
+  auto Report = [&](const char *name, double t) {
+    printf("%-36s %10.3f ms %8.3f ns/index\n", name, t * 1e3, t * 1e9 / n);
+  };
+  printf("threads %zu, %zu indices\n", tasking::get_num_of_threads(), n);
+  Report("std::function parallel_for", Measure(repeat, [&]() {
+    tasking::parallel_for(0, n, 1, [&](size_t i) { y[i] += a * x[i]; });
+  }));
+  const size_t grains[] = {1, 64, 1024, 16384};
+  const tasking::partitioner parts[] = {tasking::partitioner::AUTO,
+                                        tasking::partitioner::SIMPLE,
+                                        tasking::partitioner::STATIC};
+  const char *partNames[] = {"auto", "simple", "static"};
+  for (int p = 0; p < 3; ++p) {
+    for (auto grain : grains) {
+      char name[64];
+      snprintf(name, sizeof(name), "range parallel_for %-6s grain %zu",
+               partNames[p], grain);
+      Report(name, Measure(repeat, [&]() {
+        tasking::parallel_for(
+            tasking::blocked_range<size_t>(0, n, grain),
+            [&](const tasking::blocked_range<size_t> &r) {
+              for (size_t i = r.begin(); i < r.end(); ++i) {
+                y[i] += a * x[i];
+              }
+            }, parts[p]);
+      }));
+    }
+  }
+  double sum = 0.0;
+  Report("parallel_reduce auto grain 1024", Measure(repeat, [&]() {
+    sum = tasking::parallel_reduce(
+        tasking::blocked_range<size_t>(0, n, 1024), 0.0,
+        [&](const tasking::blocked_range<size_t> &r, double s) {
+          for (size_t i = r.begin(); i < r.end(); ++i) { s += y[i]; }
+          return s;
+        },
+        [](double l, double r) { return l + r; });
+  }));
+  printf("checksum %f\n", sum);
+  return 0;
+}
@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------------
+///
+/// \file       RayQueryBench.cpp
+/// \author     Qi WU
+///
+/// \brief Throughput benchmark for the batched ray query API. Primary rays
+///        are generated through the pixel centers of the scene camera, the
+///        occlusion test then shoots rays from every hit back to the camera.
+///
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "parser/xmlload.h"
+#include "query/rayquery.h"
+#include "tasking/parallel_for.h"
+
+using namespace qaray;
+
+template<typename F>
+static double Measure(int repeat, const F &f)
+{
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int r = 0; r < repeat; ++r) { f(); }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count() / repeat;
+}
+
+int main(int argc, char **argv)
+{
+  const char *file = nullptr;
+  int repeat = 5;
+  size_t grain = RayQuery::defaultGrainSize;
+  for (int i = 1; i < argc; ++i) {
+    std::string str(argv[i]);
+    if (str == "-threads" && i + 1 < argc) {
+      tasking::set_num_of_threads(static_cast<size_t>(std::atoi(argv[++i])));
+    } else if (str == "-grain" && i + 1 < argc) {
+      grain = static_cast<size_t>(std::atoi(argv[++i]));
+    } else if (str == "-repeat" && i + 1 < argc) {
+      repeat = std::atoi(argv[++i]);
+    } else {
+      file = argv[i];
+    }
+  }
+  repeat = MAX(repeat, 1);
+  if (file == nullptr) {
+    fprintf(stderr, "usage: %s [-threads N] [-grain N] [-repeat N] "
+        "<scene.xml>\n", argv[0]);
+    return 1;
+  }
+  tasking::init();
+  LoadSceneInSilentMode(true);
+  if (LoadScene(file) == 0) { return 1; }
+  //! camera rays through pixel centers
+  const Camera &cam = scene.camera;
+  const size_t w = static_cast<size_t>(cam.imgWidth);
+  const size_t h = static_cast<size_t>(cam.imgHeight);
+  const size_t n = w * h;
+  const float screenH = 2.f * std::tan(cam.fovy * PI / 2.f / 180.f);
+  const float screenW = screenH * w / static_cast<float>(h);
+  const Point3 X = normalize(cross(cam.dir, cam.up));
+  const Point3 Y = normalize(cross(X, cam.dir));
+  const Point3 Z = normalize(-cam.dir);
+  std::vector<qaFLOAT> ox(n, cam.pos.x), oy(n, cam.pos.y), oz(n, cam.pos.z);
+  std::vector<qaFLOAT> dx(n), dy(n), dz(n);
+  for (size_t j = 0; j < h; ++j) {
+    for (size_t i = 0; i < w; ++i) {
+      const Point3 d = normalize
+          (-Z + X * screenW * ((i + 0.5f) / w - 0.5f)
+               + Y * screenH * (0.5f - (j + 0.5f) / h));
+      dx[j * w + i] = d.x; dy[j * w + i] = d.y; dz[j * w + i] = d.z;
+    }
+  }
+  //! closest hit
+  RayQuery query(scene);
+  query.SetGrainSize(grain);
+  RayBatch rays;
+  rays.count = n;
+  rays.orgX = ox.data(); rays.orgY = oy.data(); rays.orgZ = oz.data();
+  rays.dirX = dx.data(); rays.dirY = dy.data(); rays.dirZ = dz.data();
+  std::vector<qaFLOAT> t(n), nx(n), ny(n), nz(n);
+  std::vector<qaINT> prim(n), inst(n);
+  HitBatch hits;
+  hits.t = t.data(); hits.primID = prim.data(); hits.instID = inst.data();
+  hits.nX = nx.data(); hits.nY = ny.data(); hits.nZ = nz.data();
+  const double tHit = Measure(repeat, [&]() { query.Intersect(rays, hits); });
+  //! occlusion rays from every hit back to the camera
+  std::vector<qaFLOAT> sx, sy, sz, sdx, sdy, sdz, smax;
+  for (size_t k = 0; k < n; ++k) {
+    if (inst[k] < 0) { continue; }
+    const Point3 p = cam.pos + Point3(dx[k], dy[k], dz[k]) * t[k];
+    sx.push_back(p.x); sy.push_back(p.y); sz.push_back(p.z);
+    sdx.push_back(cam.pos.x - p.x);
+    sdy.push_back(cam.pos.y - p.y);
+    sdz.push_back(cam.pos.z - p.z);
+    smax.push_back(1.f);
+  }
+  RayBatch shadows;
+  shadows.count = sx.size();
+  shadows.orgX = sx.data(); shadows.orgY = sy.data(); shadows.orgZ = sz.data();
+  shadows.dirX = sdx.data(); shadows.dirY = sdy.data(); shadows.dirZ = sdz.data();
+  shadows.tmax = smax.data();
+  std::vector<qaUCHAR> occluded(shadows.count);
+  const double tOcc = Measure(repeat, [&]() {
+    query.Occluded(shadows, occluded.data());
+  });
+  size_t numBlocked = 0;
+  for (auto o : occluded) { numBlocked += o; }
+  //! report
+  printf("threads %zu, grain %zu, instances %zu\n",
+         tasking::get_num_of_threads(), query.GetGrainSize(),
+         query.GetNumInstances());
+  printf("closest hit: %zu rays, %zu hits, %.3f ms, %.3f Mrays/s\n",
+         n, shadows.count, tHit * 1e3, n / tHit * 1e-6);
+  printf("occlusion  : %zu rays, %zu blocked, %.3f ms, %.3f Mrays/s\n",
+         shadows.count, numBlocked, tOcc * 1e3,
+         shadows.count / MAX(tOcc, 1e-9) * 1e-6);
+  return 0;
+}
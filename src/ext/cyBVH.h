@@ -36,6 +36,8 @@
 #ifndef _CY_BVH_H_INCLUDED_
 #define _CY_BVH_H_INCLUDED_
 
+#include <cstddef>
+
 //-------------------------------------------------------------------------------
 namespace cy {
 //-------------------------------------------------------------------------------
@@ -64,7 +66,7 @@ class BVH {
  public:
 
   //!@name Constructor and destructor
-  BVH() : nodes(0), elements(0) {}
+  BVH() : nodes(0), elements(0), numNodes(0), numElements(0), owned(true) {}
   virtual ~BVH() { Clear(); }
 
   //////////////////////////////////////////////////////////////////////////!//!//!
@@ -134,10 +136,35 @@ class BVH {
   //! Clears the tree structure
   void Clear()
   {
-    if (nodes) delete[] nodes;
+    if (owned && nodes) delete[] nodes;
     nodes = 0;
-    if (elements) delete[] elements;
+    if (owned && elements) delete[] elements;
     elements = 0;
+    numNodes = numElements = 0;
+    owned = true;
+  }
+
+  //! Returns the size of the node array (including the unused first node)
+  //! in bytes and the node array, for copying the tree.
+  size_t GetNodeDataSize() const { return numNodes * sizeof(Node); }
+  const void *GetNodeData() const { return nodes; }
+  //! Returns the number of elements in all nodes and their indices.
+  unsigned int GetElementCount() const { return numElements; }
+  const unsigned int *GetElements() const { return elements; }
+
+  //! Uses the node and element arrays of a copied tree in place. The arrays
+  //! are kept by the caller and must stay valid while the tree is used.
+  void Attach(const void *nodeData,
+              size_t nodeDataSize,
+              const unsigned int *elementData,
+              unsigned int elementCount)
+  {
+    Clear();
+    nodes = static_cast<Node *>(const_cast<void *>(nodeData));
+    numNodes = static_cast<unsigned int>(nodeDataSize / sizeof(Node));
+    elements = const_cast<unsigned int *>(elementData);
+    numElements = elementCount;
+    owned = false;
   }
 
   //! Builds the tree structure by recursively splitting the nodes. maxElementsPerNode cannot be larger than 8.
@@ -149,6 +176,7 @@ class BVH {
     if (maxElementsPerNode > CY_BVH_MAX_ELEMENT_COUNT)
       maxElementsPerNode = CY_BVH_MAX_ELEMENT_COUNT;
     elements = new unsigned int[numElements];
+    this->numElements = numElements;
     for (unsigned int i = 0; i < numElements; i++) elements[i] = i;
     Box box;
     box.Init();
@@ -159,8 +187,8 @@ class BVH {
     }
     TempNode *tempRoot = new TempNode(numElements, 0, box);
     SplitTempNode(tempRoot, maxElementsPerNode);
-    unsigned int numNodes = tempRoot->GetNumNodes();
-    nodes = new Node[numNodes + 1];
+    numNodes = tempRoot->GetNumNodes() + 1;
+    nodes = new Node[numNodes];
     ConvertTempData(1, tempRoot, 2);
     delete tempRoot;
   }
@@ -269,6 +297,9 @@ class BVH {
   Node *
       nodes;        //!< the tree structure that keeps all the node data (nodeData[0] is not used for cache coherency)
   unsigned int *elements;    //!< indices of all elements in all nodes
+  unsigned int numNodes;     //!< size of the node array
+  unsigned int numElements;  //!< size of the element array
+  bool owned;                //!< false when the arrays belong to the caller of Attach
 
   //////////////////////////////////////////////////////////////////////////!//!//!
   //@ Internal methods for building the BVH tree
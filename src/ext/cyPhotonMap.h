@@ -76,20 +76,30 @@ class PhotonMap {
   virtual ~PhotonMap() {}
 
   /// Removes all photons and deallocates the memory.
-  void Clear() { std::vector<Photon>().swap(photons); }
+  void Clear()
+  {
+    std::vector<Photon>().swap(photons);
+    sharedPhotons = NULL;
+    numShared = 0;
+  }
 
   /// Allocates enough memory for n photons.
   /// Calling this method before adding photons avoids
   /// multiple memory allocations while adding photons.
   void AllocatePhotons(unsigned int n) { photons.reserve(n + 1); }
-  void CreateAllPhotons(unsigned int n) { photons.resize(n + 1); }
+  void CreateAllPhotons(unsigned int n)
+  {
+    sharedPhotons = NULL;
+    numShared = 0;
+    photons.resize(n + 1);
+  }
 
   /// Adds a photon to the map with the given position, direction, and power.
   /// Assumes that the direction is normalized.
   void AddPhoton(const Point3f &pos, const Point3f &dir, const Color &power);
 
   /// Returns the number of photons stored in the map
-  unsigned int NumPhotons() const { return photons.size() - 1; }
+  unsigned int NumPhotons() const { return NumStored() - 1; }
 
   /// Scales the photon powers using the given scale factor
   void ScalePhotonPowers(float scale, int start = 0, int end = -1)
@@ -124,14 +134,40 @@ class PhotonMap {
 
   /// Returns the photon i.
   Photon &operator[](unsigned int i) { return photons[i + 1]; }
-  const Photon &operator[](unsigned int i) const { return photons[i + 1]; }
+  const Photon &operator[](unsigned int i) const { return Stored()[i + 1]; }
   Photon *GetPhotons() { return &photons[1]; }
-  const Photon *GetPhotons() const { return &photons[1]; }
+  const Photon *GetPhotons() const { return Stored() + 1; }
+
+  /// Returns the stored photons of a prepared map, the first one is not
+  /// used, and their number, for copying the balanced kd-tree.
+  const Photon *GetStoredPhotons() const { return Stored(); }
+  unsigned int NumStored() const
+  {
+    return sharedPhotons ? numShared : (unsigned int) photons.size();
+  }
+
+  /// Uses the balanced kd-tree of another map, as returned by
+  /// GetStoredPhotons(), in place and releases the own photons. The tree is
+  /// kept by the caller and must stay valid while the map is used.
+  void UseStoredPhotons(const Photon *stored, unsigned int n)
+  {
+    std::vector<Photon>().swap(photons);
+    sharedPhotons = stored;
+    numShared = n;
+    halfStoredPhotons = (n - 1) / 2 - 1;
+  }
 
  protected:
   std::vector<Photon> photons;
+  const Photon *sharedPhotons = NULL;
+  unsigned int numShared = 0;
   int halfStoredPhotons;
 
+  const Photon *Stored() const
+  {
+    return sharedPhotons ? sharedPhotons : photons.data();
+  }
+
  private:
   /// Balances the given kd-tree segment
   void BalanceSegment(std::vector<Photon> &balancedMap,
@@ -425,7 +461,7 @@ inline bool PhotonMap::GetNearestPhoton(PhotonMap::Photon &photon,
 
 inline void PhotonMap::LocatePhotons(NearestPhotons &np, const int index) const
 {
-  const Photon &p = photons[index];
+  const Photon &p = Stored()[index];
   int axis = p.GetPlane();
 
   // if this is an internal node
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+///
+/// \file       accumfile.cpp
+/// \author     Qi WU
+///
+/// \brief Raw sample accumulation of a run
+///
+//------------------------------------------------------------------------------
+
+#include "accumfile.h"
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+static const uint64_t planeAlignment = 4096;
+static uint64_t AlignPlane(uint64_t offset)
+{
+  return (offset + planeAlignment - 1) / planeAlignment * planeAlignment;
+}
+//! Offsets of the planes of a region
+static void Layout(AccumFileHeader &h)
+{
+  const uint64_t n = uint64_t(h.width) * h.height;
+  h.sumOffset = AlignPlane(sizeof(AccumFileHeader));
+  h.countOffset = AlignPlane(h.sumOffset + n * sizeof(Color3f));
+  h.m2Offset = h.hasM2 ? AlignPlane(h.countOffset + n * sizeof(qaUINT)) : 0;
+  h.fileSize = h.hasM2 ? h.m2Offset + n * sizeof(qaFLOAT) :
+               h.countOffset + n * sizeof(qaUINT);
+}
+///--------------------------------------------------------------------------//
+bool WriteAccumFile(const std::string &path, const AccumFileHeader &geometry,
+                    const Color3f *sum, const qaUINT *count,
+                    const qaFLOAT *m2)
+{
+  AccumFileHeader h = geometry;
+  h.hasM2 = m2 != nullptr;
+  Layout(h);
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (fp == nullptr) { return false; }
+  const size_t n = size_t(h.width) * h.height;
+  uint64_t pos = 0;
+  bool good = true;
+  auto Put = [&](const void *src, uint64_t offset, size_t bytes) {
+    static const char zeros[planeAlignment] = {0};
+    while (good && pos < offset) {
+      const auto k = static_cast<size_t>(MIN(offset - pos, planeAlignment));
+      good = fwrite(zeros, 1, k, fp) == k;
+      pos += k;
+    }
+    good = good && fwrite(src, 1, bytes, fp) == bytes;
+    pos += bytes;
+  };
+  Put(&h, 0, sizeof(h));
+  Put(sum, h.sumOffset, n * sizeof(Color3f));
+  Put(count, h.countOffset, n * sizeof(qaUINT));
+  if (h.hasM2) { Put(m2, h.m2Offset, n * sizeof(qaFLOAT)); }
+  good = fclose(fp) == 0 && good;
+  return good;
+}
+///--------------------------------------------------------------------------//
+bool AccumFileView::Open(const std::string &path)
+{
+  Close();
+  size_t fileSize = 0;
+#ifndef _WIN32
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: cannot open %s\n", path.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    fileSize = static_cast<size_t>(st.st_size);
+    void *p = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      // the planes are read once, front to back
+      madvise(p, fileSize, MADV_SEQUENTIAL);
+      data = static_cast<const char *>(p);
+      mapped = true;
+    }
+  }
+  close(fd);
+#endif
+  if (!mapped) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) {
+      fprintf(stderr, "Error: cannot open %s\n", path.c_str());
+      return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    buffer.resize(static_cast<size_t>(MAX(ftell(fp), 0L)));
+    fseek(fp, 0, SEEK_SET);
+    fileSize = fread(buffer.data(), 1, buffer.size(), fp);
+    fclose(fp);
+    data = buffer.data();
+  }
+  size = fileSize;
+  // the header has to match the layout this version writes
+  if (size < sizeof(AccumFileHeader)) {
+    fprintf(stderr, "Error: %s is not an accumulation file\n", path.c_str());
+    Close();
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  AccumFileHeader expected = header;
+  Layout(expected);
+  if (std::string(header.magic, 4) != "QAAC" || header.version != 1 ||
+      header.sumOffset != expected.sumOffset ||
+      header.countOffset != expected.countOffset ||
+      header.m2Offset != expected.m2Offset ||
+      header.fileSize != expected.fileSize || size < header.fileSize) {
+    fprintf(stderr, "Error: %s is not a valid accumulation file\n",
+            path.c_str());
+    Close();
+    return false;
+  }
+  return true;
+}
+void AccumFileView::Close()
+{
+#ifndef _WIN32
+  if (mapped) { munmap(const_cast<char *>(data), size); }
+#endif
+  mapped = false;
+  data = nullptr;
+  size = 0;
+  buffer.clear();
+  buffer.shrink_to_fit();
+}
+}
@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+///
+/// \file       accumfile.h
+/// \author     Qi WU
+///
+/// \brief Raw sample accumulation of a run, written next to the images so
+///        that runs of the same frame with different seeds can be added up
+///        before tonemapping. The file is a fixed header followed by the
+///        per-pixel planes, each starting on a page boundary, so that it
+///        can be mapped and read in place. Files written by the ranks of an
+///        MPI run have zero samples outside of their own tiles and merge
+///        the same way.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_ACCUMFILE_H
+#define QARAY_ACCUMFILE_H
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Layout of an accumulation file. The planes are the radiance sums
+//! (3 floats per pixel), the sample counts and, when 'hasM2' is set, the
+//! sums of the squared luminance. Values are stored in the byte order of
+//! the machine that wrote them.
+struct AccumFileHeader {
+  char magic[4] = {'Q', 'A', 'A', 'C'};
+  qaUINT version = 1;
+  qaUINT width = 0, height = 0;  // size of the stored region
+  qaUINT x0 = 0, y0 = 0;         // offset of the region in the image
+  qaUINT imageWidth = 0, imageHeight = 0;
+  qaUINT seed = 0;               // of the run, see Sampler_Counter
+  qaUINT mpiRank = 0;            // rank that wrote the file
+  qaUINT hasM2 = 0;
+  qaUINT reserved = 0;
+  uint64_t sumOffset = 0;        // byte offsets of the planes
+  uint64_t countOffset = 0;
+  uint64_t m2Offset = 0;
+  uint64_t fileSize = 0;
+};
+///--------------------------------------------------------------------------//
+//! Write the accumulation of a region, 'm2' may be null
+bool WriteAccumFile(const std::string &path, const AccumFileHeader &geometry,
+                    const Color3f *sum, const qaUINT *count,
+                    const qaFLOAT *m2);
+///--------------------------------------------------------------------------//
+//! Read-only view of an accumulation file. The file is mapped where the
+//! platform allows it and read into memory otherwise.
+class AccumFileView {
+ private:
+  AccumFileHeader header;
+  const char *data = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+  std::vector<char> buffer;
+ public:
+  AccumFileView() = default;
+  AccumFileView(const AccumFileView &) = delete;
+  AccumFileView &operator=(const AccumFileView &) = delete;
+  ~AccumFileView() { Close(); }
+  //! Returns false and prints why when the file is not a valid one
+  bool Open(const std::string &path);
+  void Close();
+  const AccumFileHeader &Header() const { return header; }
+  const Color3f *Sum() const
+  {
+    return reinterpret_cast<const Color3f *>(data + header.sumOffset);
+  }
+  const qaUINT *Count() const
+  {
+    return reinterpret_cast<const qaUINT *>(data + header.countOffset);
+  }
+  //! null when the file has no second moment
+  const qaFLOAT *M2() const
+  {
+    return header.hasM2 ?
+           reinterpret_cast<const qaFLOAT *>(data + header.m2Offset) :
+           nullptr;
+  }
+};
+}
+
+#endif //QARAY_ACCUMFILE_H
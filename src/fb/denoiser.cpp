@@ -0,0 +1,302 @@
+//------------------------------------------------------------------------------
+///
+/// \file       denoiser.cpp
+/// \author     Qi WU
+///
+/// \brief Edge-avoiding a-trous wavelet filter
+///
+//------------------------------------------------------------------------------
+
+#include "denoiser.h"
+#include "tasking/parallel_range.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace qaray::tasking;
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! exp(x) for x <= 0, relative error below 1e-4. Written without branches,
+//! comparisons or library calls so that the loops calling it get vectorized
+//! (max(a, 0) is (a + |a|) / 2).
+static inline float FastExp(float x)
+{
+  // 2^t with the exponent bias added, positive so that truncation floors
+  const float u = x * 1.442695041f + 126.f;
+  const float t = 0.5f * (u + std::fabs(u)) + 1.f;
+  const int32_t i = static_cast<int32_t>(t);
+  const float f = t - static_cast<float>(i);
+  const float p = 1.f + f * (0.6931472f + f * (0.2402265f +
+      f * (0.05550411f + f * 0.009618129f)));
+  const int32_t bits = i << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(float));
+  return p * scale;
+}
+//! max(dot(N, N'), 0)^128 by repeated squaring
+static inline float NormalWeight(float d)
+{
+  d = 0.5f * (d + std::fabs(d));
+  d *= d; // 2
+  d *= d; // 4
+  d *= d; // 8
+  d *= d; // 16
+  d *= d; // 32
+  d *= d; // 64
+  return d * d;
+}
+static const long chunk = 64; // pixels of a row filtered together
+static const float kernel[5] = {1.f / 16.f, 1.f / 4.f, 3.f / 8.f,
+                                1.f / 4.f, 1.f / 16.f};
+///--------------------------------------------------------------------------//
+/// Split the input into planes. The radiance is divided by the albedo,
+/// which is kept away from zero so that black surfaces do not blow up the
+/// noise, and the variance is scaled accordingly.
+///--------------------------------------------------------------------------//
+void Denoiser::Load(const DenoiserInput &in)
+{
+  w = in.width;
+  h = in.height;
+  const size_t n = w * h;
+  for (int k = 0; k < 2; ++k) {
+    r[k].resize(n);
+    g[k].resize(n);
+    b[k].resize(n);
+    var[k].resize(n);
+  }
+  for (auto p : {&luma, &varBlur, &nx, &ny, &nz, &z, &hit, &dzx, &dzy,
+                 &ar, &ag, &ab, &ok}) {
+    p->resize(n);
+  }
+  parallel_for_each(size_t(0), n, 4096, [&](size_t i) {
+    const bool valid = in.valid[i] != 0;
+    const Color3f a(MAX(in.albedo[i].x, 0.01f), MAX(in.albedo[i].y, 0.01f),
+                    MAX(in.albedo[i].z, 0.01f));
+    const Color3f e = valid ? in.color[i] / a : Color3f(0.f);
+    const float la = ColorLuma(a);
+    ok[i] = valid ? 1.f : 0.f;
+    r[0][i] = e.x;
+    g[0][i] = e.y;
+    b[0][i] = e.z;
+    var[0][i] = !valid ? 0.f :
+                in.variance[i] < 0.f ? -1.f : in.variance[i] / (la * la);
+    ar[i] = a.x;
+    ag[i] = a.y;
+    ab[i] = a.z;
+    const bool hasHit = valid && in.depth[i] < BIGFLOAT;
+    hit[i] = hasHit ? 1.f : 0.f;
+    z[i] = hasHit ? in.depth[i] : BIGFLOAT;
+    nx[i] = hasHit ? in.normal[i].x : 0.f;
+    ny[i] = hasHit ? in.normal[i].y : 0.f;
+    nz[i] = hasHit ? in.normal[i].z : 0.f;
+  });
+  // depth gradient, the smaller one-sided difference so that it does not
+  // jump at silhouettes
+  parallel_for_each(size_t(0), h, 4, [&](size_t y) {
+    auto Gradient = [&](size_t i, bool hasA, size_t a, bool hasB, size_t b) {
+      float d = BIGFLOAT;
+      if (hasA && z[a] < BIGFLOAT) { d = MIN(d, std::fabs(z[i] - z[a])); }
+      if (hasB && z[b] < BIGFLOAT) { d = MIN(d, std::fabs(z[i] - z[b])); }
+      return d < BIGFLOAT ? d : 0.f;
+    };
+    for (size_t x = 0; x < w; ++x) {
+      const size_t i = y * w + x;
+      if (z[i] >= BIGFLOAT) {
+        dzx[i] = dzy[i] = 0.f;
+        continue;
+      }
+      dzx[i] = Gradient(i, x > 0, i - 1, x + 1 < w, i + 1);
+      dzy[i] = Gradient(i, y > 0, i - w, y + 1 < h, i + w);
+    }
+  });
+}
+///--------------------------------------------------------------------------//
+/// Pixels with a single sample have no variance of their own, the spatial
+/// variance of the luminance over the 5x5 neighbors on the same surface is
+/// used instead
+///--------------------------------------------------------------------------//
+void Denoiser::EstimateVariance(int src)
+{
+  std::vector<float> estimate(w * h);
+  parallel_for_each(size_t(0), h, 4, [&](size_t y) {
+    for (size_t x = 0; x < w; ++x) {
+      const size_t p = y * w + x;
+      estimate[p] = var[src][p];
+      if (ok[p] == 0.f || var[src][p] >= 0.f) { continue; }
+      float sw = 0.f, m1 = 0.f, m2 = 0.f;
+      for (int dy = -2; dy <= 2; ++dy) {
+        const auto qy = static_cast<long>(y) + dy;
+        if (qy < 0 || qy >= static_cast<long>(h)) { continue; }
+        for (int dx = -2; dx <= 2; ++dx) {
+          const auto qx = static_cast<long>(x) + dx;
+          if (qx < 0 || qx >= static_cast<long>(w)) { continue; }
+          const size_t q = qy * w + qx;
+          if (ok[q] == 0.f) { continue; }
+          const bool hp = z[p] < BIGFLOAT, hq = z[q] < BIGFLOAT;
+          if (hp != hq) { continue; }
+          float wq = 1.f;
+          if (hp) {
+            wq = NormalWeight(nx[p] * nx[q] + ny[p] * ny[q] + nz[p] * nz[q]);
+            const float gz = sigmaDepth * (dzx[p] * std::abs(dx) +
+                dzy[p] * std::abs(dy)) + 1e-3f * z[p];
+            wq *= FastExp(-std::fabs(z[p] - z[q]) / gz);
+          }
+          const float l = ColorLuma(Color3f(r[src][q], g[src][q], b[src][q]));
+          sw += wq;
+          m1 += wq * l;
+          m2 += wq * l * l;
+        }
+      }
+      m1 /= sw;
+      m2 /= sw;
+      estimate[p] = MAX(0.f, m2 - m1 * m1);
+    }
+  });
+  var[src].swap(estimate);
+}
+///--------------------------------------------------------------------------//
+/// Luminance of the current iteration and its variance blurred by a 3x3
+/// Gaussian, which steadies the luminance weight
+///--------------------------------------------------------------------------//
+void Denoiser::PrepareIteration(int src)
+{
+  const float *R = r[src].data(), *G = g[src].data(), *B = b[src].data();
+  const float *V = var[src].data();
+  parallel_for_each(size_t(0), h, 4, [&](size_t y) {
+    float *L = &luma[y * w];
+    for (size_t x = 0; x < w; ++x) {
+      const size_t i = y * w + x;
+      L[x] = 0.2126f * R[i] + 0.7152f * G[i] + 0.0722f * B[i];
+    }
+    for (size_t x = 0; x < w; ++x) {
+      const size_t p = y * w + x;
+      float sw = 0.f, sv = 0.f;
+      for (long dy = -1; dy <= 1; ++dy) {
+        const long qy = static_cast<long>(y) + dy;
+        if (qy < 0 || qy >= static_cast<long>(h)) { continue; }
+        for (long dx = -1; dx <= 1; ++dx) {
+          const long qx = static_cast<long>(x) + dx;
+          if (qx < 0 || qx >= static_cast<long>(w)) { continue; }
+          const size_t q = qy * w + qx;
+          const float k = ok[q] * (dx == 0 ? 0.5f : 0.25f) *
+              (dy == 0 ? 0.5f : 0.25f);
+          sw += k;
+          sv += k * V[q];
+        }
+      }
+      varBlur[p] = sw > 0.f ? sv / sw : 0.f;
+    }
+  });
+}
+///--------------------------------------------------------------------------//
+/// One level of the filter with taps 'step' pixels apart. The variance is
+/// carried along as the weighted sum of the variances of the taps. Rows are
+/// done in chunks whose sums are kept in local arrays, so that the compiler
+/// can tell that they do not alias the planes and vectorizes the taps.
+///--------------------------------------------------------------------------//
+void Denoiser::Iterate(int src, size_t step)
+{
+  const int dst = 1 - src;
+  const float invSigmaAlbedo = 1.f / sigmaAlbedo;
+  const long width = static_cast<long>(w);
+  parallel_for_each(size_t(0), h, 1, [&](size_t y) {
+    const size_t rowP = y * w;
+    const float *zp = &z[rowP], *hp = &hit[rowP];
+    const float *nxp = &nx[rowP], *nyp = &ny[rowP];
+    const float *nzp = &nz[rowP], *dzxp = &dzx[rowP], *dzyp = &dzy[rowP];
+    const float *arp = &ar[rowP], *agp = &ag[rowP], *abp = &ab[rowP];
+    const float *lp = &luma[rowP], *vbp = &varBlur[rowP];
+    for (long x0 = 0; x0 < width; x0 += chunk) {
+      const long x1 = MIN(x0 + chunk, width);
+      float SW[chunk], SR[chunk], SG[chunk], SB[chunk], SV[chunk], SL[chunk];
+      for (long x = x0; x < x1; ++x) {
+        SW[x - x0] = SR[x - x0] = SG[x - x0] = SB[x - x0] = SV[x - x0] = 0.f;
+        SL[x - x0] = 1.f / (sigmaLuma * std::sqrt(vbp[x]) + 1e-6f);
+      }
+      for (int dy = -2; dy <= 2; ++dy) {
+        const long qy = static_cast<long>(y) + dy * static_cast<long>(step);
+        if (qy < 0 || qy >= static_cast<long>(h)) { continue; }
+        const size_t rowQ = qy * w;
+        const float *zq = &z[rowQ], *hq = &hit[rowQ];
+        const float *nxq = &nx[rowQ], *nyq = &ny[rowQ];
+        const float *nzq = &nz[rowQ], *okq = &ok[rowQ];
+        const float *arq = &ar[rowQ], *agq = &ag[rowQ], *abq = &ab[rowQ];
+        const float *lq = &luma[rowQ];
+        const float *rq = &r[src][rowQ], *gq = &g[src][rowQ];
+        const float *bq = &b[src][rowQ], *vq = &var[src][rowQ];
+        for (int dx = -2; dx <= 2; ++dx) {
+          const long off = dx * static_cast<long>(step);
+          const long xb = MAX(x0, -off), xe = MIN(x1, width - off);
+          const float k = kernel[dx + 2] * kernel[dy + 2];
+          const float adx = static_cast<float>(std::abs(off));
+          const float ady = static_cast<float>(std::abs(dy) * step);
+          for (long x = xb; x < xe; ++x) {
+            const long q = x + off, c = x - x0;
+            const float both = hp[x] * hq[q];
+            // same surface: both hit and agree, or both missed
+            const float wn = both * NormalWeight(nxp[x] * nxq[q] +
+                nyp[x] * nyq[q] + nzp[x] * nzq[q]) +
+                (1.f - hp[x]) * (1.f - hq[q]);
+            const float dz = both * std::fabs(zp[x] - zq[q]) /
+                (sigmaDepth * (dzxp[x] * adx + dzyp[x] * ady) + 1e-3f * zp[x]);
+            const float dl = std::fabs(lp[x] - lq[q]) * SL[c];
+            const float da = (std::fabs(arp[x] - arq[q]) +
+                std::fabs(agp[x] - agq[q]) +
+                std::fabs(abp[x] - abq[q])) * invSigmaAlbedo;
+            const float wq = k * okq[q] * wn * FastExp(-(dz + dl + da));
+            SW[c] += wq;
+            SR[c] += wq * rq[q];
+            SG[c] += wq * gq[q];
+            SB[c] += wq * bq[q];
+            SV[c] += wq * wq * vq[q];
+          }
+        }
+      }
+      for (long x = x0; x < x1; ++x) {
+        const size_t p = rowP + x;
+        const long c = x - x0;
+        if (ok[p] == 0.f || SW[c] <= 0.f) {
+          r[dst][p] = r[src][p];
+          g[dst][p] = g[src][p];
+          b[dst][p] = b[src][p];
+          var[dst][p] = var[src][p];
+          continue;
+        }
+        const float inv = 1.f / SW[c];
+        r[dst][p] = SR[c] * inv;
+        g[dst][p] = SG[c] * inv;
+        b[dst][p] = SB[c] * inv;
+        var[dst][p] = SV[c] * inv * inv;
+      }
+    }
+  });
+}
+///--------------------------------------------------------------------------//
+void Denoiser::Filter(const DenoiserInput &in, Color3f *out,
+                      float *outVariance)
+{
+  Load(in);
+  int src = 0;
+  EstimateVariance(src);
+  for (int it = 0; it < iterations; ++it) {
+    PrepareIteration(src);
+    Iterate(src, size_t(1) << it);
+    src = 1 - src;
+  }
+  parallel_for_each(size_t(0), w * h, 4096, [&](size_t i) {
+    if (ok[i] == 0.f) {
+      out[i] = in.color[i];
+      if (outVariance) { outVariance[i] = MAX(in.variance[i], 0.f); }
+      return;
+    }
+    const Color3f a(ar[i], ag[i], ab[i]);
+    out[i] = Color3f(r[src][i], g[src][i], b[src][i]) * a;
+    if (outVariance) {
+      const float la = ColorLuma(a);
+      outVariance[i] = var[src][i] * la * la;
+    }
+  });
+}
+}
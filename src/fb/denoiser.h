@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+///
+/// \file       denoiser.h
+/// \author     Qi WU
+///
+/// \brief Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with
+///        the variance guided luminance weight of SVGF (Schied et al. 2017).
+///        The radiance is divided by the albedo before filtering so that
+///        textures stay sharp, and the edge-stopping functions compare the
+///        first-hit normal, depth and albedo of the pixels. Every iteration
+///        doubles the spacing of a 5x5 B3-spline kernel. The image is kept
+///        as planes of floats and filtered one kernel tap over a whole row
+///        at a time, so that the inner loops are branch free and vectorized
+///        by the compiler.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_DENOISER_H
+#define QARAY_DENOISER_H
+#pragma once
+
+#include <cstddef>
+#include <vector>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Image to filter, every buffer has width * height entries. 'variance' is
+//! the luminance variance of the mean of every pixel, negative when it is
+//! unknown (single sample) in which case it is estimated from the
+//! neighbors. Where the camera ray missed, depth is BIGFLOAT and the normal
+//! null. Pixels whose 'valid' entry is 0 are ignored and left unchanged.
+struct DenoiserInput {
+  size_t width = 0, height = 0;
+  const Color3f *color = nullptr;
+  const float *variance = nullptr;
+  const Point3 *normal = nullptr;
+  const Color3f *albedo = nullptr;
+  const float *depth = nullptr;
+  const qaUCHAR *valid = nullptr;
+};
+///--------------------------------------------------------------------------//
+class Denoiser {
+ public:
+  int iterations = 5;        // the filter reaches 2^(iterations+1)-2 pixels
+  float sigmaLuma = 4.f;     // in standard deviations of the luminance
+  float sigmaDepth = 1.f;    // in depth gradients
+  float sigmaAlbedo = 0.1f;  // the normal weight is dot(N, N')^128
+ private:
+  size_t w = 0, h = 0;
+  //! demodulated radiance and its variance, read and written alternately
+  std::vector<float> r[2], g[2], b[2], var[2];
+  std::vector<float> luma, varBlur;
+  //! features
+  std::vector<float> nx, ny, nz, z, hit, dzx, dzy, ar, ag, ab, ok;
+ public:
+  //! Filter 'in' into 'out', which may be in.color. When given,
+  //! 'outVariance' receives the luminance variance left in every pixel.
+  void Filter(const DenoiserInput &in, Color3f *out,
+              float *outVariance = nullptr);
+ private:
+  void Load(const DenoiserInput &in);
+  void EstimateVariance(int src);
+  void PrepareIteration(int src);
+  void Iterate(int src, size_t step);
+};
+}
+
+#endif //QARAY_DENOISER_H
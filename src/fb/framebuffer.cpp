@@ -1,6 +1,24 @@
 #include <string>
 #include <lodepng.h>
 #include "framebuffer.h"
+#include "tasking/parallel_range.h"
+#include "tasking/numa.h"
+
+using namespace qaray::tasking;
+
+//! Per-pixel buffers are allocated without being written, so that their
+//! pages are placed on the node of the thread that first touches them
+template<typename T>
+static T *AllocatePixels(size_t n)
+{
+  return static_cast<T *>(::operator new[](n * sizeof(T)));
+}
+template<typename T>
+static void FreePixels(T *&p)
+{
+  ::operator delete[](p);
+  p = nullptr;
+}
 
 FrameBuffer::FrameBuffer() :
     mask(nullptr),
@@ -10,40 +28,70 @@ FrameBuffer::FrameBuffer() :
     sampleCount(nullptr),
     sampleCountImg(nullptr),
     irradComp(nullptr),
+    accum(nullptr),
+    accumCount(nullptr),
+    accumM2(nullptr),
+    normal(nullptr),
+    albedo(nullptr),
+    denoisedVar(nullptr),
     width(0),
     height(0),
+    numPasses(1),
     numRenderedPixels(0) {}
 
 FrameBuffer::~FrameBuffer()
 {
-  if (mask) delete[] mask;
-  if (img) delete[] img;
-  if (zbuffer) delete[] zbuffer;
+  FreePixels(mask);
+  FreePixels(img);
+  FreePixels(zbuffer);
   if (zbufferImg) delete[] zbufferImg;
-  if (sampleCount) delete[] sampleCount;
+  FreePixels(sampleCount);
   if (sampleCountImg) delete[] sampleCountImg;
   if (irradComp) delete[] irradComp;
+  FreePixels(accum);
+  FreePixels(accumCount);
+  FreePixels(accumM2);
+  FreePixels(normal);
+  FreePixels(albedo);
+  FreePixels(denoisedVar);
 }
 
 qaVOID FrameBuffer::Init(qaUINT w, qaUINT h)
 {
   width = w;
   height = h;
-  if (mask) delete[] mask;
-  mask = new qaUCHAR[width * height]();
-  if (img) delete[] img;
-  img = new Color3c[width * height];
-  if (zbuffer) delete[] zbuffer;
-  zbuffer = new float[width * height];
+  FreePixels(mask);
+  mask = AllocatePixels<qaUCHAR>(width * height);
+  FreePixels(img);
+  img = AllocatePixels<Color3c>(width * height);
+  FreePixels(zbuffer);
+  zbuffer = AllocatePixels<float>(width * height);
   if (zbufferImg) delete[] zbufferImg;
   zbufferImg = nullptr;
-  if (sampleCount) delete[] sampleCount;
-  sampleCount = new qaUCHAR[width * height];
+  FreePixels(sampleCount);
+  sampleCount = AllocatePixels<qaUCHAR>(width * height);
   if (sampleCountImg) delete[] sampleCountImg;
   sampleCountImg = nullptr;
   if (irradComp) delete[] irradComp;
   irradComp = nullptr;
-  ResetNumRenderedPixels();
+  FreePixels(accum);
+  FreePixels(accumCount);
+  FreePixels(accumM2);
+  FreePixels(normal);
+  FreePixels(albedo);
+  FreePixels(denoisedVar);
+  // every row is first written by the worker that is most likely to
+  // render it, the renderer hands tiles to workers of the same node
+  numa_first_touch(height, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) {
+      mask[i] = 0;
+      img[i] = Color3c(0);
+      zbuffer[i] = BIGFLOAT;
+      sampleCount[i] = 0;
+    }
+  }, rowNode);
+  numPasses = 1;
+  numRenderedPixels = 0;
 }
 
 qaVOID FrameBuffer::AllocateIrradianceComputationImage()
@@ -52,10 +100,93 @@ qaVOID FrameBuffer::AllocateIrradianceComputationImage()
   for (qaINT i = 0; i < width * height; i++) irradComp[i] = 0;
 }
 
+qaVOID FrameBuffer::AllocateAccumulationBuffer()
+{
+  if (!accum) accum = AllocatePixels<Color3f>(width * height);
+  if (!accumCount) accumCount = AllocatePixels<qaUINT>(width * height);
+  if (!accumM2) accumM2 = AllocatePixels<qaFLOAT>(width * height);
+  numa_parallel_for(rowNode, 1, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) {
+      accum[i] = Color3f(0.f);
+      accumCount[i] = 0;
+      accumM2[i] = 0.f;
+    }
+  });
+}
+
+qaVOID FrameBuffer::AllocateFeatureBuffers()
+{
+  if (!normal) normal = AllocatePixels<Point3>(width * height);
+  if (!albedo) albedo = AllocatePixels<Color3f>(width * height);
+  if (!denoisedVar) denoisedVar = AllocatePixels<qaFLOAT>(width * height);
+  numa_parallel_for(rowNode, 1, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) {
+      normal[i] = Point3(0.f);
+      albedo[i] = Color3f(1.f);
+      denoisedVar[i] = 0.f;
+    }
+  });
+}
+
+qaVOID FrameBuffer::ResolveAccumulation(qaBOOL useSRGB, qaUINT sppMax)
+{
+  if (!accum) return;
+  numa_parallel_for(rowNode, 1, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) {
+      if (accumCount[i] == 0) continue;
+      img[i] = ToColor24(accum[i] / static_cast<qaFLOAT>(accumCount[i]),
+                         useSRGB);
+      sampleCount[i] = static_cast<qaUCHAR>(
+          255.f * MIN(accumCount[i], sppMax) / static_cast<qaFLOAT>(sppMax));
+    }
+  });
+}
+
+qaVOID FrameBuffer::DenoiseAccumulation(qaBOOL useSRGB)
+{
+  if (!accum || !normal) return;
+  const size_t size = size_t(width) * height;
+  std::vector<Color3f> color(size);
+  std::vector<qaFLOAT> variance(size);
+  std::vector<qaUCHAR> valid(size);
+  numa_parallel_for(rowNode, 1, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) {
+      const qaUINT n = accumCount[i];
+      valid[i] = n > 0;
+      if (n == 0) {
+        color[i] = Color3f(0.f);
+        variance[i] = 0.f;
+        continue;
+      }
+      const qaFLOAT c = static_cast<qaFLOAT>(n);
+      color[i] = accum[i] / c;
+      // variance of the mean, unknown with a single sample
+      const qaFLOAT l = ColorLuma(color[i]);
+      variance[i] = n < 2 ? -1.f : MAX(0.f, accumM2[i] / c - l * l) / (c - 1.f);
+    }
+  });
+  DenoiserInput in;
+  in.width = width;
+  in.height = height;
+  in.color = color.data();
+  in.variance = variance.data();
+  in.normal = normal;
+  in.albedo = albedo;
+  in.depth = zbuffer;
+  in.valid = valid.data();
+  denoiser.Filter(in, color.data(), denoisedVar);
+  numa_parallel_for(rowNode, 1, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) {
+      if (valid[i]) img[i] = ToColor24(color[i], useSRGB);
+    }
+  });
+}
+
 qaVOID FrameBuffer::ResetNumRenderedPixels()
 {
-  if (mask) delete[] mask;
-  mask = new qaUCHAR[width * height]();
+  numa_parallel_for(rowNode, 1, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t i = rowBegin * width; i < rowEnd * width; ++i) { mask[i] = 0; }
+  });
   numRenderedPixels = 0;
 }
 
@@ -65,13 +196,21 @@ qaVOID FrameBuffer::ComputeZBufferImage()
   if (zbufferImg) delete[] zbufferImg;
   zbufferImg = new qaUCHAR[size];
 
-  float zmin = BIGFLOAT, zmax = 0;
-  for (qaINT i = 0; i < size; i++) {
-    if (zbuffer[i] == BIGFLOAT) continue;
-    if (zmin > zbuffer[i]) zmin = zbuffer[i];
-    if (zmax < zbuffer[i]) zmax = zbuffer[i];
-  }
-  for (qaINT i = 0; i < size; i++) {
+  const vec2f zrange = parallel_reduce(
+      blocked_range<qaINT>(0, size, 4096), vec2f(BIGFLOAT, 0.f),
+      [&](const blocked_range<qaINT> &r, vec2f z) {
+        for (qaINT i = r.begin(); i < r.end(); i++) {
+          if (zbuffer[i] == BIGFLOAT) continue;
+          if (z.x > zbuffer[i]) z.x = zbuffer[i];
+          if (z.y < zbuffer[i]) z.y = zbuffer[i];
+        }
+        return z;
+      },
+      [](const vec2f &a, const vec2f &b) {
+        return vec2f(MIN(a.x, b.x), MAX(a.y, b.y));
+      });
+  const float zmin = zrange.x, zmax = zrange.y;
+  parallel_for_each(qaINT(0), size, 4096, [&](qaINT i) {
     if (zbuffer[i] == BIGFLOAT) zbufferImg[i] = 0;
     else {
       float f = (zmax - zbuffer[i]) / (zmax - zmin);
@@ -80,7 +219,7 @@ qaVOID FrameBuffer::ComputeZBufferImage()
       if (c > 255) c = 255;
       zbufferImg[i] = c;
     }
-  }
+  });
 }
 
 qaINT FrameBuffer::ComputeSampleCountImage()
@@ -88,20 +227,28 @@ qaINT FrameBuffer::ComputeSampleCountImage()
   qaINT size = width * height;
   if (sampleCountImg) delete[] sampleCountImg;
   sampleCountImg = new qaUCHAR[size];
-  qaUCHAR smin = 255, smax = 0;
-  for (qaINT i = 0; i < size; i++) {
-    if (smin > sampleCount[i]) smin = sampleCount[i];
-    if (smax < sampleCount[i]) smax = sampleCount[i];
-  }
+  const vec2i srange = parallel_reduce(
+      blocked_range<qaINT>(0, size, 4096), vec2i(255, 0),
+      [&](const blocked_range<qaINT> &r, vec2i s) {
+        for (qaINT i = r.begin(); i < r.end(); i++) {
+          if (s.x > sampleCount[i]) s.x = sampleCount[i];
+          if (s.y < sampleCount[i]) s.y = sampleCount[i];
+        }
+        return s;
+      },
+      [](const vec2i &a, const vec2i &b) {
+        return vec2i(MIN(a.x, b.x), MAX(a.y, b.y));
+      });
+  const qaINT smin = srange.x, smax = srange.y;
   if (smax == smin) {
     for (qaINT i = 0; i < size; i++) sampleCountImg[i] = 0;
   } else {
-    for (qaINT i = 0; i < size; i++) {
+    parallel_for_each(qaINT(0), size, 4096, [&](qaINT i) {
       auto c = qaUCHAR((255 * (sampleCount[i] - smin)) / (smax - smin));
       if (c < 0) c = 0;
       if (c > 255) c = 255;
       sampleCountImg[i] = c;
-    }
+    });
   }
   return smax;
 }
@@ -27,8 +27,10 @@
 #pragma once
 
 #include <atomic>
+#include <vector>
 #include "math/math.h"
 #include "fb/tile.h"
+#include "fb/denoiser.h"
 
 //-----------------------------------------------------------------------------
 
@@ -41,7 +43,16 @@ class FrameBuffer {
   qaUCHAR *sampleCountImg;
   qaUCHAR *irradComp;
   qaUCHAR *mask;
+  Color3f *accum;      // per-pixel sum of linear radiance (progressive mode)
+  qaUINT *accumCount;  // per-pixel number of accumulated samples
+  qaFLOAT *accumM2;    // per-pixel sum of squared luminance
+  Point3 *normal;      // first-hit shading normal (denoiser feature)
+  Color3f *albedo;     // first-hit albedo (denoiser feature)
+  qaFLOAT *denoisedVar;// per-pixel luminance variance after denoising
+  Denoiser denoiser;
   qaUINT width, height;
+  qaINT numPasses;     // number of times every pixel will be rendered
+  std::vector<int> rowNode; // memory node that first touched every row
   std::atomic<qaINT> numRenderedPixels;
  public:
   FrameBuffer();
@@ -52,6 +63,10 @@ class FrameBuffer {
 
   qaVOID AllocateIrradianceComputationImage();
 
+  qaVOID AllocateAccumulationBuffer();
+
+  qaVOID AllocateFeatureBuffers();
+
   qaINT GetWidth() const { return width; }
 
   qaINT GetHeight() const { return height; }
@@ -70,18 +85,55 @@ class FrameBuffer {
 
   qaUCHAR *GetIrradianceComputationImage() { return irradComp; }
 
+  Color3f *GetAccumulation() { return accum; }
+
+  qaUINT *GetAccumulationCount() { return accumCount; }
+
+  qaFLOAT *GetAccumulationM2() { return accumM2; }
+
+  qaBOOL HasAccumulation() const { return accum != nullptr; }
+
+  Point3 *GetNormals() { return normal; }
+
+  Color3f *GetAlbedo() { return albedo; }
+
+  qaFLOAT *GetDenoisedVariance() { return denoisedVar; }
+
+  qaBOOL HasFeatures() const { return normal != nullptr; }
+
+  //! Memory node the row was placed on (always 0 outside of NUMA mode)
+  int GetRowNode(qaINT y) const { return rowNode.empty() ? 0 : rowNode[y]; }
+
+  qaVOID SetNumPasses(qaINT n) { numPasses = MAX(n, 1); }
+
   qaVOID ResetNumRenderedPixels();
 
   qaINT GetNumRenderedPixels() const { return numRenderedPixels; }
 
   qaVOID IncrementNumRenderPixel(qaINT n) { numRenderedPixels += n; }
 
-  qaBOOL IsRenderDone() const { return numRenderedPixels >= width * height; }
+  qaVOID MarkRenderDone() { numRenderedPixels = GetNumPixelsToRender(); }
+
+  qaINT GetNumPixelsToRender() const { return width * height * numPasses; }
+
+  qaBOOL IsRenderDone() const
+  {
+    return numRenderedPixels >= GetNumPixelsToRender();
+  }
 
   qaVOID ComputeZBufferImage();
 
   qaINT ComputeSampleCountImage();
 
+  //! Tonemap the accumulated radiance into the 8-bit color image and
+  //! record the sample counts (scaled by sppMax) in the sample-count channel
+  qaVOID ResolveAccumulation(qaBOOL useSRGB, qaUINT sppMax);
+
+  //! Filter the mean of the accumulated radiance with the feature buffers
+  //! and the z-buffer, then tonemap it into the 8-bit color image. The
+  //! variance left in every pixel is kept for the adaptive sampler.
+  qaVOID DenoiseAccumulation(qaBOOL useSRGB);
+
   qaBOOL SaveImage(const qaCHAR *filename) const;
 
   qaBOOL SaveZImage(const qaCHAR *filename) const;
@@ -49,6 +49,7 @@ float GenLight::Shadow(Ray ray, float t_max)
 //------------------------------------------------------------------------------
 Color3f PointLight::Illuminate(const Point3 &p, const Point3 &N) const
 {
+  Scene::RecordDependency(this);
   if (size > 0.01f) {
     int spp = GenLight::shadow_spp_min, s = 0;
     float inshadow = 0.0f;
@@ -72,6 +73,24 @@ Color3f PointLight::Illuminate(const Point3 &p, const Point3 &N) const
         InverseSquareFalloff(dir);
   }
 }
+//! one sample of a point light, spherical lights pick a random point
+static Color3f SamplePoint(const Point3 &position, float size,
+                           const Point3 &p, Ray &shadowRay, float &tMax)
+{
+  const Point3 dir = size > 0.01f ?
+                     position + rng->local().UniformBall(size) - p :
+                     position - p;
+  shadowRay = Ray(p, dir);
+  shadowRay.Normalize();
+  tMax = length(dir);
+  return Color3f(InverseSquareFalloff(dir));
+}
+Color3f PointLight::SampleUnoccluded(const Point3 &p, const Point3 &N,
+                                     Ray &shadowRay, float &tMax) const
+{
+  Scene::RecordDependency(this);
+  return SamplePoint(position, size, p, shadowRay, tMax) * intensity;
+}
 //------------------------------------------------------------------------------
 DiffRay PointLight::RandomPhoton() const
 {
@@ -105,7 +124,17 @@ Color3f SpotLight::Illuminate(const Point3 &p, const Point3 &N) const
     I = Shadow(ray, length(dir)) * intensity * InverseSquareFalloff(dir);
   }
   // calculate spot light attenuation
-  return I * GetAttenuation(Direction(p));
+  const float attenuation = GetAttenuation(Direction(p));
+  if (attenuation > 0.f) { Scene::RecordDependency(this); }
+  return I * attenuation;
+}
+Color3f SpotLight::SampleUnoccluded(const Point3 &p, const Point3 &N,
+                                    Ray &shadowRay, float &tMax) const
+{
+  const float attenuation = GetAttenuation(Direction(p));
+  if (attenuation > 0.f) { Scene::RecordDependency(this); }
+  return SamplePoint(position, size, p, shadowRay, tMax) * intensity *
+      attenuation;
 }
 DiffRay SpotLight::RandomPhoton() const
 {
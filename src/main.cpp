@@ -1,7 +1,9 @@
 
+#include <memory>
 #include "renderers/Renderer_GUI.h"
 #include "renderers/Renderer_MPI.h"
 #include "parser/xmlload.h"
+#include "tasking/numa.h"
 
 #pragma warning(disable: 588)
 
@@ -10,6 +12,9 @@ int main(int argc, char **argv)
   RendererParam param;
   enum { RENDER_GUI, RENDER_MPI } renderer_mode = RENDER_GUI;
   const char *file = nullptr;
+  const char *editFile = nullptr;
+  const char *animFile = nullptr; // the scene file by default
+  int firstFrame = 0, lastFrame = -1;
   if (argc < 2) {
     std::cerr << "Error: insufficient input" << std::endl;
     return -1;
@@ -25,13 +30,85 @@ int main(int argc, char **argv)
     } else if (str == "-sppMin") {
       param.SetSPPMin(std::atoi(argv[++i]));
     } else if (str == "-sppMax") {
-      param.SetSPPMin(std::atoi(argv[++i]));
+      param.SetSPPMax(std::atoi(argv[++i]));
     } else if (str == "-bounce") {
       Material::maxBounce = std::atoi(argv[++i]);
+    } else if (str == "-progressive") {
+      param.SetProgressiveSPP(std::atoi(argv[++i]));
+    } else if (str == "-adaptive") {
+      param.SetAdaptiveSPP(std::atoi(argv[++i]));
+    } else if (str == "-adaptive-error") {
+      param.SetAdaptiveError(static_cast<qaFLOAT>(std::atof(argv[++i])));
+    } else if (str == "-integrator") {
+      const std::string name(argv[++i]);
+      if (name == "recursive") {
+        param.SetIntegrator(INTEGRATOR_RECURSIVE);
+      } else if (name == "wavefront") {
+        param.SetIntegrator(INTEGRATOR_WAVEFRONT);
+      } else if (name == "iterative") {
+        param.SetIntegrator(INTEGRATOR_ITERATIVE);
+      } else {
+        std::cerr << "Error: unknown integrator " << name << std::endl;
+        return -1;
+      }
+    } else if (str == "-rr-depth") {
+      param.SetRouletteDepth(std::atoi(argv[++i]));
+    } else if (str == "-ray-stats") {
+      param.SetRayStatsFlag(true);
+    } else if (str == "-time") {
+      param.SetTimeBudget(static_cast<qaFLOAT>(std::atof(argv[++i])));
+    } else if (str == "-crop") {
+      const int x0 = std::atoi(argv[++i]);
+      const int y0 = std::atoi(argv[++i]);
+      const int x1 = std::atoi(argv[++i]);
+      const int y1 = std::atoi(argv[++i]);
+      param.SetCropWindow(x0, y0, x1, y1);
+    } else if (str == "-edit") {
+      editFile = argv[++i];
+      param.SetDependencyFlag(true);
+    } else if (str == "-checkpoint") {
+      param.SetCheckpointInterval(static_cast<qaFLOAT>(std::atof(argv[++i])));
+    } else if (str == "-checkpoint-photons") {
+      param.SetCheckpointPhotonsFlag(true);
+    } else if (str == "-resume") {
+      param.SetResumeFlag(true);
+    } else if (str == "-seed") {
+      Sampler_Counter::SetSeed(static_cast<qaUINT>(std::atoi(argv[++i])));
+    } else if (str == "-animation") {
+      animFile = argv[++i];
+    } else if (str == "-frames") {
+      firstFrame = std::atoi(argv[++i]);
+      lastFrame = std::atoi(argv[++i]);
+    } else if (str == "-blue-noise") {
+      param.SetBlueNoiseFlag(true);
+    } else if (str == "-denoise") {
+      param.SetDenoiseFlag(true);
+    } else if (str == "-denoise-passes") {
+      param.SetDenoiseFlag(true);
+      param.SetDenoisePassesFlag(true);
+    } else if (str == "-accum-out") {
+      param.SetSaveAccumulationFlag(true);
+    } else if (str == "-dynamic-tiles") {
+      param.SetDynamicTilesFlag(true);
+    } else if (str == "-sample-split") {
+      param.SetSampleSplitFlag(true);
+    } else if (str == "-node-shared") {
+      param.SetNodeSharedFlag(true);
+    } else if (str == "-data-distributed") {
+      param.SetDataDistributedFlag(true);
+    } else if (str == "-tile") {
+      param.SetTileSize(std::atoi(argv[++i]));
+    } else if (str == "-tile-stats") {
+      param.SetTileStatsFlag(true);
     } else if (str == "-srgb") {
       param.SetSRGBFlag(std::atoi(argv[++i]) != 0);
     } else if (str == "-threads") {
       tasking::set_num_of_threads(static_cast<size_t>(std::atoi(argv[++i])));
+    } else if (str == "-numa") {
+      if (!tasking::get_numa_mode()) { tasking::set_numa_mode(true); }
+    } else if (str == "-numa-replicate") {
+      if (!tasking::get_numa_mode()) { tasking::set_numa_mode(true); }
+      tasking::set_numa_replication(true);
     } else if (str == "-use-photon-map") {
       param.SetPhotonMappingFlag(true);
     } else if (str == "-photon-map-size") {
@@ -43,6 +120,10 @@ int main(int argc, char **argv)
     }
   }
 
+  // the workers start with the requested count before any task is run, and
+  // are pinned before the frame buffer and the scene get touched
+  tasking::init();
+
   std::shared_ptr<Renderer> renderer;
   switch(renderer_mode){
     case(RENDER_GUI):
@@ -54,8 +135,30 @@ int main(int argc, char **argv)
   }
   renderer->Init();
   LoadScene(file);
+  // animation: the scene stays loaded and the frames are rendered in turn
+  Animation animation;
+  const int numFrames = LoadAnimation(animFile ? animFile : file, animation);
+  if (numFrames > 0 && renderer_mode == RENDER_MPI) {
+    if (lastFrame < 0 || lastFrame >= numFrames) { lastFrame = numFrames - 1; }
+    renderer->RenderAnimation(renderImage, scene, animation,
+                              firstFrame, lastFrame);
+    renderer->Terminate();
+    return 0;
+  }
+  if (numFrames > 0) {
+    std::cerr << "Warning: animations are only rendered in batch mode"
+              << std::endl;
+  }
   renderer->ComputeScene(renderImage, scene);
   renderer->Render();
+  // look-dev: apply the edits and re-render only what they touched
+  if (editFile != nullptr) {
+    std::vector<ItemBase *> replaced;
+    if (LoadEdits(editFile, replaced)) {
+      renderer->RenderEdits({replaced.begin(), replaced.end()});
+    }
+    for (auto item : replaced) { delete item; }
+  }
   renderer->Terminate();
 
   return 0;
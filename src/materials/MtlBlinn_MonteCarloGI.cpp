@@ -21,6 +21,13 @@ MtlBlinn_MonteCarloGI::MtlBlinn_MonteCarloGI() :
 static int maxBounceMC = 1;
 static int maxMCSample = 10;
 
+// the first bounces use more diffuse samples
+static int NumSampleMC(int bounceCount)
+{
+  return (Material::maxBounce - maxBounceMC - bounceCount >= 0) ?
+         1 : maxMCSample;
+}
+
 const float glossy_threshold = 0.001f;
 const float total_reflection_threshold = 1.001f;
 const float refraction_angle_threshold = 0.001f;
@@ -31,16 +38,66 @@ const float diffuse_color_threshold = 0.001f;
 
 //------------------------------------------------------------------------------
 
-Color3f MtlBlinn_MonteCarloGI::Shade(const DiffRay &ray,
-                                   const DiffHitInfo &hInfo,
-                                   const LightList &lights,
-                                   int bounceCount)
+static bool IsVisible(const Color3f &K, float threshold)
+{
+  return K.x > threshold || K.y > threshold || K.z > threshold;
+}
+
+//------------------------------------------------------------------------------
+
+// Sample a diffuse bounce direction around N
+static Point3 SampleDiffuseDirection(const Point3 &N)
+{
+  //-- Sampling Hemisphere
+  //-- Method 1
+  // Point3 mc_coe;
+  // do {
+  //   mc_coe.x = (2.f * rng->Get() - 1.f);
+  //   mc_coe.y = (2.f * rng->Get() - 1.f);
+  //   mc_coe.z = rng->Get();
+  // } while (glm::length(mc_coe) < 0.001f || glm::length(mc_coe) > 0.999f);
+  // mc_coe = glm::normalize(mc_coe);
+  //
+  //-- Method 2
+  Point3 mc_coe = glm::normalize(rng->local().CosWeightedHemisphere());
+  //
+  //-- Method 3 (the idx_halton can go out of limit)
+  // static std::atomic<int> idx_halton(1);
+  // Point3 mc_coe =
+  //   glm::normalize(CosWeightedSampleHemiSphere(Halton(idx_halton,2), Halton(idx_halton,3)));
+  // ++idx_halton;
+  //
+  //-- Compute local coordinate frame
+  //-- Method 1
+  // Point3 new_z = Y;
+  // auto new_zx = ABS(glm::dot(Point3(1.f,0.f,0.f), new_z));
+  // auto new_zy = ABS(glm::dot(Point3(0.f,1.f,0.f), new_z));
+  // auto new_zz = ABS(glm::dot(Point3(0.f,0.f,1.f), new_z));
+  // Point3 new_y = (new_zx < new_zy && new_zx < new_zz) ?
+  //   glm::normalize(glm::cross(new_z, Point3(1.f,0.f,0.f))) :
+  //   (new_zy < new_zz ? glm::normalize(glm::cross(new_z, Point3(0.f,1.f,0.f))) :
+  //                      glm::normalize(glm::cross(new_z, Point3(0.f,0.f,1.f))));
+  // Point3 new_x = glm::normalize(glm::cross(new_y, new_z));
+  //
+  //-- Method 2
+  Point3 new_x, new_y, new_z = N;
+  if (ABS(new_z.x) > ABS(new_z.y)) {
+    new_y = glm::normalize(Point3(new_z.z, 0, -new_z.x));
+  } else {
+    new_y = glm::normalize(Point3(0, -new_z.z, new_z.y));
+  }
+  new_x = glm::normalize(glm::cross(new_y, new_z));
+  return mc_coe.x * new_x + mc_coe.y * new_y + mc_coe.z * new_z;
+}
+
+//------------------------------------------------------------------------------
+
+void MtlBlinn_MonteCarloGI::SpecularRays(const DiffRay &ray,
+                                         const DiffHitInfo &hInfo,
+                                         DiffRay &tRay, Color3f &tK,
+                                         DiffRay &rRay, Color3f &rK)
 const
 {
-  // input parameters
-  Color3f color = hInfo.c.hasTexture ?
-                  emission.Sample(hInfo.c.uvw, hInfo.c.duvw) :
-                  emission.GetColor();
   const auto
       N = normalize(hInfo.c.N);   // surface normal in world coordinate
   const auto V = normalize(-ray.c.dir); // ray incoming direction
@@ -119,20 +176,39 @@ const
   const Color3f sampleReflection =
       hInfo.c.hasTexture ?
       reflection.Sample(hInfo.c.uvw, hInfo.c.duvw) : reflection.GetColor();
-  const auto tK = totReflection ? Color3f(0.f) : sampleRefraction * tC;
-  const auto rK = totReflection ?
-                  (sampleReflection + sampleRefraction) :
-                  (sampleReflection + sampleRefraction * rC);
+  tK = totReflection ? Color3f(0.f) : sampleRefraction * tC;
+  rK = totReflection ?
+       (sampleReflection + sampleRefraction) :
+       (sampleReflection + sampleRefraction * rC);
+  tRay = DiffRay(p, tDir, px, txDir, py, tyDir);
+  tRay.Normalize();
+  rRay = DiffRay(p, rDir, px, rxDir, py, ryDir);
+  rRay.Normalize();
+}
+
+//------------------------------------------------------------------------------
+
+Color3f MtlBlinn_MonteCarloGI::Shade(const DiffRay &ray,
+                                   const DiffHitInfo &hInfo,
+                                   const LightList &lights,
+                                   int bounceCount)
+const
+{
+  // input parameters
+  Color3f color = hInfo.c.hasTexture ?
+                  emission.Sample(hInfo.c.uvw, hInfo.c.duvw) :
+                  emission.GetColor();
+  const auto N = normalize(hInfo.c.N);   // surface normal in world coordinate
+  const auto V = normalize(-ray.c.dir); // ray incoming direction
+  const auto p = hInfo.c.p;             // surface position in world coordinate
+  DiffRay tRay, rRay;
+  Color3f tK, rK;
+  SpecularRays(ray, hInfo, tRay, tK, rRay, rK);
 
   //!--- refraction ---
-  if (bounceCount > 0 &&
-      (tK.x > refraction_color_threshold ||
-       tK.y > refraction_color_threshold ||
-       tK.z > refraction_color_threshold)) {
-    DiffRay tRay(p, tDir, px, txDir, py, tyDir);
+  if (bounceCount > 0 && IsVisible(tK, refraction_color_threshold)) {
     DiffHitInfo tHit;
     tHit.c.z = BIGFLOAT;
-    tRay.Normalize();
     if (scene.TraceNodeNormal(scene.rootNode, tRay, tHit)) {
       const auto K = tK * (tHit.c.hasFrontHit ?
                            Color3f(1.f) :
@@ -145,13 +221,8 @@ const
   }
 
   //!--- reflection ---
-  if (bounceCount > 0 &&
-      (rK.x > reflection_color_threshold ||
-       rK.y > reflection_color_threshold ||
-       rK.z > reflection_color_threshold)) {
-    DiffRay rRay(p, rDir, px, rxDir, py, ryDir);
+  if (bounceCount > 0 && IsVisible(rK, reflection_color_threshold)) {
     DiffHitInfo rHit;
-    rRay.Normalize();
     rHit.c.z = BIGFLOAT;
     if (scene.TraceNodeNormal(scene.rootNode, rRay, rHit)) {
       const auto K = rK * (rHit.c.hasFrontHit ?
@@ -173,9 +244,7 @@ const
       hInfo.c.hasTexture ?
       specular.Sample(hInfo.c.uvw, hInfo.c.duvw) :
       specular.GetColor();
-  const int numSampleMC =
-      ((Material::maxBounce - maxBounceMC - bounceCount >= 0) ?
-       1 : maxMCSample);
+  const int numSampleMC = NumSampleMC(bounceCount);
   if (hInfo.c.hasFrontHit) {
     // Directional Lights
     Color3f directShadecolor = Color3f(0.f);
@@ -199,47 +268,8 @@ const
     const float normCoeGI = 1.f / numSampleMC;
     if (bounceCount > 0) {
       for (int i = 0; i < numSampleMC; ++i) {
-        //-- Sampling Hemisphere
-        //-- Method 1
-        // Point3 mc_coe;
-        // do {
-        //   mc_coe.x = (2.f * rng->Get() - 1.f);
-        //   mc_coe.y = (2.f * rng->Get() - 1.f);
-        //   mc_coe.z = rng->Get();
-        // } while (glm::length(mc_coe) < 0.001f || glm::length(mc_coe) > 0.999f);
-        // mc_coe = glm::normalize(mc_coe);
-        //
-        //-- Method 2
-        Point3 mc_coe = glm::normalize(rng->local().CosWeightedHemisphere());
-        //
-        //-- Method 3 (the idx_halton can go out of limit)
-        // static std::atomic<int> idx_halton(1);
-        // Point3 mc_coe =
-        //   glm::normalize(CosWeightedSampleHemiSphere(Halton(idx_halton,2), Halton(idx_halton,3)));
-        // ++idx_halton;
-        //
-        //-- Compute local coordinate frame
-        //-- Method 1
-        // Point3 new_z = Y;
-        // auto new_zx = ABS(glm::dot(Point3(1.f,0.f,0.f), new_z));
-        // auto new_zy = ABS(glm::dot(Point3(0.f,1.f,0.f), new_z));
-        // auto new_zz = ABS(glm::dot(Point3(0.f,0.f,1.f), new_z));
-        // Point3 new_y = (new_zx < new_zy && new_zx < new_zz) ?
-        //   glm::normalize(glm::cross(new_z, Point3(1.f,0.f,0.f))) :
-        //   (new_zy < new_zz ? glm::normalize(glm::cross(new_z, Point3(0.f,1.f,0.f))) :
-        //                      glm::normalize(glm::cross(new_z, Point3(0.f,0.f,1.f))));
-        // Point3 new_x = glm::normalize(glm::cross(new_y, new_z));
-        //
-        //-- Method 2
-        Point3 new_x, new_y, new_z = N;
-        if (ABS(new_z.x) > ABS(new_z.y)) {
-          new_y = glm::normalize(Point3(new_z.z, 0, -new_z.x));
-        } else {
-          new_y = glm::normalize(Point3(0, -new_z.z, new_z.y));
-        }
-        new_x = glm::normalize(glm::cross(new_y, new_z));
+        const Point3 dirMC = SampleDiffuseDirection(N);
         // generate ray
-        Point3 dirMC = mc_coe.x * new_x + mc_coe.y * new_y + mc_coe.z * new_z;
         DiffRay rayMC(p, dirMC);
         DiffHitInfo hitMC;
         hitMC.c.z = BIGFLOAT;
@@ -266,3 +296,69 @@ const
 }
 
 //------------------------------------------------------------------------------
+
+bool MtlBlinn_MonteCarloGI::Scatter(const DiffRay &ray,
+                                    const DiffHitInfo &hInfo,
+                                    const LightList &lights,
+                                    int bounceCount,
+                                    ScatterRecord &rec)
+const
+{
+  rec.radiance += hInfo.c.hasTexture ?
+                  emission.Sample(hInfo.c.uvw, hInfo.c.duvw) :
+                  emission.GetColor();
+  const auto N = normalize(hInfo.c.N);
+  const auto V = normalize(-ray.c.dir);
+  const auto p = hInfo.c.p;
+  DiffRay tRay, rRay;
+  Color3f tK, rK;
+  SpecularRays(ray, hInfo, tRay, tK, rRay, rK);
+  if (bounceCount > 0 && IsVisible(tK, refraction_color_threshold)) {
+    rec.rays.push_back({tRay, tK, absorption, false});
+  }
+  if (bounceCount > 0 && IsVisible(rK, reflection_color_threshold)) {
+    rec.rays.push_back({rRay, rK, absorption, false});
+  }
+  if (!hInfo.c.hasFrontHit) { return true; }
+  const Color3f sampleDiffuse =
+      hInfo.c.hasTexture ?
+      diffuse.Sample(hInfo.c.uvw, hInfo.c.duvw) :
+      diffuse.GetColor();
+  const Color3f sampleSpecular =
+      hInfo.c.hasTexture ?
+      specular.Sample(hInfo.c.uvw, hInfo.c.duvw) :
+      specular.GetColor();
+  // Directional Lights
+  for (auto &light : lights) {
+    if (light->IsAmbient()) { continue; }
+    Ray shadowRay;
+    float tMax;
+    const auto Intensity = light->SampleUnoccluded(p, N, shadowRay, tMax);
+    const auto L = glm::normalize(-light->Direction(p));
+    const auto H = glm::normalize(V + L);
+    const auto cosNL = MAX(0.f, dot(N, L));
+    const auto cosNH = MAX(0.f, dot(N, H));
+    rec.AddLight((sampleDiffuse * cosNL +
+                     sampleSpecular * POW(cosNH, glossiness)) * Intensity,
+                 shadowRay, tMax);
+  }
+  // Monte Carlo GI, the paths are not attenuated by the medium
+  if (bounceCount > 0) {
+    const int numSampleMC = NumSampleMC(bounceCount);
+    const float normCoeGI = 1.f / numSampleMC;
+    for (int i = 0; i < numSampleMC; ++i) {
+      const Point3 dirMC = SampleDiffuseDirection(N);
+      const auto H = glm::normalize(V + dirMC);
+      const auto cosNL = MAX(0.f, dot(N, dirMC));
+      const auto cosNH = MAX(0.f, dot(N, H));
+      DiffRay rayMC(p, dirMC);
+      rayMC.Normalize();
+      rec.rays.push_back({rayMC, normCoeGI *
+          (cosNL * sampleSpecular * POW(cosNH, glossiness) + sampleDiffuse),
+                          Color3f(0.f), false});
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
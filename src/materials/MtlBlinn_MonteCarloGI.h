@@ -41,9 +41,19 @@ class MtlBlinn_MonteCarloGI : public Material {
   Color3f Shade(const DiffRay &ray, const DiffHitInfo &hInfo,
                 const LightList &lights, int bounceCount) const override;
 
+  bool Scatter(const DiffRay &ray, const DiffHitInfo &hInfo,
+               const LightList &lights, int bounceCount,
+               ScatterRecord &rec) const override;
+
   // OpenGL Extensions
   void SetViewportMaterial(int subMtlID) const override;
 
+ private:
+  // refraction and reflection rays and their weights
+  void SpecularRays(const DiffRay &ray, const DiffHitInfo &hInfo,
+                    DiffRay &tRay, Color3f &tK,
+                    DiffRay &rRay, Color3f &rK) const;
+
  private:
   TexturedColor diffuse, specular, reflection, refraction, emission;
   float glossiness;
@@ -298,5 +298,17 @@ const
   }
   return color;
 }
+
+//------------------------------------------------------------------------------
+
+Color3f MtlBlinn_PathTracing::Albedo(const DiffHitInfo &hInfo) const
+{
+  const auto sample = [&](const TexturedColor &c) {
+    return hInfo.c.hasTexture ? c.Sample(hInfo.c.uvw, hInfo.c.duvw) :
+           c.GetColor();
+  };
+  const Color3f a = sample(diffuse) + sample(reflection) + sample(refraction);
+  return Color3f(MIN(a.x, 1.f), MIN(a.y, 1.f), MIN(a.z, 1.f));
+}
 }
 //------------------------------------------------------------------------------
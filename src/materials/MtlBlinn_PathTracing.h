@@ -71,6 +71,8 @@ class MtlBlinn_PathTracing : public Material {
   Color3f Shade(const DiffRay &ray, const DiffHitInfo &hInfo,
                 const LightList &lights, int bounceCount) const override;
 
+  Color3f Albedo(const DiffHitInfo &hInfo) const override;
+
   // OpenGL Extensions
   void SetViewportMaterial(int subMtlID) const override;
  private:
@@ -223,6 +223,28 @@ const
   return true;
 }
 ///--------------------------------------------------------------------------//
+Color3f MtlBlinn_PhotonMap::GatherPhotons(const PhotonMap &pm,
+                                          const Point3 &p,
+                                          const Point3 &N,
+                                          const Point3 &V,
+                                          const Color3f &colorDiffuse,
+                                          const Color3f &colorSpecular) const
+{
+  Color3f I;
+  Point3 D;
+  pm.map.EstimateIrradiance<100>(I, D, pm.radius, p, &N, 1.f,
+                                 cyPhotonMap::FILTER_TYPE_QUADRATIC);
+  if (ColorLuma(I) <= color_luma_threshold) { // in case we found nothing
+    return Color3f(0.f);
+  }
+  const auto L = -normalize(D);
+  const auto H = normalize(V + L);
+  const auto cosNL = MAX(0.f, dot(N, L));
+  const auto cosNH = MAX(0.f, dot(N, H));
+  return I * cosNL *
+      (colorDiffuse + colorSpecular * POW(cosNH, specularGlossiness));
+}
+///--------------------------------------------------------------------------//
 Color3f MtlBlinn_PhotonMap::ComputeSecondaryRay(const Point3 &pos,
                                                 const Point3 &dir,
                                                 const Color3f &BxDF,
@@ -424,37 +446,15 @@ const
     // Gather Photon
     //
     if (doGatherPhoton) {
-      Color3f I;
-      Point3 D;
-      scene.photonmap.map.EstimateIrradiance<100>
-          (I, D, scene.photonmap.radius, p, &N, 1.f,
-           cyPhotonMap::FILTER_TYPE_QUADRATIC);
-      if (ColorLuma(I) > color_luma_threshold) { // in case we found nothing
-        const auto L = -normalize(D);
-        const auto H = normalize(V + L);
-        const auto cosNL = MAX(0.f, dot(N, L));
-        const auto cosNH = MAX(0.f, dot(N, H));
-        color += I * cosNL *
-            (sampleDiffuse + sampleSpecular * POW(cosNH, specularGlossiness));
-      }
+      color += GatherPhotons(scene.photonmap, p, N, V,
+                             sampleDiffuse, sampleSpecular);
     }
     //
     // Gather Caustics
     //
     if (doGatherCaustics) {
-      Color3f I;
-      Point3 D;
-      scene.causticsmap.map.EstimateIrradiance<100>
-          (I, D, scene.causticsmap.radius, p, &N, 1.f,
-           cyPhotonMap::FILTER_TYPE_QUADRATIC);
-      if (ColorLuma(I) > color_luma_threshold) { // in case we found nothing
-        const auto L = -normalize(D);
-        const auto H = normalize(V + L);
-        const auto cosNL = MAX(0.f, dot(N, L));
-        const auto cosNH = MAX(0.f, dot(N, H));
-        color += I * cosNL *
-            (sampleDiffuse + sampleSpecular * POW(cosNH, specularGlossiness));
-      }
+      color += GatherPhotons(scene.causticsmap, p, N, V,
+                             sampleDiffuse, sampleSpecular);
     }
     //
     // MC Integration
@@ -498,6 +498,120 @@ const
   }
   return color;
 }
+///--------------------------------------------------------------------------//
+Color3f MtlBlinn_PhotonMap::Albedo(const DiffHitInfo &hInfo) const
+{
+  const Color3f a = Sample(hInfo, diffuse) + Sample(hInfo, reflection) +
+      Sample(hInfo, refraction);
+  return Color3f(MIN(a.x, 1.f), MIN(a.y, 1.f), MIN(a.z, 1.f));
+}
+///--------------------------------------------------------------------------//
+/// Wavefront version of Shade: the same lobe is selected, but the secondary
+/// ray and the shadow rays are handed back to the integrator
+///--------------------------------------------------------------------------//
+bool MtlBlinn_PhotonMap::Scatter(const DiffRay &ray,
+                                 const DiffHitInfo &hInfo,
+                                 const LightList &lights,
+                                 int bounceCount,
+                                 ScatterRecord &rec)
+const
+{
+  rec.radiance += Sample(hInfo, emission);
+  const auto V = -ray.c.dir;
+  const auto N = hInfo.c.N;
+  const auto Y = dot(N, V) > 0.f ? N : -N;
+  const auto p = hInfo.c.p;
+  auto AddRay = [&](const Point3 &dir, const Color3f &BxDF, float PDF,
+                    bool diffuseHit) {
+    ScatterRay r;
+    r.ray = DiffRay(p, dir);
+    r.ray.Normalize();
+    r.weight = BxDF / PDF;
+    r.absorption = absorption;
+    r.diffuseHit = diffuseHit;
+    rec.rays.push_back(r);
+  };
+  //
+  // Reflection and Transmission Colors
+  //
+  Point3 tDir, rDir;
+  float tC, rC;
+  const bool totReflection = ComputeFresnel(ray, hInfo, tDir, rDir, tC, rC);
+  const Color3f tK = Sample(hInfo, refraction);
+  const Color3f rK = Sample(hInfo, reflection);
+  const Color3f sampleTransmission = totReflection ? Color3f(0.f) : tK * tC;
+  const Color3f sampleReflection = totReflection ? (rK + tK) : (rK + tK * rC);
+  const Color3f sampleSpecular = Sample(hInfo, specular);
+  const Color3f sampleDiffuse = Sample(hInfo, diffuse);
+  //
+  // Select a BxDF
+  //
+  Point3 sampleDir;
+  Color3f BxDF;
+  float PDF = 1.f;
+  float scale = 1.f;
+  const auto select = RandomSelectMtl(scale,
+                                      sampleTransmission,
+                                      sampleReflection,
+                                      sampleDiffuse);
+  if (bounceCount > 0) {
+    if (select == REFLECT &&
+        ColorLuma(sampleReflection) > color_luma_threshold &&
+        SampleReflectionBxDF(sampleDir, BxDF, PDF, N, Y, V, rDir,
+                             sampleReflection))
+    {
+      AddRay(sampleDir, BxDF, PDF, false);
+    }
+    if (select == TRANSMIT &&
+        ColorLuma(sampleTransmission) > color_luma_threshold &&
+        SampleTransmitBxDF(sampleDir, BxDF, PDF, N, Y, V, tDir,
+                           sampleTransmission))
+    {
+      AddRay(sampleDir, BxDF, PDF, false);
+    }
+  }
+  //
+  // Diffuse: photons are gathered after the first diffuse bounce, before
+  // that the path continues
+  //
+  if (select == DIFFUSE && ColorLuma(sampleDiffuse) > color_luma_threshold) {
+    if (scene.usePhotonMap) {
+      if (hInfo.c.hasDiffuseHit) {
+        rec.radiance += GatherPhotons(scene.photonmap, p, N, V,
+                                      sampleDiffuse, sampleSpecular);
+      }
+      rec.radiance += GatherPhotons(scene.causticsmap, p, N, V,
+                                    sampleDiffuse, sampleSpecular);
+    }
+    if (bounceCount > 0 && !hInfo.c.hasDiffuseHit && hInfo.c.hasFrontHit &&
+        SampleDiffuseBxDF(sampleDir, BxDF, PDF, N, V,
+                          sampleDiffuse, sampleSpecular))
+    {
+      AddRay(sampleDir, BxDF, PDF, true);
+    }
+  }
+  //
+  // Direct Lights
+  //
+  const float normCoefDI = (lights.empty() ? 1.f : 1.f / lights.size());
+  for (auto &light : lights) {
+    if (light->IsAmbient()) { continue; }
+    Ray shadowRay;
+    float tMax;
+    const auto intensity =
+        light->SampleUnoccluded(p, N, shadowRay, tMax) * normCoefDI;
+    const auto L = normalize(-light->Direction(p));
+    const auto H = normalize(V + L);
+    const auto cosNL = MAX(0.f, dot(N, L));
+    const auto cosNH = MAX(0.f, dot(N, H));
+    if (cosNL <= 0.f) { continue; }
+    rec.AddLight(intensity * cosNL *
+                     (sampleDiffuse +
+                         sampleSpecular * POW(cosNH, specularGlossiness)),
+                 shadowRay, tMax);
+  }
+  return true;
+}
 // If this method returns true, a new photon with the given direction and
 // color will be traced
 bool MtlBlinn_PhotonMap::RandomPhotonBounce(DiffRay &ray, Color3f &c,
@@ -69,6 +69,12 @@ public:
   Color3f Shade(const DiffRay &ray, const DiffHitInfo &hInfo,
                 const LightList &lights, int bounceCount) const override;
 
+  bool Scatter(const DiffRay &ray, const DiffHitInfo &hInfo,
+               const LightList &lights, int bounceCount,
+               ScatterRecord &rec) const override;
+
+  Color3f Albedo(const DiffHitInfo &hInfo) const override;
+
   // Photon Extensions
   // If this method returns true, the photon will be stored
   bool IsPhotonSurface(int subMtlID) const override
@@ -130,6 +136,13 @@ private:
                          bool photonMap = false)
   const;
 
+  Color3f GatherPhotons(const PhotonMap &pm,
+                        const Point3 &p,
+                        const Point3 &N,
+                        const Point3 &V,
+                        const Color3f &colorDiffuse,
+                        const Color3f &colorSpecular) const;
+
   Color3f ComputeSecondaryRay(const Point3& pos,
                               const Point3 &dir,
                               const Color3f &BxDF,
@@ -75,6 +75,20 @@ class MultiMtl : public Material {
            Color3f(1, 1, 1);
   }
 
+  bool Scatter(const DiffRay &ray, const DiffHitInfo &hInfo,
+               const LightList &lights, int bounceCount,
+               ScatterRecord &rec) const override
+  {
+    return hInfo.c.mtlID < (int) mtls.size() &&
+        mtls[hInfo.c.mtlID]->Scatter(ray, hInfo, lights, bounceCount, rec);
+  }
+
+  Color3f Albedo(const DiffHitInfo &hInfo) const override
+  {
+    return hInfo.c.mtlID < (int) mtls.size() ?
+           mtls[hInfo.c.mtlID]->Albedo(hInfo) : Color3f(1, 1, 1);
+  }
+
   void SetViewportMaterial(int subMtlID) const override
   {
     if (subMtlID < (int) mtls.size()) mtls[subMtlID]->SetViewportMaterial(0);
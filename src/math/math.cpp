@@ -44,4 +44,25 @@ Point3 TransformToLocalFrame(const Point3 &N, const Point3 &sample)
   const Point3 unit = normalize(sample);
   return unit.x * X + unit.y * Y + unit.z * Z;
 }
+qaFLOAT LinearToSRGB(const qaFLOAT c)
+{
+  const qaFLOAT a = 0.055f;
+  if (c < 0.0031308f) { return 12.92f * c; }
+  else { return (1.f + a) * POW(c, 1.f / 2.4f) - a; }
+}
+Color3c ToColor24(const Color3f &c, qaBOOL useSRGB)
+{
+  Color3f color = c;
+  if (useSRGB) {
+    color.r = LinearToSRGB(color.r);
+    color.g = LinearToSRGB(color.g);
+    color.b = LinearToSRGB(color.b);
+  }
+  color.r = MAX(0.f, MIN(1.f, color.r));
+  color.g = MAX(0.f, MIN(1.f, color.g));
+  color.b = MAX(0.f, MIN(1.f, color.b));
+  return Color3c(static_cast<qaUCHAR>(roundf(color.r * 255.f)),
+                 static_cast<qaUCHAR>(roundf(color.g * 255.f)),
+                 static_cast<qaUCHAR>(roundf(color.b * 255.f)));
+}
 }
\ No newline at end of file
@@ -130,6 +130,9 @@ inline qaFLOAT ColorLuma(const Color3f &c)
   return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
 }
 Point3 TransformToLocalFrame(const Point3 &N, const Point3 &sample);
+qaFLOAT LinearToSRGB(const qaFLOAT c);
+// from linear Color -> Color24 (clamped, optionally sRGB encoded)
+Color3c ToColor24(const Color3f &c, qaBOOL useSRGB);
 }
 //-----------------------------------------------------------------------------
 #endif //QARAY_MATH_H
@@ -32,12 +32,12 @@ namespace qaray {
 void BVHTriMesh::GetElementBounds(unsigned int i, float box[6]) const
 {
   const TriMesh::TriFace &f = mesh->F(i);
-  vec3f p = mesh->V(f.v[0]->vertex_index);
+  vec3f p = mesh->V(f.v[0].vertex_index);
   box[0] = box[3] = p.x;
   box[1] = box[4] = p.y;
   box[2] = box[5] = p.z;
   for (int j = 1; j < 3; j++) { // for each triangle
-    vec3f p = mesh->V((*f.v)[j].vertex_index);
+    vec3f p = mesh->V(f.v[j].vertex_index);
     for (int k = 0; k < 3; k++) { // for each dimension
       if (box[k] > p[k]) box[k] = p[k];
       if (box[k + 3] < p[k]) box[k + 3] = p[k];
@@ -50,8 +50,8 @@ float BVHTriMesh::GetElementCenter(unsigned int i, int dim) const
 {
   const TriMesh::TriFace &f = mesh->F(i);
   return
-      (mesh->V(f.v[0]->vertex_index)[dim] +
-       mesh->V(f.v[1]->vertex_index)[dim] +
-       mesh->V(f.v[2]->vertex_index)[dim]) / 3.0f;
+      (mesh->V(f.v[0].vertex_index)[dim] +
+       mesh->V(f.v[1].vertex_index)[dim] +
+       mesh->V(f.v[2].vertex_index)[dim]) / 3.0f;
 }
 }
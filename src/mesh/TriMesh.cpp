@@ -27,6 +27,9 @@
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "TriMesh.h"
+#include <algorithm>
+#include <bitset>
+#include <fstream>
 
 //----------------------------------------------------------------------------
 static std::string ParsePath(const std::string &str)
@@ -60,6 +63,18 @@ static std::string ComputePath(const std::string &str, std::string &dpath, std::
 //----------------------------------------------------------------------------
 
 namespace qaray {
+static void SortFacesByMaterial(std::vector<TriMesh::TriFace> &faces)
+{
+  std::sort(faces.begin(), faces.end(),
+            [](const TriMesh::TriFace& a, const TriMesh::TriFace& b) {
+    if (a.mtl >= 0 && b.mtl >= 0) {
+      return a.mtl < b.mtl;
+    }
+    else {
+      return false;
+    }
+  });
+}
 bool TriMesh::LoadFromFileObj(const char *filename,
                               bool loadMtl,
                               std::ostream *outStream)
@@ -78,6 +93,23 @@ bool TriMesh::LoadFromFileObj(const char *filename,
   // err may contain warning message.
   if (!err.empty()) { *outStream << std::endl << err << std::endl; }
   if (!ret) { return false; }
+  return BuildFaces(outStream);
+}
+bool TriMesh::LoadFromStreamObj(const char *filename,
+                                std::istream &obj,
+                                tinyobj::MaterialReader *mtl,
+                                std::ostream *outStream)
+{
+  file = ComputePath(filename, path, name);
+  std::string err;
+  bool ret =
+      tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &obj, mtl, true);
+  if (!err.empty()) { *outStream << std::endl << err << std::endl; }
+  if (!ret) { return false; }
+  return BuildFaces(outStream);
+}
+bool TriMesh::BuildFaces(std::ostream *outStream)
+{
   // post processing
   mcfc.resize(materials.size(), 0);
   // Loop over shapes
@@ -93,25 +125,482 @@ bool TriMesh::LoadFromFileObj(const char *filename,
       }
       // Loop over vertices in the face.
       int mtl_id = shape.mesh.material_ids[f];
-      faces.emplace_back(shape,
-                         shape.mesh.indices[index_offset + 0],
-                         shape.mesh.indices[index_offset + 1],
-                         shape.mesh.indices[index_offset + 2],
-                         mtl_id, faces.size());
+      TriFace face = {{shape.mesh.indices[index_offset + 0],
+                       shape.mesh.indices[index_offset + 1],
+                       shape.mesh.indices[index_offset + 2]},
+                      mtl_id, faces.size()};
+      faces.push_back(face);
       if (mtl_id >= 0) {
         ++mcfc[mtl_id];
       }
       index_offset += fv;
     }
   }
-  std::sort(faces.begin(), faces.end(), [](const TriFace& a, const TriFace& b) {
-    if (a.mtl >= 0 && b.mtl >= 0) {
-      return a.mtl < b.mtl;
+  // the faces keep their own indices, the shapes are not needed anymore
+  std::vector<tinyobj::shape_t>().swap(shapes);
+  SortFacesByMaterial(faces);
+  UpdateViews();
+  return true;
+}
+//----------------------------------------------------------------------------
+// Loading one part of a mesh. The file is read in several streaming passes
+// and only a few bits per vertex are kept besides the part itself:
+//  - the vertices are split at the median along the longest axis of their
+//    bounds, recursively, as the top levels of a BVH over the parts would.
+//    Every pass finds one plane on the way to the own part, the median is
+//    taken from a histogram so that every process splits the same way.
+//  - a face belongs to the part of its first corner, the part keeps its
+//    faces and all the corners they use.
+//  - computed normals are summed over the parts at the shared vertices.
+//----------------------------------------------------------------------------
+namespace {
+//! One bit per element, Rank(i) counts the bits set before i
+class BitArray {
+ public:
+  void Resize(size_t n) { words.assign((n + 63) / 64, 0); }
+  void Set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+  bool Test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+  void BuildRanks()
+  {
+    ranks.resize(words.size());
+    size_t n = 0;
+    for (size_t w = 0; w < words.size(); ++w) {
+      ranks[w] = n;
+      n += std::bitset<64>(words[w]).count();
     }
-    else {
-      return false;
+  }
+  size_t Rank(size_t i) const
+  {
+    const uint64_t below = words[i / 64] & ((uint64_t(1) << (i % 64)) - 1);
+    return ranks[i / 64] + std::bitset<64>(below).count();
+  }
+ private:
+  std::vector<uint64_t> words;
+  std::vector<size_t> ranks;
+};
+//! The lines of an OBJ file read by ScanObj. Corners are zero based and -1
+//! when missing, polygons are split into fans as LoadObj does.
+struct ObjPass {
+  size_t numV = 0, numVN = 0, numVT = 0, numF = 0;
+  int mtl = -1;
+  void Vertex(size_t, const vec3f &) {}
+  void Normal(size_t, const vec3f &) {}
+  void Texcoord(size_t, const vec2f &) {}
+  void Face(const tinyobj::index_t *) {}
+  void Materials(const tinyobj::material_t *, int) {}
+};
+static int FixIndex(int index, size_t n)
+{
+  // relative indices count back from the last element read
+  return index > 0 ? index - 1 : index < 0 ? static_cast<int>(n) + index : -1;
+}
+template<typename Pass>
+static bool ScanObj(const std::string &file, Pass &pass,
+                    tinyobj::MaterialReader *mtl, std::ostream *outStream)
+{
+  std::ifstream in(file);
+  if (!in) { return false; }
+  tinyobj::callback_t cb;
+  cb.vertex_cb = [](void *p, tinyobj::real_t x, tinyobj::real_t y,
+                    tinyobj::real_t z, tinyobj::real_t) {
+    Pass &s = *static_cast<Pass *>(p);
+    s.Vertex(s.numV++, vec3f(x, y, z));
+  };
+  cb.normal_cb = [](void *p, tinyobj::real_t x, tinyobj::real_t y,
+                    tinyobj::real_t z) {
+    Pass &s = *static_cast<Pass *>(p);
+    s.Normal(s.numVN++, vec3f(x, y, z));
+  };
+  cb.texcoord_cb = [](void *p, tinyobj::real_t x, tinyobj::real_t y,
+                      tinyobj::real_t) {
+    Pass &s = *static_cast<Pass *>(p);
+    s.Texcoord(s.numVT++, vec2f(x, y));
+  };
+  cb.index_cb = [](void *p, tinyobj::index_t *corners, int n) {
+    Pass &s = *static_cast<Pass *>(p);
+    for (int k = 0; k < n; ++k) {
+      corners[k].vertex_index = FixIndex(corners[k].vertex_index, s.numV);
+      corners[k].normal_index = FixIndex(corners[k].normal_index, s.numVN);
+      corners[k].texcoord_index =
+          FixIndex(corners[k].texcoord_index, s.numVT);
     }
-  });
+    for (int k = 2; k < n; ++k) {
+      const tinyobj::index_t tri[3] = {corners[0], corners[k - 1],
+                                       corners[k]};
+      s.Face(tri);
+      ++s.numF;
+    }
+  };
+  cb.usemtl_cb = [](void *p, const char *, int id) {
+    static_cast<Pass *>(p)->mtl = id;
+  };
+  cb.mtllib_cb = [](void *p, const tinyobj::material_t *m, int n) {
+    static_cast<Pass *>(p)->Materials(m, n);
+  };
+  std::string err;
+  const bool ret = tinyobj::LoadObjWithCallback(in, cb, &pass, mtl, &err);
+  if (!err.empty()) { *outStream << std::endl << err << std::endl; }
+  return ret;
+}
+struct BoundsPass : ObjPass {
+  vec3f lo = vec3f(BIGFLOAT), hi = vec3f(-BIGFLOAT);
+  void Vertex(size_t, const vec3f &p)
+  {
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+};
+//! The vertices on one side of a plane across 'axis'. Sides are told by
+//! the bins of the histogram the plane was chosen from, so all processes
+//! put a vertex on the same side.
+struct SplitPlane {
+  static const int numBins = 1 << 12;
+  int axis = 0, bin = 0;
+  float lo = 0.f, scale = 0.f; // bins of [lo, lo + numBins / scale)
+  bool below = true;           // which side is kept
+  int Bin(const vec3f &p) const
+  {
+    const float x = (p[axis] - lo) * scale;
+    return x <= 0.f ? 0 : x >= numBins - 1 ? numBins - 1 : static_cast<int>(x);
+  }
+  bool Keeps(const vec3f &p) const { return (Bin(p) < bin) == below; }
+};
+static bool Inside(const std::vector<SplitPlane> &planes, const vec3f &p)
+{
+  for (auto &plane : planes) {
+    if (!plane.Keeps(p)) { return false; }
+  }
+  return true;
+}
+struct HistogramPass : ObjPass {
+  const std::vector<SplitPlane> &planes;
+  const SplitPlane &plane;
+  std::vector<size_t> counts;
+  HistogramPass(const std::vector<SplitPlane> &planes, const SplitPlane &plane)
+      : planes(planes), plane(plane), counts(SplitPlane::numBins, 0) {}
+  void Vertex(size_t, const vec3f &p)
+  {
+    if (Inside(planes, p)) { ++counts[plane.Bin(p)]; }
+  }
+};
+struct RegionPass : ObjPass {
+  const std::vector<SplitPlane> &planes;
+  BitArray &inside;
+  RegionPass(const std::vector<SplitPlane> &planes, BitArray &inside)
+      : planes(planes), inside(inside) {}
+  void Vertex(size_t i, const vec3f &p)
+  {
+    if (Inside(planes, p)) { inside.Set(i); }
+  }
+};
+struct FacePass : ObjPass {
+  const BoundsPass &all;
+  const BitArray &inside;
+  BitArray usedV, usedVN, usedVT, foreign; // foreign: used by other parts
+  std::vector<TriMesh::TriFace> &faces;
+  std::vector<tinyobj::material_t> &materials;
+  FacePass(const BoundsPass &all, const BitArray &inside,
+           std::vector<TriMesh::TriFace> &faces,
+           std::vector<tinyobj::material_t> &materials)
+      : all(all), inside(inside), faces(faces), materials(materials)
+  {
+    usedV.Resize(all.numV);
+    usedVN.Resize(all.numVN);
+    usedVT.Resize(all.numVT);
+    foreign.Resize(all.numV);
+  }
+  void Face(const tinyobj::index_t *tri)
+  {
+    TriMesh::TriFace face = {{tri[0], tri[1], tri[2]}, mtl, numF};
+    for (auto &c : face.v) {
+      if (c.vertex_index < 0 || size_t(c.vertex_index) >= all.numV) return;
+      if (size_t(c.normal_index) >= all.numVN) c.normal_index = -1;
+      if (size_t(c.texcoord_index) >= all.numVT) c.texcoord_index = -1;
+    }
+    if (!inside.Test(size_t(face.v[0].vertex_index))) {
+      for (auto &c : face.v) { foreign.Set(size_t(c.vertex_index)); }
+      return;
+    }
+    for (auto &c : face.v) {
+      usedV.Set(size_t(c.vertex_index));
+      if (c.normal_index >= 0) usedVN.Set(size_t(c.normal_index));
+      if (c.texcoord_index >= 0) usedVT.Set(size_t(c.texcoord_index));
+    }
+    faces.push_back(face);
+  }
+  void Materials(const tinyobj::material_t *m, int n)
+  {
+    materials.assign(m, m + n);
+  }
+};
+struct AttribPass : ObjPass {
+  const FacePass &used;
+  tinyobj::attrib_t &attrib;
+  AttribPass(const FacePass &used, tinyobj::attrib_t &attrib)
+      : used(used), attrib(attrib) {}
+  void Vertex(size_t i, const vec3f &p)
+  {
+    if (used.usedV.Test(i)) {
+      attrib.vertices.insert(attrib.vertices.end(), {p.x, p.y, p.z});
+    }
+  }
+  void Normal(size_t i, const vec3f &n)
+  {
+    if (used.usedVN.Test(i)) {
+      attrib.normals.insert(attrib.normals.end(), {n.x, n.y, n.z});
+    }
+  }
+  void Texcoord(size_t i, const vec2f &t)
+  {
+    if (used.usedVT.Test(i)) {
+      attrib.texcoords.insert(attrib.texcoords.end(), {t.x, t.y});
+    }
+  }
+};
+}
+bool TriMesh::LoadPartFromFileObj(const char *filename,
+                                  tinyobj::MaterialReader *mtl,
+                                  MeshPartition &partition,
+                                  std::ostream *outStream)
+{
+  Clear();
+  file = ComputePath(filename, path, name);
+  // the planes on the way to the own part, these passes are local
+  BoundsPass all;
+  bool ok = ScanObj(file, all, nullptr, outStream);
+  std::vector<SplitPlane> planes;
+  vec3f lo = all.lo, hi = all.hi;
+  size_t first = 0, count = partition.NumParts();
+  const size_t part = partition.Part();
+  while (ok && count > 1) {
+    const vec3f extent = hi - lo;
+    SplitPlane plane;
+    plane.axis = extent.x >= extent.y && extent.x >= extent.z ? 0 :
+                 extent.y >= extent.z ? 1 : 2;
+    plane.lo = lo[plane.axis];
+    plane.scale = extent[plane.axis] > 0.f ?
+                  SplitPlane::numBins / extent[plane.axis] : 0.f;
+    HistogramPass histogram(planes, plane);
+    ok = ScanObj(file, histogram, nullptr, outStream);
+    // the vertices are divided in proportion to the parts on either side
+    const size_t left = count / 2;
+    size_t total = 0;
+    for (auto c : histogram.counts) { total += c; }
+    const size_t target = total * left / count;
+    size_t below = 0;
+    int bin = 0;
+    while (bin < SplitPlane::numBins && below + histogram.counts[bin] < target) {
+      below += histogram.counts[bin++];
+    }
+    if (bin < SplitPlane::numBins &&
+        below + histogram.counts[bin] - target < target - below) { ++bin; }
+    plane.bin = bin;
+    plane.below = part < first + left;
+    const float edge = plane.scale > 0.f ? plane.lo + bin / plane.scale
+                                         : plane.lo;
+    if (plane.below) {
+      hi[plane.axis] = edge;
+      count = left;
+    } else {
+      lo[plane.axis] = edge;
+      first += left;
+      count -= left;
+    }
+    planes.push_back(plane);
+  }
+  BitArray inside;
+  inside.Resize(all.numV);
+  RegionPass region(planes, inside);
+  ok = ok && ScanObj(file, region, nullptr, outStream);
+  // the material files may be read collectively, all parts read them
+  if (!partition.AllOk(ok)) { return false; }
+  FacePass used(all, inside, faces, materials);
+  ok = ScanObj(file, used, mtl, outStream);
+  inside = BitArray();
+  AttribPass attributes(used, attrib);
+  ok = ok && ScanObj(file, attributes, nullptr, outStream);
+  if (!partition.AllOk(ok)) {
+    Clear();
+    return false;
+  }
+  // the kept corners are renumbered in the order of the file
+  used.usedV.BuildRanks();
+  used.usedVN.BuildRanks();
+  used.usedVT.BuildRanks();
+  mcfc.assign(materials.size(), 0);
+  for (auto &face : faces) {
+    for (auto &c : face.v) {
+      c.vertex_index = static_cast<int>(used.usedV.Rank(c.vertex_index));
+      if (c.normal_index >= 0) {
+        c.normal_index = static_cast<int>(used.usedVN.Rank(c.normal_index));
+      }
+      if (c.texcoord_index >= 0) {
+        c.texcoord_index =
+            static_cast<int>(used.usedVT.Rank(c.texcoord_index));
+      }
+    }
+    if (face.mtl >= 0) { ++mcfc[face.mtl]; }
+  }
+  faces.shrink_to_fit();
+  attrib.vertices.shrink_to_fit();
+  attrib.normals.shrink_to_fit();
+  attrib.texcoords.shrink_to_fit();
+  SortFacesByMaterial(faces);
+  UpdateViews();
+  if (all.numVN > 0) { return true; }
+  // as ComputeNormals, the vertices the other parts also use get the sums
+  // of all their faces
+  attrib.normals.assign(3 * NV(), 0.f);
+  for (auto &face : faces) {
+    const vec3f N = qaray::cross(
+        V(face.v[1].vertex_index) - V(face.v[0].vertex_index),
+        V(face.v[2].vertex_index) - V(face.v[0].vertex_index));
+    for (auto &c : face.v) {
+      VN(c.vertex_index) += N;
+      c.normal_index = c.vertex_index;
+    }
+  }
+  std::vector<uint64_t> shared;
+  std::vector<float> sums;
+  for (size_t i = 0; i < all.numV; ++i) {
+    if (used.usedV.Test(i) && used.foreign.Test(i)) {
+      const vec3f &N = VN(static_cast<int>(used.usedV.Rank(i)));
+      shared.push_back(i);
+      sums.insert(sums.end(), {N.x, N.y, N.z});
+    }
+  }
+  partition.SumShared(shared, sums, 3);
+  for (size_t k = 0; k < shared.size(); ++k) {
+    VN(static_cast<int>(used.usedV.Rank(shared[k]))) =
+        vec3f(sums[3 * k], sums[3 * k + 1], sums[3 * k + 2]);
+  }
+  for (size_t i = 0; i < NV(); ++i) {
+    VN(static_cast<int>(i)) = normalize(VN(static_cast<int>(i)));
+  }
+  UpdateViews();
+  return true;
+}
+void TriMesh::CopyFrom(const TriMesh &m) {
+  path = m.path;
+  name = m.name;
+  file = m.file;
+  attrib = m.attrib;
+  shapes = m.shapes;
+  materials = m.materials;
+  mcfc = m.mcfc;
+  boundMin = m.boundMin;
+  boundMax = m.boundMax;
+  // the arrays of 'm' may be shared ones, they are copied from its views
+  attrib.vertices.assign(m.vertexData, m.vertexData + 3 * m.numVertices);
+  attrib.normals.assign(m.normalData, m.normalData + 3 * m.numNormals);
+  attrib.texcoords.assign(m.texcoordData,
+                          m.texcoordData + 2 * m.numTexcoords);
+  faces.assign(m.faceData, m.faceData + m.numFaces);
+  UpdateViews();
+}
+void TriMesh::UpdateViews() {
+  vertexData = attrib.vertices.data();
+  normalData = attrib.normals.data();
+  texcoordData = attrib.texcoords.data();
+  faceData = faces.data();
+  numVertices = attrib.vertices.size() / 3;
+  numNormals = attrib.normals.size() / 3;
+  numTexcoords = attrib.texcoords.size() / 2;
+  numFaces = faces.size();
+}
+//----------------------------------------------------------------------------
+// The materials are packed as fixed records, their names into one array of
+// null terminated strings
+struct PackedMtl {
+  float ambient[3], diffuse[3], specular[3], transmittance[3], emission[3];
+  float shininess, ior, dissolve;
+  int illum;
+  uint32_t name, diffuseTex, specularTex; // offsets into the names
+};
+void TriMesh::Pack(SharedBlockWriter &out) const {
+  std::vector<PackedMtl> mtls(materials.size());
+  std::vector<char> names;
+  auto AddName = [&](const std::string &str) {
+    const auto offset = static_cast<uint32_t>(names.size());
+    names.insert(names.end(), str.begin(), str.end());
+    names.push_back('\0');
+    return offset;
+  };
+  for (size_t i = 0; i < materials.size(); ++i) {
+    const tinyobj::material_t &src = materials[i];
+    PackedMtl &dst = mtls[i];
+    for (int k = 0; k < 3; ++k) {
+      dst.ambient[k] = src.ambient[k];
+      dst.diffuse[k] = src.diffuse[k];
+      dst.specular[k] = src.specular[k];
+      dst.transmittance[k] = src.transmittance[k];
+      dst.emission[k] = src.emission[k];
+    }
+    dst.shininess = src.shininess;
+    dst.ior = src.ior;
+    dst.dissolve = src.dissolve;
+    dst.illum = src.illum;
+    dst.name = AddName(src.name);
+    dst.diffuseTex = AddName(src.diffuse_texname);
+    dst.specularTex = AddName(src.specular_texname);
+  }
+  const float bounds[6] = {boundMin.x, boundMin.y, boundMin.z,
+                           boundMax.x, boundMax.y, boundMax.z};
+  out.Put(vertexData, 3 * numVertices);
+  out.Put(normalData, 3 * numNormals);
+  out.Put(texcoordData, 2 * numTexcoords);
+  out.Put(faceData, numFaces);
+  out.Put(bounds, 6);
+  out.Put(mcfc);
+  out.Put(mtls);
+  out.Put(names);
+}
+bool TriMesh::Unpack(const char *filename, SharedBlockReader &in) {
+  // release the own arrays, not just empty them
+  attrib = tinyobj::attrib_t();
+  std::vector<tinyobj::shape_t>().swap(shapes);
+  std::vector<TriFace>().swap(faces);
+  Clear();
+  file = ComputePath(filename, path, name);
+  size_t nv, nvn, nvt, nf, nb, nc, nm, nn;
+  vertexData = in.Get<float>(nv);
+  normalData = in.Get<float>(nvn);
+  texcoordData = in.Get<float>(nvt);
+  faceData = in.Get<TriFace>(nf);
+  const float *bounds = in.Get<float>(nb);
+  const size_t *counts = in.Get<size_t>(nc);
+  const PackedMtl *mtls = in.Get<PackedMtl>(nm);
+  const char *names = in.Get<char>(nn);
+  if (!in.Good() || nb != 6) {
+    Clear();
+    return false;
+  }
+  numVertices = nv / 3;
+  numNormals = nvn / 3;
+  numTexcoords = nvt / 2;
+  numFaces = nf;
+  boundMin = vec3f(bounds[0], bounds[1], bounds[2]);
+  boundMax = vec3f(bounds[3], bounds[4], bounds[5]);
+  mcfc.assign(counts, counts + nc);
+  materials.resize(nm);
+  for (size_t i = 0; i < nm; ++i) {
+    const PackedMtl &src = mtls[i];
+    tinyobj::material_t &dst = materials[i];
+    for (int k = 0; k < 3; ++k) {
+      dst.ambient[k] = src.ambient[k];
+      dst.diffuse[k] = src.diffuse[k];
+      dst.specular[k] = src.specular[k];
+      dst.transmittance[k] = src.transmittance[k];
+      dst.emission[k] = src.emission[k];
+    }
+    dst.shininess = src.shininess;
+    dst.ior = src.ior;
+    dst.dissolve = src.dissolve;
+    dst.illum = src.illum;
+    dst.name = names + src.name;
+    dst.diffuse_texname = names + src.diffuseTex;
+    dst.specular_texname = names + src.specularTex;
+  }
   return true;
 }
 void TriMesh::ComputeBoundingBox() {
@@ -140,21 +629,22 @@ void TriMesh::ComputeNormals(bool clockwise) {
   }
   for (unsigned int i = 0; i < NF(); i++) {
     // face normal (not normalized)
-    vec3f N = qaray::cross((V(faces[i].v[1]->vertex_index) -
-                               V(faces[i].v[0]->vertex_index)),
-                           (V(faces[i].v[2]->vertex_index) -
-                               V(faces[i].v[0]->vertex_index)));
+    vec3f N = qaray::cross((V(faces[i].v[1].vertex_index) -
+                               V(faces[i].v[0].vertex_index)),
+                           (V(faces[i].v[2].vertex_index) -
+                               V(faces[i].v[0].vertex_index)));
     if (clockwise) N = -N;
-    VN(faces[i].v[0]->vertex_index) += N;
-    VN(faces[i].v[1]->vertex_index) += N;
-    VN(faces[i].v[2]->vertex_index) += N;
-    faces[i].v[0]->normal_index = faces[i].v[0]->vertex_index;
-    faces[i].v[1]->normal_index = faces[i].v[1]->vertex_index;
-    faces[i].v[2]->normal_index = faces[i].v[2]->vertex_index;
+    VN(faces[i].v[0].vertex_index) += N;
+    VN(faces[i].v[1].vertex_index) += N;
+    VN(faces[i].v[2].vertex_index) += N;
+    faces[i].v[0].normal_index = faces[i].v[0].vertex_index;
+    faces[i].v[1].normal_index = faces[i].v[1].vertex_index;
+    faces[i].v[2].normal_index = faces[i].v[2].vertex_index;
   }
   for (unsigned int i = 0; i < NF(); i++) {
     VN(i) = normalize(VN(i));
   }
+  UpdateViews();
 }
 
 //!< Returns the number of faces associated with the given material ID.
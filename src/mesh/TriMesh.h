@@ -30,6 +30,8 @@
 #pragma once
 
 #include "math/math.h"
+#include "core/sharing.h"
+#include "core/partition.h"
 #include <tiny_obj_loader.h>
 #include <utility>
 #include <cassert>
@@ -38,32 +40,12 @@
 namespace qaray {
 class TriMesh {
  public:
+  //! A triangle, it holds the indices of its corners by value so that the
+  //! faces can be copied to other processes
   struct TriFace {
-    tinyobj::shape_t* shape = nullptr;
-    tinyobj::index_t* v[3];
-    size_t idx;
+    tinyobj::index_t v[3];
     int mtl;
-    TriFace(tinyobj::shape_t& s,
-            tinyobj::index_t& vt0,
-            tinyobj::index_t& vt1,
-            tinyobj::index_t& vt2,
-            int m, size_t id)
-        :
-        shape(&s), mtl(m), v{&vt0, &vt1, &vt2}, idx(id)
-    {}
-    TriFace(const TriFace& t)
-        :
-        shape(t.shape), mtl(t.mtl), v{t.v[0], t.v[1], t.v[2]}, idx(t.idx)
-    {}
-    TriFace& operator = (const TriFace& t) {
-      if (&t == this) { return *this; }
-      shape = t.shape;
-      mtl = t.mtl;
-      v[0] = t.v[0];
-      v[1] = t.v[1];
-      v[2] = t.v[2];
-      idx = t.idx;
-    };
+    size_t idx;
   };
  private:
   std::string path, name, file;
@@ -74,7 +56,16 @@ class TriMesh {
   std::vector<size_t> mcfc;
   vec3f boundMin;    //!< Bounding box minimum bound
   vec3f boundMax;    //!< Bounding box maximum bound
+  //! The arrays read by the const accessors. They point into the vectors
+  //! above, or into memory shared with other processes (see Unpack).
+  const float *vertexData = nullptr;
+  const float *normalData = nullptr;
+  const float *texcoordData = nullptr;
+  const TriFace *faceData = nullptr;
+  size_t numVertices = 0, numNormals = 0, numTexcoords = 0, numFaces = 0;
  public:
+  TriMesh() = default;
+  TriMesh(const TriMesh &t) { CopyFrom(t); }
 
   //!@name Component Access Methods
   std::string GetDirectoryName() { return path; }
@@ -82,12 +73,12 @@ class TriMesh {
   std::string GetFullPath() { return file; }
 
   //!< returns the i^th face
-  const TriFace& F(size_t i) const { return faces[i]; }
+  const TriFace& F(size_t i) const { return faceData[i]; }
   TriFace& F(size_t i) { return faces[i]; }
 
   //!< returns the i^th vertex
   const vec3f &V(int i) const {
-    return (const vec3f&)attrib.vertices[3 * i];
+    return (const vec3f&)vertexData[3 * i];
   }
   //!< returns the i^th vertex
   vec3f &V(int i) {
@@ -96,7 +87,7 @@ class TriMesh {
 
   //!< returns the i^th vertex normal
   const vec3f &VN(int i) const {
-    return (const vec3f&)attrib.normals[3 * i];
+    return (const vec3f&)normalData[3 * i];
   }
   //!< returns the i^th vertex normal
   vec3f &VN(int i) {
@@ -105,7 +96,7 @@ class TriMesh {
 
   //!< returns the i^th vertex texture
   const vec2f &VT(int i) const {
-    return (const vec2f&)attrib.texcoords[2 * i];
+    return (const vec2f&)texcoordData[2 * i];
   }
   //!< returns the i^th vertex texture
   vec2f &VT(int i) { return (vec2f&)attrib.texcoords[2 * i]; }
@@ -116,13 +107,13 @@ class TriMesh {
   tinyobj::material_t &M(int i) { return materials[i]; }
 
   //!< returns the number of faces
-  size_t NF() const { return faces.size(); }
+  size_t NF() const { return numFaces; }
   //!< returns the number of vertices
-  size_t NV() const { return attrib.vertices.size() / 3; }
+  size_t NV() const { return numVertices; }
   //!< returns the number of vertex normals
-  size_t NVN() const { return attrib.normals.size() / 3; }
+  size_t NVN() const { return numNormals; }
   //!< returns the number of texture vertices
-  size_t NVT() const { return attrib.texcoords.size() / 2; }
+  size_t NVT() const { return numTexcoords; }
   //!< returns the number of materials
   size_t NM() const { return materials.size(); }
 
@@ -130,25 +121,25 @@ class TriMesh {
   bool HasVertices(size_t faceID) const
   {
     return
-        (faces[faceID].v[0]->vertex_index >= 0) &&
-        (faces[faceID].v[1]->vertex_index >= 0) &&
-        (faces[faceID].v[2]->vertex_index >= 0);
+        (faceData[faceID].v[0].vertex_index >= 0) &&
+        (faceData[faceID].v[1].vertex_index >= 0) &&
+        (faceData[faceID].v[2].vertex_index >= 0);
   }
   //!< returns true if the mesh has vertex normals
   bool HasNormals(size_t faceID) const
   {
     return
-        (faces[faceID].v[0]->normal_index >= 0) &&
-        (faces[faceID].v[1]->normal_index >= 0) &&
-        (faces[faceID].v[2]->normal_index >= 0);
+        (faceData[faceID].v[0].normal_index >= 0) &&
+        (faceData[faceID].v[1].normal_index >= 0) &&
+        (faceData[faceID].v[2].normal_index >= 0);
   }
   //!< returns true if the mesh has texture vertices
   bool HasTextureVertices(size_t faceID) const
   {
     return
-        (faces[faceID].v[0]->texcoord_index >= 0) &&
-        (faces[faceID].v[1]->texcoord_index >= 0) &&
-        (faces[faceID].v[2]->texcoord_index >= 0);
+        (faceData[faceID].v[0].texcoord_index >= 0) &&
+        (faceData[faceID].v[1].texcoord_index >= 0) &&
+        (faceData[faceID].v[2].texcoord_index >= 0);
   }
 
   //!@name Set Component Count
@@ -162,12 +153,18 @@ class TriMesh {
     shapes.clear();
     materials.clear();
     faces.clear();
+    mcfc.clear();
     boundMin = vec3f(1, 1, 1);
     boundMax = vec3f(0, 0, 0);
+    UpdateViews();
   }
 
   //!< Copies mesh data from the given mesh.
-  TriMesh& operator=(const TriMesh &t) = default;
+  TriMesh& operator=(const TriMesh &t)
+  {
+    if (&t != this) { CopyFrom(t); }
+    return *this;
+  }
 
   //!@name Get Property Methods
   //!< Returns true if the bounding box has been computed.
@@ -185,9 +182,9 @@ class TriMesh {
   vec3f GetPoint(size_t faceID, const vec3f &bc) const
   {
     assert(HasVertices(faceID));
-    int v0 = faces[faceID].v[0]->vertex_index;
-    int v1 = faces[faceID].v[1]->vertex_index;
-    int v2 = faces[faceID].v[2]->vertex_index;
+    int v0 = faceData[faceID].v[0].vertex_index;
+    int v1 = faceData[faceID].v[1].vertex_index;
+    int v2 = faceData[faceID].v[2].vertex_index;
     return V(v0) * bc.x + V(v1) * bc.y + V(v2) * bc.z;
   }
 
@@ -196,9 +193,9 @@ class TriMesh {
   vec3f GetNormal(size_t faceID, const vec3f &bc) const
   {
     assert(HasVertices(faceID));
-    int v0 = faces[faceID].v[0]->normal_index;
-    int v1 = faces[faceID].v[1]->normal_index;
-    int v2 = faces[faceID].v[2]->normal_index;
+    int v0 = faceData[faceID].v[0].normal_index;
+    int v1 = faceData[faceID].v[1].normal_index;
+    int v2 = faceData[faceID].v[2].normal_index;
     return VN(v0) * bc.x + VN(v1) * bc.y + VN(v2) * bc.z;
   }
 
@@ -207,9 +204,9 @@ class TriMesh {
   vec2f GetTexCoord(size_t faceID, const vec3f &bc) const
   {
     assert(HasVertices(faceID));
-    int v0 = faces[faceID].v[0]->texcoord_index;
-    int v1 = faces[faceID].v[1]->texcoord_index;
-    int v2 = faces[faceID].v[2]->texcoord_index;
+    int v0 = faceData[faceID].v[0].texcoord_index;
+    int v1 = faceData[faceID].v[1].texcoord_index;
+    int v2 = faceData[faceID].v[2].texcoord_index;
     return VT(v0) * bc.x + VT(v1) * bc.y + VT(v2) * bc.z;
   }
   //!< Returns the material index of the face. This method goes through material
@@ -217,7 +214,7 @@ class TriMesh {
   //!< negative number if the face as no material
   int GetMaterialIndex(size_t faceID) const
   {
-    return faces[faceID].mtl;
+    return faceData[faceID].mtl;
   }
   //!< Returns the number of faces associated with the given material ID.
   size_t GetMaterialFaceCount(int mtlID) const;
@@ -232,6 +229,22 @@ class TriMesh {
   bool LoadFromFileObj(const char *filename,
                        bool loadMtl = true,
                        std::ostream *outStream = &std::cout);    //!< Loads the mesh from an OBJ file. Automatically converts all faces to triangles..
+  bool LoadFromStreamObj(const char *filename,
+                         std::istream &obj,
+                         tinyobj::MaterialReader *mtl,
+                         std::ostream *outStream = &std::cout);  //!< Same as LoadFromFileObj with the contents of the OBJ and MTL files read by the caller
+  bool LoadPartFromFileObj(const char *filename,
+                           tinyobj::MaterialReader *mtl,
+                           MeshPartition &partition,
+                           std::ostream *outStream = &std::cout); //!< Loads only the faces of the part 'partition' assigns to this process, streaming the file so that the whole mesh is never held. Collective over the parts.
+  void CopyFrom(const TriMesh &m); //!< Deep copy, also of a mesh that reads shared arrays
+
+  //!@name Shared storage
+  void Pack(SharedBlockWriter &out) const;  //!< Appends the arrays of the mesh and its materials to a block
+  bool Unpack(const char *filename, SharedBlockReader &in); //!< Reads the arrays in place from a block written by Pack, the own copies are released
+ private:
+  bool BuildFaces(std::ostream *outStream); //!< Collects the faces of the loaded shapes, sorted by material
+  void UpdateViews(); //!< Points the arrays read while rendering at the vectors of the mesh
 };
 }
 
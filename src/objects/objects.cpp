@@ -12,6 +12,7 @@
 #include "objects.h"
 #include <stack>
 #include <tiny_obj_loader.h>
+#include "tasking/numa.h"
 
 Sphere theSphere;
 Plane thePlane;
@@ -100,6 +101,7 @@ bool Sphere::IntersectRay(const Ray &ray, HitInfo &hInfo, int hitSide,
         hInfo.p = p;
         hInfo.N = N;
         hInfo.hasFrontHit = front;
+        hInfo.primID = 0;
         // Texture Coordinate at the Hit Point
         hInfo.hasTexture = true;
         hInfo.uvw = Sphere_TexCoord(p);
@@ -167,6 +169,7 @@ bool Plane::IntersectRay(const Ray &ray, HitInfo &hInfo, int hitSide,
         hInfo.p = p;
         hInfo.N = N;
         hInfo.hasFrontHit = front;
+        hInfo.primID = 0;
         // texture coordinates
         hInfo.hasTexture = true;
         hInfo.uvw = Plane_TexCoord(p);
@@ -214,9 +217,9 @@ bool TriObj::IntersectTriangle(const Ray &ray, HitInfo &hInfo,
                                DiffRay *diffray, DiffHitInfo *diffhit) const
 {
   auto &face = F(faceID);
-  const Point3& A = V(face.v[0]->vertex_index); //!< vertex
-  const Point3& B = V(face.v[1]->vertex_index); //!< vertex
-  const Point3& C = V(face.v[2]->vertex_index); //!< vertex
+  const Point3& A = V(face.v[0].vertex_index); //!< vertex
+  const Point3& B = V(face.v[1].vertex_index); //!< vertex
+  const Point3& C = V(face.v[2].vertex_index); //!< vertex
   const Point3
       N = normalize(cross((B - A), (C - A))); //!< face normal
   //! ray - plane intersection
@@ -254,6 +257,7 @@ bool TriObj::IntersectTriangle(const Ray &ray, HitInfo &hInfo,
         hInfo.N = GetNormal(faceID, bc);
         hInfo.hasFrontHit = front;
         hInfo.mtlID = GetMaterialIndex(faceID);
+        hInfo.primID = static_cast<int>(faceID);
         // Texture Coordinates
         // TODO: we need to remove cyCodeBase dependencies
         if (HasTextureVertices(faceID)) {
@@ -310,6 +314,12 @@ bool TriObj::IntersectTriangle(const Ray &ray, HitInfo &hInfo,
 bool TriObj::IntersectRay(const Ray &ray, HitInfo &hInfo, int hitSide,
                           DiffRay *diffray, DiffHitInfo *diffhit) const
 {
+  if (!replicas.empty()) {
+    return replicas[qaray::tasking::numa_this_node() % replicas.size()]
+        ->IntersectRay(ray, hInfo, hitSide, diffray, diffhit);
+  }
+  // the part of a split mesh kept by this process may be empty
+  if (NF() == 0) { return false; }
   // ray-box intersection
   if (!GetBoundBox().IntersectRay(ray, hInfo.z)) { return false; }
   // ray-triangle intersection
@@ -321,6 +331,52 @@ bool TriObj::IntersectRay(const Ray &ray, HitInfo &hInfo, int hitSide,
                       diffhit);
 }
 
+void TriObj::Replicate()
+{
+  replicas.clear();
+  std::vector<std::unique_ptr<TriObj>> copies(qaray::tasking::numa_num_nodes());
+  // the copy is written by a thread of the node, so its pages land there
+  qaray::tasking::numa_on_each_node([&](int node) {
+    std::unique_ptr<TriObj> copy(new TriObj);
+    copy->CopyFrom(*this);
+    copy->bvh.SetMesh(copy.get(), 4);
+    copies[node] = std::move(copy);
+  });
+  replicas = std::move(copies);
+}
+
+bool TriObj::Share(NodeSharing &sharing, const char *filename)
+{
+  replicas.clear();
+  size_t bytes = 0;
+  const char *shared = nullptr;
+  if (sharing.IsLoader()) {
+    SharedBlockWriter out;
+    if (NF() > 0) {
+      Pack(out);
+      out.Put(static_cast<const char *>(bvh.GetNodeData()),
+              bvh.GetNodeDataSize());
+      out.Put(bvh.GetElements(), bvh.GetElementCount());
+    }
+    bytes = out.Data().size();
+    shared = sharing.Share(out.Data().data(), bytes);
+  } else {
+    shared = sharing.Share(nullptr, bytes);
+  }
+  bvh.Clear();
+  if (shared == nullptr) { Clear(); return false; }
+  // the loader drops its own arrays too and reads the shared ones
+  SharedBlockReader in(shared, bytes);
+  size_t nodeBytes = 0, numElements = 0;
+  if (!Unpack(filename, in)) { return false; }
+  const char *nodes = in.Get<char>(nodeBytes);
+  const unsigned int *elements = in.Get<unsigned int>(numElements);
+  if (!in.Good()) { Clear(); return false; }
+  bvh.Attach(nodes, nodeBytes, elements,
+             static_cast<unsigned int>(numElements));
+  return true;
+}
+
 bool TriObj::TraceBVHNode(const Ray &ray,
                           HitInfo &hInfo,
                           int hitSide,
@@ -19,6 +19,9 @@
 #include "mesh/TriMesh.h"
 #include "mesh/TriBVH.h"
 
+#include <memory>
+#include <vector>
+
 //------------------------------------------------------------------------------
 
 class Sphere : public Object {
@@ -62,18 +65,49 @@ class TriObj : public Object, public TriMesh {
 
   void ViewportDisplay(const Material *mtl) const override ;
 
-  bool Load(const char *filename, bool loadMtl)
+  //! Build one copy of the mesh and its BVH on every NUMA node, rays are
+  //! then traced against the copy of the node of the calling thread
+  void Replicate();
+
+  //! Move the mesh and its BVH into memory shared by the ranks of the host.
+  //! Collective over these ranks: the loader shares the mesh it loaded, the
+  //! other ranks call it on an empty object that then reads the shared copy.
+  //! Returns false on all ranks when the loader has no mesh.
+  bool Share(NodeSharing &sharing, const char *filename);
+
+  //! 'obj' and 'mtl' give the contents of the files when the caller has
+  //! read them already, the files are opened otherwise
+  bool Load(const char *filename, bool loadMtl,
+            std::istream *obj = nullptr,
+            tinyobj::MaterialReader *mtl = nullptr)
   {
     bvh.Clear();
-    if (!LoadFromFileObj(filename, loadMtl)) return false;
+    replicas.clear();
+    const bool loaded = obj ? LoadFromStreamObj(filename, *obj, mtl)
+                            : LoadFromFileObj(filename, loadMtl);
+    if (!loaded) return false;
     if (NVN() == 0) ComputeNormals();
     ComputeBoundingBox();
     bvh.SetMesh(this, 4);
     return true;
   }
 
+  //! Load only the part of the mesh 'partition' assigns to this process,
+  //! see TriMesh::LoadPartFromFileObj. Collective over the parts.
+  bool LoadPart(const char *filename, tinyobj::MaterialReader *mtl,
+                MeshPartition &partition)
+  {
+    bvh.Clear();
+    replicas.clear();
+    if (!LoadPartFromFileObj(filename, mtl, partition)) return false;
+    ComputeBoundingBox();
+    bvh.SetMesh(this, 4);
+    return true;
+  }
+
  private:
   BVHTriMesh bvh;
+  std::vector<std::unique_ptr<TriObj>> replicas;
 
   bool IntersectTriangle(const Ray &ray,
                          HitInfo &hInfo,
@@ -12,13 +12,19 @@
 #include "xmlload.h"
 
 #include "scene/scene.h"
+#include "scene/animation.h"
 #include "lights/lights.h"
 #include "objects/objects.h"
 #include "materials/materials.h"
 #include "textures/texture.h"
+#include "tasking/numa.h"
+#include "core/sharing.h"
+#include "core/partition.h"
 
 #include <tinyxml/tinyxml.h>
 #include <tiny_obj_loader.h>
+#include <sstream>
+#include <string>
 
 //-----------------------------------------------------------------------------
 
@@ -59,6 +65,79 @@ void LoadSceneInSilentMode(bool flag) { silentmode = flag; }
 
 //-----------------------------------------------------------------------------
 
+SceneFileReader sceneFileReader = ReadSceneFileFromDisk;
+
+void SetSceneFileReader(SceneFileReader reader)
+{
+  sceneFileReader = reader ? reader : ReadSceneFileFromDisk;
+}
+
+bool ReadSceneFileFromDisk(const char *filename, std::vector<char> &data)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) return false;
+  data.clear();
+  char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  bool good = ferror(fp) == 0;
+  fclose(fp);
+  return good;
+}
+
+// Parse an xml file, the line endings are normalized as TiXmlDocument does
+// when it opens the file itself
+static bool LoadDocument(TiXmlDocument &doc, const char *filename)
+{
+  std::vector<char> data;
+  if (!sceneFileReader(filename, data)) return false;
+  std::string text;
+  text.reserve(data.size());
+  for (size_t i = 0; i < data.size(); i++) {
+    if (data[i] != '\r') text += data[i];
+    else if (i + 1 == data.size() || data[i + 1] != '\n') text += '\n';
+  }
+  doc.Parse(text.c_str());
+  return !doc.Error();
+}
+
+// Meshes and textures that end up in memory shared by the ranks of a host
+// are only read by the loading ranks
+static bool ReadSharedSceneFile(const char *filename, std::vector<char> &data)
+{
+  NodeSharing *sharing = GetNodeSharing();
+  return sharing ? sharing->ReadFile(filename, data)
+                 : sceneFileReader(filename, data);
+}
+
+// Reads the mtl files of an obj file through the scene file reader
+class SceneMtlReader : public tinyobj::MaterialReader {
+ public:
+  explicit SceneMtlReader(const std::string &dir) : dir(dir) {}
+  bool operator()(const std::string &matId,
+                  std::vector<tinyobj::material_t> *materials,
+                  std::map<std::string, int> *matMap,
+                  std::string *err) override
+  {
+    std::vector<char> data;
+    if (!ReadSharedSceneFile((dir + matId).c_str(), data)) {
+      if (err) *err += "WARN: Material file [ " + dir + matId + " ] not found.\n";
+      return false;
+    }
+    std::istringstream stream(std::string(data.begin(), data.end()));
+    std::string warning;
+    tinyobj::LoadMtl(matMap, materials, &stream, &warning);
+    if (err) *err += warning;
+    return true;
+  }
+ private:
+  std::string dir;
+};
+
+//-----------------------------------------------------------------------------
+
 struct NodeMtl {
   Node *node;
   const char *mtlName;
@@ -71,7 +150,7 @@ std::vector<NodeMtl> nodeMtlList;
 int LoadScene(const char *filename)
 {
   TiXmlDocument doc(filename);
-  if (!doc.LoadFile()) {
+  if (!LoadDocument(doc, filename)) {
     PRINTF("Failed to load the file \"%s\"\n", filename);
     return 0;
   }
@@ -150,6 +229,170 @@ int LoadScene(const char *filename)
 
 //-----------------------------------------------------------------------------
 
+static void ReplaceMaterial(Node &node, Material *oldMtl, Material *newMtl)
+{
+  if (node.GetMaterial() == oldMtl) node.SetMaterial(newMtl);
+  for (int i = 0; i < node.GetNumChild(); i++)
+    ReplaceMaterial(*node.GetChild(i), oldMtl, newMtl);
+}
+
+// Move the last item of the list over the item that has the same name
+template<class T>
+static T *ReplaceByName(std::vector<T *> &list)
+{
+  T *item = list.back();
+  list.pop_back();
+  for (size_t i = 0; i < list.size(); i++) {
+    if (strcmp(list[i]->GetName(), item->GetName()) == 0) {
+      T *old = list[i];
+      list[i] = item;
+      return old;
+    }
+  }
+  PRINTF("No item named \"%s\" to edit.\n", item->GetName());
+  delete item;
+  return NULL;
+}
+
+int LoadEdits(const char *filename, std::vector<ItemBase *> &replaced)
+{
+  TiXmlDocument doc(filename);
+  if (!LoadDocument(doc, filename)) {
+    PRINTF("Failed to load the file \"%s\"\n", filename);
+    return 0;
+  }
+
+  TiXmlElement *xml = doc.FirstChildElement("xml");
+  TiXmlElement *edits = xml ? xml->FirstChildElement("scene") : NULL;
+  if (!edits) {
+    PRINTF("No \"scene\" tag found.\n");
+    return 0;
+  }
+
+  for (TiXmlElement *element = edits->FirstChildElement();
+       element != NULL; element = element->NextSiblingElement()) {
+    if (COMPARE(element->Value(), "material")) {
+      size_t n = qaray::scene.materials.size();
+      LoadMaterial(element);
+      if (qaray::scene.materials.size() == n) continue;
+      Material *newMtl = qaray::scene.materials.back();
+      Material *oldMtl = ReplaceByName<Material>(qaray::scene.materials);
+      if (oldMtl) {
+        ReplaceMaterial(qaray::scene.rootNode, oldMtl, newMtl);
+        replaced.push_back(oldMtl);
+      }
+    } else if (COMPARE(element->Value(), "light")) {
+      size_t n = qaray::scene.lights.size();
+      LoadLight(element);
+      if (qaray::scene.lights.size() == n) continue;
+      Light *oldLight = ReplaceByName<Light>(qaray::scene.lights);
+      if (oldLight) replaced.push_back(oldLight);
+    }
+  }
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+
+static Node *FindNode(Node &node, const char *name)
+{
+  if (strcmp(node.GetName(), name) == 0) return &node;
+  for (int i = 0; i < node.GetNumChild(); i++) {
+    Node *found = FindNode(*node.GetChild(i), name);
+    if (found) return found;
+  }
+  return NULL;
+}
+
+int LoadAnimation(const char *filename, qaray::Animation &anim)
+{
+  TiXmlDocument doc(filename);
+  if (!LoadDocument(doc, filename)) {
+    PRINTF("Failed to load the file \"%s\"\n", filename);
+    return 0;
+  }
+
+  TiXmlElement *xml = doc.FirstChildElement("xml");
+  TiXmlElement *animation = xml ? xml->FirstChildElement("animation") : NULL;
+  if (!animation) return 0;
+
+  int numFrames = 0;
+  animation->QueryIntAttribute("frames", &numFrames);
+  PRINTF("animation - %d frames\n", numFrames);
+  const Camera &cam = qaray::scene.camera;
+  for (TiXmlElement *track = animation->FirstChildElement();
+       track != NULL; track = track->NextSiblingElement()) {
+    const bool isCamera = COMPARE(track->Value(), "camera");
+    Node *node = NULL;
+    if (!isCamera) {
+      const char *name = track->Attribute("name");
+      if (!COMPARE(track->Value(), "object") || !name) continue;
+      node = FindNode(qaray::scene.rootNode, name);
+      if (!node) {
+        PRINTF("No object named \"%s\" to animate.\n", name);
+        continue;
+      }
+    }
+    int numKeys = 0;
+    for (TiXmlElement *key = track->FirstChildElement("key");
+         key != NULL; key = key->NextSiblingElement("key")) {
+      int frame = 0;
+      key->QueryIntAttribute("frame", &frame);
+      ++numKeys;
+      if (isCamera) {
+        // unset fields keep the camera of the scene, without a target the
+        // camera keeps its direction
+        CameraKey k;
+        k.frame = frame;
+        k.pos = cam.pos;
+        k.up = cam.up;
+        bool hasTarget = false;
+        k.fovy = cam.fovy;
+        k.focalDistance = cam.focalDistance;
+        k.depthOfField = cam.depthOfField;
+        for (TiXmlElement *child = key->FirstChildElement();
+             child != NULL; child = child->NextSiblingElement()) {
+          if (COMPARE(child->Value(), "position")) ReadVector(child, k.pos);
+          else if (COMPARE(child->Value(), "target")) {
+            ReadVector(child, k.target);
+            hasTarget = true;
+          }
+          else if (COMPARE(child->Value(), "up")) ReadVector(child, k.up);
+          else if (COMPARE(child->Value(), "fov")) ReadFloat(child, k.fovy);
+          else if (COMPARE(child->Value(), "focaldist"))
+            ReadFloat(child, k.focalDistance);
+          else if (COMPARE(child->Value(), "dof"))
+            ReadFloat(child, k.depthOfField);
+        }
+        if (!hasTarget) k.target = k.pos + cam.dir;
+        anim.AddCameraKey(k);
+      } else {
+        TransformKey k;
+        k.frame = frame;
+        for (TiXmlElement *child = key->FirstChildElement();
+             child != NULL; child = child->NextSiblingElement()) {
+          if (COMPARE(child->Value(), "scale")) {
+            ReadVector(child, k.scale);
+          } else if (COMPARE(child->Value(), "rotate")) {
+            k.axis = Point3(0, 0, 0);
+            ReadVector(child, k.axis);
+            ReadFloat(child, k.angle, "angle");
+          } else if (COMPARE(child->Value(), "translate")) {
+            ReadVector(child, k.translate);
+          }
+        }
+        anim.AddNodeKey(node, k);
+      }
+    }
+    PRINTF("   %s [%s] - %d keys\n", isCamera ? "camera" : "object",
+           isCamera ? "" : node->GetName(), numKeys);
+  }
+  anim.SetNumFrames(numFrames);
+  return numFrames;
+}
+
+//-----------------------------------------------------------------------------
+
 void PrintIndent(int level)
 {
   for (int i = 0; i < level; i++) PRINTF("   ");
@@ -222,12 +465,41 @@ void LoadNode(Node *parent, TiXmlElement *element, int level)
       Object *obj = qaray::scene.objList.Find(name);
       if (obj == NULL) {// object is not on the list, so we should load it now
         TriObj *tobj = new TriObj;
-        if (!tobj->Load(name, mtlName == NULL)) {
+        NodeSharing *sharing = GetNodeSharing();
+        MeshPartition *partition = GetMeshPartition();
+        bool loaded = false;
+        if (partition) {
+          // every process streams the file itself, its contents would not
+          // fit in memory
+          std::string file(name);
+          size_t p = file.find_last_of("/\\");
+          SceneMtlReader mtlReader(p == std::string::npos ? "" :
+                                   file.substr(0, p + 1));
+          loaded = tobj->LoadPart(name, &mtlReader, *partition);
+        } else if (sharing == NULL || sharing->IsLoader()) {
+          std::vector<char> data;
+          loaded = ReadSharedSceneFile(name, data);
+          if (loaded) {
+            std::string file(name);
+            size_t p = file.find_last_of("/\\");
+            SceneMtlReader mtlReader(p == std::string::npos ? "" :
+                                     file.substr(0, p + 1));
+            std::istringstream obj(std::string(data.begin(), data.end()));
+            std::vector<char>().swap(data);
+            loaded = tobj->Load(name, mtlName == NULL, &obj, &mtlReader);
+          }
+        }
+        // the other ranks of the host get the mesh of the loader
+        if (sharing) loaded = tobj->Share(*sharing, name);
+        if (!loaded) {
           PRINTF(" -- ERROR: Cannot load file \"%s.\"", name);
           delete tobj;
         } else {
           qaray::scene.objList.Append(tobj, name);// add to the list
           obj = tobj;
+          if (qaray::tasking::get_numa_replication() && sharing == NULL) {
+            tobj->Replicate();
+          }
           // generate multi-material
           if (mtlName == NULL && tobj->NM() > 0) {
             if (qaray::scene.materials.Find(name) == NULL) {
@@ -616,7 +888,14 @@ Texture *ReadTexture(const char *texName)
     TextureFile *ftex = new TextureFile;
     tex = ftex;
     ftex->SetName(texName);
-    if (!ftex->Load()) {
+    NodeSharing *sharing = GetNodeSharing();
+    bool loaded = false;
+    if (sharing == NULL || sharing->IsLoader()) {
+      std::vector<char> data;
+      loaded = ReadSharedSceneFile(texName, data) && ftex->Load(data);
+    }
+    if (sharing) loaded = ftex->Share(*sharing);
+    if (!loaded) {
       PRINTF(" -- Error loading file!");
       delete tex;
       tex = NULL;
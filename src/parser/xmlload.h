@@ -13,8 +13,30 @@
 #ifndef _XML_LOAD_H_
 #define _XML_LOAD_H_
 
+#include <vector>
+
 void LoadSceneInSilentMode(bool);
 
+// Every file of a scene (xml, obj, mtl and textures) is read into memory by
+// a reader before it is parsed. The default reader opens the file, another
+// one can hand out contents it got elsewhere. Passing NULL restores the
+// default reader.
+typedef bool (*SceneFileReader)(const char *filename, std::vector<char> &data);
+void SetSceneFileReader(SceneFileReader reader);
+bool ReadSceneFileFromDisk(const char *filename, std::vector<char> &data);
+
 int LoadScene(const char *filename);
 
+namespace qaray { class ItemBase; class Animation; }
+
+// Load the materials and lights of an edit file (same format as a scene
+// file) over the items of the current scene that have the same names. The
+// replaced items are returned and still have to be deleted by the caller.
+int LoadEdits(const char *filename, std::vector<qaray::ItemBase *> &replaced);
+
+// Load the "animation" tag of a file (the scene file or a side file) with
+// camera and object keyframes, objects are found by name in the current
+// scene. Returns the number of frames, 0 when there is no animation.
+int LoadAnimation(const char *filename, qaray::Animation &anim);
+
 #endif//_XML_LOAD_H_
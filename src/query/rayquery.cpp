@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------
+///
+/// \file       rayquery.cpp
+/// \author     Qi WU
+///
+/// \brief Batched ray queries (SoA layout) against a loaded scene
+///
+//------------------------------------------------------------------------------
+
+#include "rayquery.h"
+#include "tasking/parallel_range.h"
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+RayQuery::RayQuery(Scene &scene) : scene(scene) { Commit(); }
+
+void RayQuery::Commit()
+{
+  instances.clear();
+  instanceIDs.clear();
+  CollectInstances(scene.rootNode);
+}
+
+void RayQuery::CollectInstances(const Node &node)
+{
+  instanceIDs[&node] = static_cast<qaINT>(instances.size());
+  instances.push_back(&node);
+  for (int c = 0; c < node.GetNumChild(); ++c) {
+    CollectInstances(*node.GetChild(c));
+  }
+}
+
+const Node *RayQuery::GetInstance(qaINT id) const
+{
+  if (id < 0 || static_cast<size_t>(id) >= instances.size()) { return nullptr; }
+  return instances[id];
+}
+///--------------------------------------------------------------------------//
+void RayQuery::Intersect(const RayBatch &rays, HitBatch &hits) const
+{
+  // batches are split into chunks of grainSize rays over the tasking pool
+  const tasking::blocked_range<size_t> range(0, rays.count, grainSize);
+  tasking::parallel_for(range, [&](const tasking::blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+      DiffRay ray(Point3(rays.orgX[i], rays.orgY[i], rays.orgZ[i]),
+                  Point3(rays.dirX[i], rays.dirY[i], rays.dirZ[i]));
+      DiffHitInfo hInfo;
+      hInfo.c.z = rays.tmax ? rays.tmax[i] : BIGFLOAT;
+      const bool hasHit = scene.TraceNodeNormal(scene.rootNode, ray, hInfo);
+      const Point3 N = hasHit ? normalize(hInfo.c.N) : Point3(0.f);
+      qaINT instID = -1;
+      if (hasHit) {
+        auto it = instanceIDs.find(hInfo.c.node);
+        if (it != instanceIDs.end()) { instID = it->second; }
+      }
+      if (hits.t) { hits.t[i] = hasHit ? hInfo.c.z : BIGFLOAT; }
+      if (hits.primID) { hits.primID[i] = hasHit ? hInfo.c.primID : -1; }
+      if (hits.instID) { hits.instID[i] = instID; }
+      if (hits.nX) { hits.nX[i] = N.x; }
+      if (hits.nY) { hits.nY[i] = N.y; }
+      if (hits.nZ) { hits.nZ[i] = N.z; }
+    }
+  });
+}
+
+void RayQuery::Occluded(const RayBatch &rays, qaUCHAR *occluded) const
+{
+  // batches are split into chunks of grainSize rays over the tasking pool
+  const tasking::blocked_range<size_t> range(0, rays.count, grainSize);
+  tasking::parallel_for(range, [&](const tasking::blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+      Ray ray(Point3(rays.orgX[i], rays.orgY[i], rays.orgZ[i]),
+              Point3(rays.dirX[i], rays.dirY[i], rays.dirZ[i]));
+      HitInfo hInfo;
+      hInfo.z = rays.tmax ? rays.tmax[i] : BIGFLOAT;
+      occluded[i] = scene.TraceNodeShadow(scene.rootNode, ray, hInfo) ? 1 : 0;
+    }
+  });
+}
+///--------------------------------------------------------------------------//
+}
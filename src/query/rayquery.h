@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+///
+/// \file       rayquery.h
+/// \author     Qi WU
+///
+/// \brief Batched ray queries (SoA layout) against a loaded scene. This is
+///        meant for tools that only need visibility information and do not
+///        want to go through the renderer.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_RAYQUERY_H
+#define QARAY_RAYQUERY_H
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+#include "core/core.h"
+#include "scene/scene.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Input rays in structure-of-arrays layout. The arrays are owned by the
+//! caller and must hold at least 'count' entries. 'tmax' is optional, rays
+//! are unbounded when it is null.
+struct RayBatch {
+  size_t count = 0;
+  const qaFLOAT *orgX = nullptr, *orgY = nullptr, *orgZ = nullptr;
+  const qaFLOAT *dirX = nullptr, *dirY = nullptr, *dirZ = nullptr;
+  const qaFLOAT *tmax = nullptr;
+};
+//! Closest-hit results in structure-of-arrays layout. Missed rays get
+//! t = BIGFLOAT, primID = instID = -1 and a zero normal. Any of the
+//! arrays can be null if the caller does not need that output.
+struct HitBatch {
+  qaFLOAT *t = nullptr;
+  qaINT *primID = nullptr;  //!< face index for meshes, 0 for other objects
+  qaINT *instID = nullptr;  //!< index of the hit node, see RayQuery
+  qaFLOAT *nX = nullptr, *nY = nullptr, *nZ = nullptr; //!< world space
+};
+///--------------------------------------------------------------------------//
+class RayQuery {
+ public:
+  static const size_t defaultGrainSize = 256;
+ private:
+  Scene &scene;
+  std::vector<const Node *> instances; //!< nodes in pre-order
+  std::unordered_map<const Node *, qaINT> instanceIDs;
+  size_t grainSize = defaultGrainSize;
+ public:
+  explicit RayQuery(Scene &scene);
+  //! Rebuild the instance table, call it after the node tree is modified
+  void Commit();
+  //! Number of rays handled by one task of the tasking pool
+  void SetGrainSize(size_t n) { grainSize = MAX(n, size_t(1)); }
+  size_t GetGrainSize() const { return grainSize; }
+  //! Instances are the scene nodes numbered in pre-order (root is 0)
+  size_t GetNumInstances() const { return instances.size(); }
+  const Node *GetInstance(qaINT id) const;
+  //! Closest hit for every ray of the batch
+  void Intersect(const RayBatch &rays, HitBatch &hits) const;
+  //! Any hit within tmax, 'occluded' receives 1 for blocked rays and 0
+  //! otherwise
+  void Occluded(const RayBatch &rays, qaUCHAR *occluded) const;
+ private:
+  void CollectInstances(const Node &node);
+};
+///--------------------------------------------------------------------------//
+}
+
+#endif //QARAY_RAYQUERY_H
@@ -39,6 +39,7 @@ void Renderer_GUI::BeginRender()
   // Reset
   StopRender();
   image->ResetNumRenderedPixels();
+  if (image->HasAccumulation()) { image->AllocateAccumulationBuffer(); }
   // Start threads
   tasking::signal_start();
   threadMain = new std::thread([&]{
@@ -27,14 +27,307 @@
 
 #include "Renderer_MPI.h"
 #include "parser/xmlload.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <unordered_map>
 
 namespace qaray {
+//! In progressive and adaptive modes Ctrl-C stops after the current samples and the
+//! images accumulated so far are still written out. With checkpoints, Ctrl-C
+//! and SIGTERM also write a last checkpoint to resume from.
+static volatile std::sig_atomic_t interrupted = 0;
+static void StopOnInterrupt(int)
+{
+  interrupted = 1;
+  tasking::signal_stop();
+}
+
+#ifdef USE_MPI
+//! Rank 0 of 'comm' reads a file and broadcasts its contents
+static bool BroadcastFile(const char *filename, std::vector<char> &data,
+                          MPI_Comm comm)
+{
+  const size_t chunk = size_t(1) << 28; // MPI counts are ints
+  int rank = 0;
+  MPI_Comm_rank(comm, &rank);
+  long long size = -1;
+  if (rank == 0 && ReadSceneFileFromDisk(filename, data)) {
+    size = static_cast<long long>(data.size());
+  }
+  MPI_Bcast(&size, 1, MPI_LONG_LONG, 0, comm);
+  if (size < 0) { return false; }
+  data.resize(static_cast<size_t>(size));
+  for (size_t offset = 0; offset < data.size(); offset += chunk) {
+    const size_t n = MIN(chunk, data.size() - offset);
+    MPI_Bcast(data.data() + offset, static_cast<int>(n), MPI_BYTE, 0, comm);
+  }
+  return true;
+}
+//! Rank 0 reads the scene files and broadcasts their contents, the other
+//! ranks parse what they receive and never open the files. All ranks load
+//! the same scene, so they ask for the same files in the same order.
+static bool BroadcastSceneFile(const char *filename, std::vector<char> &data)
+{
+  return BroadcastFile(filename, data, MPI_COMM_WORLD);
+}
+//---------------------------------------------------------------------------//
+// Scene data shared by the ranks of a host. The lowest rank of every host
+// is its loader, so rank 0 is a loader too and the root of the loaders.
+//---------------------------------------------------------------------------//
+class NodeSharing_MPI : public NodeSharing {
+ private:
+  MPI_Comm node, loaders; // 'loaders' is MPI_COMM_NULL on the other ranks
+  std::vector<std::pair<const char *, MPI_Win>> windows;
+ public:
+  NodeSharing_MPI(MPI_Comm node, MPI_Comm loaders)
+      : node(node), loaders(loaders) {}
+  ~NodeSharing_MPI() override
+  {
+    // collective, all ranks hold the same windows in the same order
+    for (auto &w : windows) { MPI_Win_free(&w.second); }
+  }
+  bool IsLoader() const override { return loaders != MPI_COMM_NULL; }
+  //! Rank 0 reads the file for all the loaders
+  bool ReadFile(const char *filename, std::vector<char> &data) override
+  {
+    return IsLoader() && BroadcastFile(filename, data, loaders);
+  }
+  const char *Share(const void *data, size_t &bytes) override
+  {
+    unsigned long long size = IsLoader() ? bytes : 0;
+    MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG_LONG, 0, node);
+    bytes = 0;
+    if (size == 0) { return nullptr; }
+    // the window memory is allocated by the loader only, the others map it
+    char *base = nullptr;
+    MPI_Win win;
+    MPI_Win_allocate_shared(IsLoader() ? MPI_Aint(size) : 0, 1,
+                            MPI_INFO_NULL, node, &base, &win);
+    if (IsLoader()) {
+      memcpy(base, data, static_cast<size_t>(size));
+    } else {
+      MPI_Aint querySize;
+      int dispUnit;
+      MPI_Win_shared_query(win, 0, &querySize, &dispUnit, &base);
+    }
+    // the copy of the loader is complete and visible after the fence
+    MPI_Win_fence(0, win);
+    windows.emplace_back(base, win);
+    bytes = static_cast<size_t>(size);
+    return base;
+  }
+  void Release(const char *shared) override
+  {
+    for (auto w = windows.begin(); w != windows.end(); ++w) {
+      if (w->first == shared) {
+        MPI_Win_free(&w->second);
+        windows.erase(w);
+        return;
+      }
+    }
+  }
+};
+//---------------------------------------------------------------------------//
+// Meshes split over the ranks, one part per rank
+//---------------------------------------------------------------------------//
+class MeshPartition_MPI : public MeshPartition {
+ private:
+  int size = 1, rank = 0;
+ public:
+  MeshPartition_MPI()
+  {
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  }
+  size_t NumParts() const override { return static_cast<size_t>(size); }
+  size_t Part() const override { return static_cast<size_t>(rank); }
+  bool AllOk(bool ok) override
+  {
+    int local = ok ? 1 : 0, all = 0;
+    MPI_Allreduce(&local, &all, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return all != 0;
+  }
+  //! The shared ids are the vertices on the seams between the parts, they
+  //! are few compared to the mesh, so every rank gathers all of them
+  void SumShared(const std::vector<uint64_t> &ids,
+                 std::vector<float> &values, size_t dim) override
+  {
+    int count = static_cast<int>(ids.size());
+    std::vector<int> counts(size), offsets(size);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT,
+                  MPI_COMM_WORLD);
+    int total = 0;
+    for (int r = 0; r < size; ++r) { offsets[r] = total; total += counts[r]; }
+    if (total == 0) { return; }
+    std::vector<uint64_t> allIds(total);
+    MPI_Allgatherv(ids.data(), count, MPI_UINT64_T, allIds.data(),
+                   counts.data(), offsets.data(), MPI_UINT64_T,
+                   MPI_COMM_WORLD);
+    for (int r = 0; r < size; ++r) {
+      counts[r] *= static_cast<int>(dim);
+      offsets[r] *= static_cast<int>(dim);
+    }
+    std::vector<float> allValues(total * dim);
+    MPI_Allgatherv(values.data(), count * static_cast<int>(dim), MPI_FLOAT,
+                   allValues.data(), counts.data(), offsets.data(), MPI_FLOAT,
+                   MPI_COMM_WORLD);
+    std::unordered_map<uint64_t, size_t> local(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) { local[ids[i]] = i; }
+    std::fill(values.begin(), values.end(), 0.f);
+    for (size_t j = 0; j < allIds.size(); ++j) {
+      auto it = local.find(allIds[j]);
+      if (it == local.end()) { continue; }
+      for (size_t d = 0; d < dim; ++d) {
+        values[it->second * dim + d] += allValues[j * dim + d];
+      }
+    }
+  }
+};
+//---------------------------------------------------------------------------//
+// Rays of a data-distributed render. The rays of a stage go to the ranks
+// whose meshes they may reach in one message per rank, the hits come back
+// the same way. All exchanges are collective over all the ranks.
+//---------------------------------------------------------------------------//
+class RayForwarding_MPI : public RayForwarding {
+ private:
+  int size = 1, rank = 0;
+  SceneDomains domains;
+  //! Send out[r] to rank r, 'in' receives what the ranks sent to this one,
+  //! in rank order, and 'counts' how much every rank sent
+  template<typename T>
+  void Exchange(const std::vector<std::vector<T>> &out, std::vector<T> &in,
+                std::vector<int> &counts) const
+  {
+    std::vector<int> sendBytes(size), sendOffsets(size, 0);
+    std::vector<int> recvBytes(size), recvOffsets(size, 0);
+    std::vector<T> send;
+    for (int r = 0; r < size; ++r) {
+      sendOffsets[r] = static_cast<int>(send.size() * sizeof(T));
+      sendBytes[r] = static_cast<int>(out[r].size() * sizeof(T));
+      send.insert(send.end(), out[r].begin(), out[r].end());
+    }
+    MPI_Alltoall(sendBytes.data(), 1, MPI_INT, recvBytes.data(), 1, MPI_INT,
+                 MPI_COMM_WORLD);
+    counts.resize(size);
+    size_t total = 0;
+    for (int r = 0; r < size; ++r) {
+      recvOffsets[r] = static_cast<int>(total);
+      total += recvBytes[r];
+      counts[r] = recvBytes[r] / static_cast<int>(sizeof(T));
+    }
+    in.resize(total / sizeof(T));
+    MPI_Alltoallv(send.data(), sendBytes.data(), sendOffsets.data(), MPI_BYTE,
+                  in.data(), recvBytes.data(), recvOffsets.data(), MPI_BYTE,
+                  MPI_COMM_WORLD);
+  }
+ public:
+  RayForwarding_MPI()
+  {
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  }
+  void Commit(Scene &scene) override
+  {
+    domains.Build(scene);
+    const std::vector<Box> &local = domains.LocalBoxes();
+    const int bytes = static_cast<int>(local.size() * sizeof(Box));
+    std::vector<int> counts(size), offsets(size, 0);
+    MPI_Allgather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT,
+                  MPI_COMM_WORLD);
+    for (int r = 1; r < size; ++r) {
+      offsets[r] = offsets[r - 1] + counts[r - 1];
+    }
+    std::vector<Box> all((offsets.back() + counts.back()) / sizeof(Box));
+    MPI_Allgatherv(local.data(), bytes, MPI_BYTE, all.data(), counts.data(),
+                   offsets.data(), MPI_BYTE, MPI_COMM_WORLD);
+    // the own meshes are never forwarded to
+    std::vector<std::vector<Box>> boxes(size);
+    for (int r = 0; r < size; ++r) {
+      if (r == rank) { continue; }
+      boxes[r].assign(all.begin() + offsets[r] / sizeof(Box),
+                      all.begin() + (offsets[r] + counts[r]) / sizeof(Box));
+    }
+    domains.SetDomains(std::move(boxes));
+  }
+  void Intersect(const std::vector<DiffRay> &rays,
+                 std::vector<DiffHitInfo> &hits,
+                 std::vector<qaUCHAR> &found) override
+  {
+    // a ray only goes where it may find a hit closer than the local one
+    std::vector<std::vector<ForwardedRay>> out(size);
+    for (size_t i = 0; i < rays.size(); ++i) {
+      const float tMax = found[i] ? hits[i].c.z : BIGFLOAT;
+      for (int r = 0; r < size; ++r) {
+        if (domains.Reaches(r, rays[i].c, tMax)) {
+          out[r].push_back({rays[i], tMax, static_cast<qaUINT>(i)});
+        }
+      }
+    }
+    std::vector<ForwardedRay> in;
+    std::vector<int> counts;
+    Exchange(out, in, counts);
+    std::vector<ForwardedHit> results;
+    std::vector<qaUCHAR> hit;
+    domains.Intersect(in, results, hit);
+    // only the hits go back to the ranks that sent the rays
+    std::vector<std::vector<ForwardedHit>> back(size);
+    size_t k = 0;
+    for (int r = 0; r < size; ++r) {
+      for (int c = 0; c < counts[r]; ++c, ++k) {
+        if (hit[k]) { back[r].push_back(results[k]); }
+      }
+    }
+    std::vector<ForwardedHit> replies;
+    Exchange(back, replies, counts);
+    for (auto &h : replies) { domains.Merge(h, hits[h.index], found[h.index]); }
+  }
+  void Occluded(const std::vector<ShadowRequest> &shadows,
+                std::vector<qaUCHAR> &occluded) override
+  {
+    std::vector<std::vector<ForwardedShadow>> out(size);
+    for (size_t i = 0; i < shadows.size(); ++i) {
+      if (occluded[i]) { continue; }
+      for (int r = 0; r < size; ++r) {
+        if (domains.Reaches(r, shadows[i].ray, shadows[i].tMax)) {
+          out[r].push_back({shadows[i].ray, shadows[i].tMax,
+                            static_cast<qaUINT>(i)});
+        }
+      }
+    }
+    std::vector<ForwardedShadow> in;
+    std::vector<int> counts;
+    Exchange(out, in, counts);
+    std::vector<qaUCHAR> blocked;
+    domains.Occluded(in, blocked);
+    // the indices of the blocked rays go back
+    std::vector<std::vector<qaUINT>> back(size);
+    size_t k = 0;
+    for (int r = 0; r < size; ++r) {
+      for (int c = 0; c < counts[r]; ++c, ++k) {
+        if (blocked[k]) { back[r].push_back(in[k].index); }
+      }
+    }
+    std::vector<qaUINT> replies;
+    Exchange(back, replies, counts);
+    for (auto i : replies) { occluded[i] = 1; }
+  }
+  bool AnyActive(bool active) override
+  {
+    int flag = active ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &flag, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    return flag != 0;
+  }
+};
+#endif
 Renderer_MPI::Renderer_MPI(RendererParam& param) : Renderer(param) {}
 void Renderer_MPI::Init()
 {
 #ifdef USE_MPI
-  // Initialize the MPI environment
-  MPI_Init(nullptr, nullptr);
+  // Initialize the MPI environment. Dynamic tiles are claimed by the worker
+  // threads, one at a time.
+  int threadSupport = MPI_THREAD_SINGLE;
+  MPI_Init_thread(nullptr, nullptr, MPI_THREAD_SERIALIZED, &threadSupport);
   // Get the number of processes
   int tmp_mpi_size;
   MPI_Comm_size(MPI_COMM_WORLD, &tmp_mpi_size);
@@ -50,12 +343,78 @@ void Renderer_MPI::Init()
   // Setup parameters
   if (mpiRank == 0) { fprintf(stdout, "Number of MPI Ranks: %zu\n", mpiSize); }
   mpiPrefix = std::string("rank_") + std::to_string(mpiRank) + "_";
+  MPI_Win_allocate(mpiRank == 0 ? sizeof(long long) : 0, sizeof(long long),
+                   MPI_INFO_NULL, MPI_COMM_WORLD, &tileCounter, &tileWindow);
+  if (param.dynamicTiles && threadSupport < MPI_THREAD_SERIALIZED) {
+    if (mpiRank == 0) {
+      printf("Warning: MPI has no thread support, using static tiles\n");
+    }
+    param.SetDynamicTilesFlag(false);
+  }
+  if (mpiSize > 1) { SetSceneFileReader(BroadcastSceneFile); }
+  if (param.dataDistributed && mpiSize > 1) {
+    // rays are forwarded between the stages of the wavefront integrator,
+    // the other modes trace whole paths against the local meshes
+    if (mpiRank == 0) {
+      printf("Splitting the meshes over %zu ranks, rendering one pass with "
+             "the wavefront integrator\n", mpiSize);
+      if (param.usePhotonMap || param.UseAccumulation() || param.denoise ||
+          param.checkpointInterval > 0.f || param.resume ||
+          param.dynamicTiles || param.sampleSplit || param.nodeShared) {
+        printf("Warning: photon maps, progressive, adaptive and timed "
+               "modes, denoising, checkpoints, dynamic tiles, sample "
+               "splitting and node sharing are off with -data-distributed\n");
+      }
+    }
+    param.SetIntegrator(INTEGRATOR_WAVEFRONT);
+    param.SetPhotonMappingFlag(false);
+    param.SetProgressiveSPP(0);
+    param.SetAdaptiveSPP(0);
+    param.SetTimeBudget(0.f);
+    param.SetDenoiseFlag(false);
+    param.SetDenoisePassesFlag(false);
+    param.SetCheckpointInterval(0.f);
+    param.SetResumeFlag(false);
+    param.SetDynamicTilesFlag(false);
+    param.SetSampleSplitFlag(false);
+    param.SetNodeSharedFlag(false);
+    meshPartition.reset(new MeshPartition_MPI);
+    SetMeshPartition(meshPartition.get());
+    rayForwarding.reset(new RayForwarding_MPI);
+    forwarding = rayForwarding.get();
+  }
+  if (param.nodeShared && mpiSize > 1) {
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, tmp_mpi_rank,
+                        MPI_INFO_NULL, &nodeComm);
+    int nodeRank = 0, nodeSize = 0, numHosts = 0;
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_size(nodeComm, &nodeSize);
+    MPI_Comm_split(MPI_COMM_WORLD, nodeRank == 0 ? 0 : MPI_UNDEFINED,
+                   tmp_mpi_rank, &loaderComm);
+    if (loaderComm != MPI_COMM_NULL) { MPI_Comm_size(loaderComm, &numHosts); }
+    nodeSharing.reset(new NodeSharing_MPI(nodeComm, loaderComm));
+    SetNodeSharing(nodeSharing.get());
+    if (mpiRank == 0) {
+      printf("Sharing the scene on %d hosts, %d ranks on the first one\n",
+             numHosts, nodeSize);
+    }
+  }
 #endif
   if (mpiRank != 0) { LoadSceneInSilentMode(true); }
 }
 void Renderer_MPI::Terminate()
 {
 #ifdef USE_MPI
+  SetSceneFileReader(nullptr);
+  SetMeshPartition(nullptr);
+  meshPartition.reset();
+  forwarding = nullptr;
+  rayForwarding.reset();
+  SetNodeSharing(nullptr);
+  nodeSharing.reset();
+  if (loaderComm != MPI_COMM_NULL) { MPI_Comm_free(&loaderComm); }
+  if (nodeComm != MPI_COMM_NULL) { MPI_Comm_free(&nodeComm); }
+  MPI_Win_free(&tileWindow);
   MPI_Finalize(); // Finalize the MPI environment.
 #endif
 }
@@ -72,6 +431,7 @@ void Renderer_MPI::StartTimer()
   }
   else {
     t1 = MPI_Wtime();
+    c1 = std::clock();
   }
 #else
   Renderer::StartTimer();
@@ -83,6 +443,8 @@ void Renderer_MPI::StartTimer()
 void Renderer_MPI::StopTimer()
 {
 #ifdef USE_MPI
+  const double busyEnd = MPI_Wtime();
+  const double work = static_cast<double>(std::clock() - c1) / CLOCKS_PER_SEC;
   MPI_Barrier(MPI_COMM_WORLD);
   if (mpiSize == 1)
   {
@@ -90,8 +452,19 @@ void Renderer_MPI::StopTimer()
   }
   else
   {
+    // time this rank worked before waiting for the others
+    const double busy = busyEnd - t1;
     t2 = MPI_Wtime();
-    if (mpiRank == 0) printf("\nElapsed MPI Time is %f\n", t2 - t1);
+    const double local[2] = {busy, work};
+    double maxTime[2] = {0., 0.}, sumTime[2] = {0., 0.};
+    MPI_Reduce(local, maxTime, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local, sumTime, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (mpiRank == 0) {
+      printf("\nElapsed MPI Time is %f\n", t2 - t1);
+      printf("Rank imbalance (max / mean): busy time %.3f, cpu time %.3f\n",
+             maxTime[0] / MAX(sumTime[0] / mpiSize, 1e-9),
+             maxTime[1] / MAX(sumTime[1] / mpiSize, 1e-9));
+    }
   }
 #else
   Renderer::StartTimer();
@@ -100,26 +473,6 @@ void Renderer_MPI::StopTimer()
 //---------------------------------------------------------------------------//
 //
 //---------------------------------------------------------------------------//
-template<typename T>
-void PlaceImage(const int srcext[4], size_t dstW, size_t dstH,
-                const qaUCHAR *mask, const T *src, T *dst)
-{
-  const size_t xstart = CLAMP(srcext[0], 0, dstW);
-  const size_t ystart = CLAMP(srcext[1], 0, dstH);
-  const size_t xend = CLAMP(srcext[2], 0, dstW);
-  const size_t yend = CLAMP(srcext[3], 0, dstH);
-  const size_t srcW = srcext[2] - srcext[0];
-  const size_t srcH = srcext[3] - srcext[1];
-# pragma omp parallel for collapse(2)
-  for (size_t j = ystart; j < yend; ++j) {
-    for (size_t i = xstart; i < xend; ++i) {
-      const size_t srcidx = (j - ystart) * srcW + i - xstart;
-      const size_t dstidx = j * dstW + i;
-      if (mask[srcidx] != 0)
-        dst[dstidx] = src[srcidx];
-    }
-  }
-}
 void Renderer_MPI::Render() {
   //-------------------------------------------------------------------------//
   // Render
@@ -127,91 +480,373 @@ void Renderer_MPI::Render() {
   // first we render locally
   image->ResetNumRenderedPixels();
   tasking::signal_start();
+  if (param.UseAccumulation() || param.checkpointInterval > 0.f) {
+    std::signal(SIGINT, StopOnInterrupt);
+  }
+  if (param.checkpointInterval > 0.f) { std::signal(SIGTERM, StopOnInterrupt); }
   ThreadRender();
   tasking::signal_stop();
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  SaveImages();
+}
+void Renderer_MPI::RenderEdits(const std::vector<const ItemBase *> &edited)
+{
+  // the dependencies of the tiles are not recorded when the rays are
+  // forwarded, the edited scene is rendered again
+  if (forwarding != nullptr) {
+    Render();
+    return;
+  }
+  tasking::signal_start();
+  Renderer::RenderEdits(edited);
+  tasking::signal_stop();
+  SaveImages();
+}
+bool Renderer_MPI::Interrupted() const { return interrupted != 0; }
+//---------------------------------------------------------------------------//
+// Shared tile counter, incremented with an atomic fetch-and-add on rank 0
+//---------------------------------------------------------------------------//
+size_t Renderer_MPI::ClaimTiles(size_t n)
+{
+#ifdef USE_MPI
+  if (mpiSize > 1) {
+    const long long add = static_cast<long long>(n);
+    long long first = 0;
+    MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, tileWindow);
+    MPI_Fetch_and_op(&add, &first, MPI_LONG_LONG, 0, 0, MPI_SUM, tileWindow);
+    MPI_Win_unlock(0, tileWindow);
+    return static_cast<size_t>(first);
+  }
+#endif
+  return Renderer::ClaimTiles(n);
+}
+void Renderer_MPI::ResetTileClaims()
+{
+#ifdef USE_MPI
+  if (mpiRank == 0) {
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, tileWindow);
+    *tileCounter = 0;
+    MPI_Win_unlock(0, tileWindow);
+  }
+#endif
+  Renderer::ResetTileClaims();
+}
+//---------------------------------------------------------------------------//
+// Every rank traces a share of the photons, all ranks get the whole map
+//---------------------------------------------------------------------------//
+void Renderer_MPI::GatherPhotons(cyPhotonMap &map, size_t &numEmitted)
+{
+#ifdef USE_MPI
+  if (mpiSize == 1) { return; }
+  unsigned long long emitted = numEmitted;
+  MPI_Allreduce(MPI_IN_PLACE, &emitted, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+  numEmitted = static_cast<size_t>(emitted);
+  const size_t numLocal = map.NumPhotons();
+  std::vector<cyPhotonMap::Photon> local(numLocal);
+  if (numLocal > 0) {
+    std::copy(map.GetPhotons(), map.GetPhotons() + numLocal, local.begin());
+  }
+  // gathers the photons of all ranks of 'comm' on 'root', or on all ranks
+  // when 'root' is negative
+  auto Gather = [&](MPI_Comm comm, int root, cyPhotonMap &dst) {
+    int commSize = 0, commRank = 0;
+    MPI_Comm_size(comm, &commSize);
+    MPI_Comm_rank(comm, &commRank);
+    const int bytes =
+        static_cast<int>(local.size() * sizeof(cyPhotonMap::Photon));
+    std::vector<int> counts(commSize), offsets(commSize, 0);
+    MPI_Allgather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < commSize; ++r) {
+      offsets[r] = offsets[r - 1] + counts[r - 1];
+    }
+    const size_t numPhotons = static_cast<size_t>(offsets.back() +
+        counts.back()) / sizeof(cyPhotonMap::Photon);
+    const bool receives = root < 0 || root == commRank;
+    dst.CreateAllPhotons(receives ? static_cast<qaUINT>(numPhotons) : 0);
+    if (numPhotons == 0) { return; }
+    if (root < 0) {
+      MPI_Allgatherv(local.data(), bytes, MPI_BYTE, dst.GetPhotons(),
+                     counts.data(), offsets.data(), MPI_BYTE, comm);
+    } else {
+      MPI_Gatherv(local.data(), bytes, MPI_BYTE,
+                  receives ? dst.GetPhotons() : nullptr,
+                  counts.data(), offsets.data(), MPI_BYTE, root, comm);
+    }
+  };
+  if (nodeSharing) {
+    // only the loaders build the map: the photons of every host go to its
+    // loader first, then the loaders exchange them
+    Gather(nodeComm, 0, map);
+    if (loaderComm == MPI_COMM_NULL) { return; }
+    local.assign(map.GetPhotons(), map.GetPhotons() + map.NumPhotons());
+    Gather(loaderComm, -1, map);
+  } else {
+    Gather(MPI_COMM_WORLD, -1, map);
+  }
+#endif
+}
+void Renderer_MPI::SaveImages()
+{
+  const std::string suffix = FrameSuffix() + ".png";
   //-------------------------------------------------------------------------//
   // debug
   image->ComputeZBufferImage();
   image->ComputeSampleCountImage();
-  image->SaveZImage((mpiPrefix+"depthBuffer.png").c_str());
-  image->SaveImage ((mpiPrefix+"colorBuffer.png").c_str());
-  image->SaveSampleCountImage((mpiPrefix+"sampleBuffer.png").c_str());
+  image->SaveZImage((mpiPrefix + "depthBuffer" + suffix).c_str());
+  image->SaveImage ((mpiPrefix + "colorBuffer" + suffix).c_str());
+  image->SaveSampleCountImage((mpiPrefix + "sampleBuffer" + suffix).c_str());
+  // every rank writes its own samples, merging the files of the ranks
+  // gives the whole image
+  if (param.saveAccumulation) {
+    SaveAccumulation(mpiPrefix + "accumulation" + FrameSuffix() + ".acc");
+  }
   //-------------------------------------------------------------------------//
   // now we gather images
   //-------------------------------------------------------------------------//
 #ifdef USE_MPI
-  //-- gather data in rank 0
-  MPI_Barrier(MPI_COMM_WORLD);
-  int master = 0;
-  int tag[5] = {100, 200, 300, 400, 500};
+  const int master = 0, tag = 100;
+  // with sample splitting every rank holds a part of the samples of all
+  // the pixels, they are added up instead of composited
+  if (UseSampleSplit()) {
+    ReduceAccumulation();
+    if (mpiRank != master) { return; }
+    const size_t n = pixelSize[0] * pixelSize[1];
+    qaUINT sppMax = 1;
+    for (size_t i = 0; i < n; ++i) {
+      sppMax = MAX(sppMax, accumCountBuffer[i]);
+    }
+    image->ResolveAccumulation(param.useSRGB, sppMax);
+    if (param.denoise) {
+      const double tDenoise = MPI_Wtime();
+      image->DenoiseAccumulation(param.useSRGB);
+      printf("\nDenoised the reduced image in %f s\n",
+             MPI_Wtime() - tDenoise);
+    }
+    image->ComputeZBufferImage();
+    image->ComputeSampleCountImage();
+    image->SaveImage(("colorBuffer_MPI" + suffix).c_str());
+    image->SaveZImage(("depthBuffer_MPI" + suffix).c_str());
+    image->SaveSampleCountImage(("sampleBuffer_MPI" + suffix).c_str());
+    return;
+  }
+  // only the tiles a rank rendered are sent, packed in one message; rank 0
+  // composites every message as soon as it arrives
+  const double t0 = MPI_Wtime();
+  // the denoiser needs the whole image, it runs on the gathered buffers
+  const bool gatherDenoise = param.denoise && mpiSize > 1;
+  const std::vector<Channel> localChannels =
+      CompositeChannels(*image, gatherDenoise);
+  std::vector<char> message;
+  if (mpiRank != master) { PackTiles(localChannels, message); }
+  unsigned long long messageSize = message.size();
+  std::vector<unsigned long long> sizes(mpiSize, 0);
+  MPI_Gather(&messageSize, 1, MPI_UNSIGNED_LONG_LONG, sizes.data(), 1,
+             MPI_UNSIGNED_LONG_LONG, master, MPI_COMM_WORLD);
+  // messages are sent in chunks, MPI counts are ints; the chunks of a rank
+  // arrive in order as they share the tag
+  const size_t chunk = size_t(1) << 28;
   if (mpiRank == master) { // receive data
-    FrameBuffer finalImage;
-    finalImage.Init(static_cast<int>(pixelW), static_cast<int>(pixelH));
-    for (int target = 0; target < mpiSize; ++target) {
-      if (target == master) {
-        int imgext[4] = {(int) pixelRegion[0], (int) pixelRegion[1],
-                         (int) pixelRegion[2], (int) pixelRegion[3]};
-        PlaceImage<Color3c>(imgext, pixelW, pixelH, maskBuffer,
-                            colorBuffer,
-                            finalImage.GetPixels());
-        PlaceImage<float  >(imgext, pixelW, pixelH, maskBuffer,
-                            depthBuffer,
-                            finalImage.GetZBuffer());
-        PlaceImage<qaUCHAR>(imgext, pixelW, pixelH, maskBuffer,
-                            sampleCountBuffer,
-                            finalImage.GetSampleCount());
-      } else {
-        int imgext[4];
-        MPI_Recv(&imgext, 4, MPI_INT, target, tag[0],
-                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        int buffsize = (imgext[2] - imgext[0]) * (imgext[3] - imgext[1]);
-        auto cbuff = new Color3c[buffsize];
-        auto zbuff = new float[buffsize];
-        auto sbuff = new qaUCHAR[buffsize];
-        auto mbuff = new qaUCHAR[buffsize];
-        MPI_Recv(cbuff, buffsize * sizeof(Color3c), MPI_BYTE,
-                 target, tag[1], MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(zbuff, buffsize, MPI_FLOAT, target,
-                 tag[2], MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(sbuff, buffsize * sizeof(qaUCHAR), MPI_BYTE, target,
-                 tag[3], MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(mbuff, buffsize * sizeof(qaUCHAR), MPI_BYTE, target,
-                 tag[4], MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        PlaceImage<Color3c>(imgext, pixelW, pixelH, mbuff, cbuff,
-                            finalImage.GetPixels());
-        PlaceImage<float>(imgext, pixelW, pixelH, mbuff, zbuff,
-                          finalImage.GetZBuffer());
-        PlaceImage<qaUCHAR>(imgext, pixelW, pixelH, mbuff, sbuff,
-                            finalImage.GetSampleCount());
+    std::vector<std::vector<char>> inbox(mpiSize);
+    std::vector<size_t> pending(mpiSize, 0); // chunks not received yet
+    std::vector<MPI_Request> requests;
+    std::vector<size_t> sources; // of every request
+    size_t numMessages = 0;
+    for (size_t r = 0; r < mpiSize; ++r) {
+      if (r == master || sizes[r] == 0) { continue; }
+      inbox[r].resize(sizes[r]);
+      ++numMessages;
+      for (size_t offset = 0; offset < inbox[r].size(); offset += chunk) {
+        const size_t n = MIN(chunk, inbox[r].size() - offset);
+        requests.emplace_back();
+        sources.push_back(r);
+        ++pending[r];
+        MPI_Irecv(inbox[r].data() + offset, static_cast<int>(n), MPI_BYTE,
+                  static_cast<int>(r), tag, MPI_COMM_WORLD,
+                  &requests.back());
       }
     }
-    finalImage.IncrementNumRenderPixel(static_cast<int>(pixelW * pixelH));
+    // the final image covers the crop window, or the full image
+    const size_t finalW = pixelSize[0], finalH = pixelSize[1];
+    FrameBuffer finalImage;
+    finalImage.Init(static_cast<int>(finalW), static_cast<int>(finalH));
+    if (gatherDenoise) {
+      finalImage.AllocateAccumulationBuffer();
+      finalImage.AllocateFeatureBuffers();
+    }
+    const std::vector<Channel> finalChannels =
+        CompositeChannels(finalImage, gatherDenoise);
+    // our own tiles are placed while the messages are in flight
+    CopyTiles(localChannels, finalChannels);
+    size_t numBytes = 0;
+    for (size_t n = 0; n < requests.size(); ++n) {
+      int k = MPI_UNDEFINED;
+      MPI_Waitany(static_cast<int>(requests.size()), requests.data(), &k,
+                  MPI_STATUS_IGNORE);
+      if (k == MPI_UNDEFINED) { break; }
+      if (--pending[sources[k]] > 0) { continue; }
+      std::vector<char> &received = inbox[sources[k]];
+      UnpackTiles(received, finalChannels);
+      numBytes += received.size();
+      std::vector<char>().swap(received);
+    }
+    printf("\nComposited %zu messages, %.2f MB in %f s\n", numMessages,
+           numBytes / 1048576.0, MPI_Wtime() - t0);
+    finalImage.IncrementNumRenderPixel(static_cast<int>(finalW * finalH));
+    if (gatherDenoise) {
+      const double tDenoise = MPI_Wtime();
+      finalImage.DenoiseAccumulation(param.useSRGB);
+      printf("\nDenoised the gathered image in %f s\n",
+             MPI_Wtime() - tDenoise);
+    }
     finalImage.ComputeZBufferImage();
     finalImage.ComputeSampleCountImage();
-    finalImage.SaveImage("colorBuffer_MPI.png");
-    finalImage.SaveZImage("depthBuffer_MPI.png");
-    finalImage.SaveSampleCountImage("sampleBuffer_MPI.png");
+    finalImage.SaveImage(("colorBuffer_MPI" + suffix).c_str());
+    finalImage.SaveZImage(("depthBuffer_MPI" + suffix).c_str());
+    finalImage.SaveSampleCountImage(("sampleBuffer_MPI" + suffix).c_str());
   } else {
-    int imgext[4] = {(int) pixelRegion[0], (int) pixelRegion[1],
-                     (int) pixelRegion[2], (int) pixelRegion[3]};
-    MPI_Send(&imgext, 4, MPI_INT, master, tag[0], MPI_COMM_WORLD);
-    int buffsize = (imgext[2] - imgext[0]) * (imgext[3] - imgext[1]);
-    MPI_Send(colorBuffer, buffsize * sizeof(Color3c), MPI_BYTE,
-             master, tag[1], MPI_COMM_WORLD);
-    MPI_Send(depthBuffer, buffsize, MPI_FLOAT,
-             master, tag[2], MPI_COMM_WORLD);
-    MPI_Send(sampleCountBuffer, buffsize * sizeof(qaUCHAR), MPI_BYTE,
-             master, tag[3], MPI_COMM_WORLD);
-    MPI_Send(maskBuffer, buffsize * sizeof(qaUCHAR), MPI_BYTE,
-             master, tag[4], MPI_COMM_WORLD);
+    for (size_t offset = 0; offset < message.size(); offset += chunk) {
+      const size_t n = MIN(chunk, message.size() - offset);
+      MPI_Send(message.data() + offset, static_cast<int>(n), MPI_BYTE,
+               master, tag, MPI_COMM_WORLD);
+    }
   }
 #else
-  renderImage->ComputeZBufferImage();
-  renderImage->ComputeSampleCountImage();
-  renderImage->SaveImage ("colorBuffer_LOCAL.png");
-  renderImage->SaveZImage("depthBuffer_LOCAL.png");
-  renderImage->SaveSampleCountImage("sampleBuffer_LOCAL.png");
+  image->SaveImage (("colorBuffer_LOCAL" + suffix).c_str());
+  image->SaveZImage(("depthBuffer_LOCAL" + suffix).c_str());
+  image->SaveSampleCountImage(("sampleBuffer_LOCAL" + suffix).c_str());
+#endif
+}
+//---------------------------------------------------------------------------//
+// Sparse compositing
+//---------------------------------------------------------------------------//
+std::vector<Renderer_MPI::Channel>
+Renderer_MPI::CompositeChannels(FrameBuffer &fb, bool features) const
+{
+  auto channel = [](void *data, size_t bytes) {
+    return Channel{static_cast<char *>(data), bytes};
+  };
+  std::vector<Channel> channels = {
+      channel(fb.GetPixels(), sizeof(Color3c)),
+      channel(fb.GetZBuffer(), sizeof(qaFLOAT)),
+      channel(fb.GetSampleCount(), sizeof(qaUCHAR))};
+  if (features) {
+    channels.push_back(channel(fb.GetAccumulation(), sizeof(Color3f)));
+    channels.push_back(channel(fb.GetAccumulationCount(), sizeof(qaUINT)));
+    channels.push_back(channel(fb.GetAccumulationM2(), sizeof(qaFLOAT)));
+    channels.push_back(channel(fb.GetNormals(), sizeof(Point3)));
+    channels.push_back(channel(fb.GetAlbedo(), sizeof(Color3f)));
+  }
+  return channels;
+}
+void Renderer_MPI::PackTiles(const std::vector<Channel> &src,
+                             std::vector<char> &message) const
+{
+  size_t bytesPerPixel = 0;
+  for (auto &c : src) { bytesPerPixel += c.bytes; }
+  size_t size = 0;
+  for (auto k : localTiles) {
+    size_t region[4];
+    TileRegion(k, region);
+    size += sizeof(uint64_t) +
+        (region[2] - region[0]) * (region[3] - region[1]) * bytesPerPixel;
+  }
+  message.resize(size);
+  char *out = message.data();
+  for (auto k : localTiles) {
+    size_t region[4];
+    TileRegion(k, region);
+    const auto tile = static_cast<uint64_t>(k);
+    memcpy(out, &tile, sizeof(tile));
+    out += sizeof(tile);
+    const size_t w = region[2] - region[0];
+    for (auto &c : src) {
+      for (size_t j = region[1]; j < region[3]; ++j) {
+        const size_t idx =
+            (j - pixelRegion[1]) * pixelSize[0] + region[0] - pixelRegion[0];
+        memcpy(out, c.data + idx * c.bytes, w * c.bytes);
+        out += w * c.bytes;
+      }
+    }
+  }
+}
+void Renderer_MPI::UnpackTiles(const std::vector<char> &message,
+                               const std::vector<Channel> &dst) const
+{
+  const char *in = message.data();
+  const char *end = in + message.size();
+  while (in + sizeof(uint64_t) <= end) {
+    uint64_t tile;
+    memcpy(&tile, in, sizeof(tile));
+    in += sizeof(tile);
+    size_t region[4];
+    TileRegion(static_cast<size_t>(tile), region);
+    const size_t w = region[2] - region[0];
+    for (auto &c : dst) {
+      for (size_t j = region[1]; j < region[3]; ++j) {
+        const size_t idx =
+            (j - pixelRegion[1]) * pixelSize[0] + region[0] - pixelRegion[0];
+        memcpy(c.data + idx * c.bytes, in, w * c.bytes);
+        in += w * c.bytes;
+      }
+    }
+  }
+}
+void Renderer_MPI::CopyTiles(const std::vector<Channel> &src,
+                             const std::vector<Channel> &dst) const
+{
+  for (auto k : localTiles) {
+    size_t region[4];
+    TileRegion(k, region);
+    const size_t w = region[2] - region[0];
+    for (size_t c = 0; c < src.size(); ++c) {
+      const size_t bytes = src[c].bytes;
+      for (size_t j = region[1]; j < region[3]; ++j) {
+        const size_t offset = ((j - pixelRegion[1]) * pixelSize[0] +
+            region[0] - pixelRegion[0]) * bytes;
+        memcpy(dst[c].data + offset, src[c].data + offset, w * bytes);
+      }
+    }
+  }
+}
+//---------------------------------------------------------------------------//
+// Sample splitting
+//---------------------------------------------------------------------------//
+void Renderer_MPI::ReduceAccumulation()
+{
+#ifdef USE_MPI
+  // the buffers are reduced in chunks, all of them in flight at once, so
+  // that the transfer of a chunk overlaps the sums of the previous ones
+  const double t0 = MPI_Wtime();
+  const size_t chunk = size_t(1) << 18; // values
+  const size_t n = pixelSize[0] * pixelSize[1];
+  std::vector<MPI_Request> requests;
+  auto Reduce = [&](void *data, size_t count, size_t bytes,
+                    MPI_Datatype type) {
+    for (size_t offset = 0; offset < count; offset += chunk) {
+      const int c = static_cast<int>(MIN(chunk, count - offset));
+      char *values = static_cast<char *>(data) + offset * bytes;
+      requests.emplace_back();
+      if (mpiRank == 0) {
+        MPI_Ireduce(MPI_IN_PLACE, values, c, type, MPI_SUM, 0,
+                    MPI_COMM_WORLD, &requests.back());
+      } else {
+        MPI_Ireduce(values, nullptr, c, type, MPI_SUM, 0, MPI_COMM_WORLD,
+                    &requests.back());
+      }
+    }
+  };
+  Reduce(accumBuffer, 3 * n, sizeof(float), MPI_FLOAT);
+  Reduce(accumCountBuffer, n, sizeof(qaUINT), MPI_UNSIGNED);
+  Reduce(accumM2Buffer, n, sizeof(qaFLOAT), MPI_FLOAT);
+  MPI_Waitall(static_cast<int>(requests.size()), requests.data(),
+              MPI_STATUSES_IGNORE);
+  if (mpiRank == 0) {
+    printf("\nReduced the samples of %zu ranks, %.2f MB per rank in %f s\n",
+           mpiSize, n * (sizeof(Color3f) + sizeof(qaUINT) + sizeof(qaFLOAT)) /
+               1048576.0, MPI_Wtime() - t0);
+  }
 #endif
 }
 }
-
@@ -33,13 +33,30 @@
 #ifdef USE_MPI
 # include <mpi.h>
 #endif
+#include <ctime>
+#include <memory>
 #include "renderers/renderer.h"
+#include "core/sharing.h"
+#include "core/partition.h"
 
 namespace qaray {
 class Renderer_MPI : public Renderer {
  private:
-  double t1, t2;
+  double t1 = 0., t2 = 0.;
+  std::clock_t c1 = 0; // processor time, counts the work of the rank only
   std::string mpiPrefix;
+#ifdef USE_MPI
+  //! shared tile counter, it lives on rank 0
+  MPI_Win tileWindow = MPI_WIN_NULL;
+  long long *tileCounter = nullptr;
+  //! the ranks of this host and the loaders of all hosts, with -node-shared
+  MPI_Comm nodeComm = MPI_COMM_NULL;
+  MPI_Comm loaderComm = MPI_COMM_NULL;
+#endif
+  std::unique_ptr<NodeSharing> nodeSharing;
+  //! with -data-distributed
+  std::unique_ptr<MeshPartition> meshPartition;
+  std::unique_ptr<RayForwarding> rayForwarding;
  public:
   explicit Renderer_MPI(RendererParam &param);
   void Init() override;
@@ -47,6 +64,32 @@ class Renderer_MPI : public Renderer {
   void StartTimer() override;
   void StopTimer() override;
   void Render() override;
+  void RenderEdits(const std::vector<const ItemBase *> &edited) override;
+  bool Interrupted() const override;
+  size_t ClaimTiles(size_t n) override;
+  void ResetTileClaims() override;
+  void GatherPhotons(cyPhotonMap &map, size_t &numEmitted) override;
+ private:
+  //! A per-pixel buffer taking part in the compositing
+  struct Channel {
+    char *data;   // whole image, pixelSize[0] x pixelSize[1]
+    size_t bytes; // per pixel
+  };
+  void SaveImages();
+  //! Add up the accumulation buffers of all ranks on rank 0
+  void ReduceAccumulation();
+  //! The buffers of 'fb' that are composited, in packing order
+  std::vector<Channel> CompositeChannels(FrameBuffer &fb,
+                                         bool features) const;
+  //! Pack every local tile into 'message', the tile index followed by
+  //! the rows of each channel
+  void PackTiles(const std::vector<Channel> &src,
+                 std::vector<char> &message) const;
+  void UnpackTiles(const std::vector<char> &message,
+                   const std::vector<Channel> &dst) const;
+  //! Copy the local tiles between two images of the same size
+  void CopyTiles(const std::vector<Channel> &src,
+                 const std::vector<Channel> &dst) const;
 };
 }
 
@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+///
+/// \file       checkpoint.cpp
+/// \author     Qi WU
+///
+/// \brief Binary checkpoint files
+///
+//------------------------------------------------------------------------------
+
+#include "checkpoint.h"
+#ifndef _WIN32
+# include <unistd.h>
+#endif
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+CheckpointWriter::CheckpointWriter(const std::string &path)
+    : path(path), tmpPath(path + ".tmp")
+{
+  fp = fopen(tmpPath.c_str(), "wb");
+  good = fp != nullptr;
+}
+CheckpointWriter::~CheckpointWriter()
+{
+  // an uncommitted file is incomplete
+  if (fp != nullptr) {
+    fclose(fp);
+    remove(tmpPath.c_str());
+  }
+}
+void CheckpointWriter::Write(const void *data, size_t bytes)
+{
+  if (good && bytes > 0) { good = fwrite(data, 1, bytes, fp) == bytes; }
+}
+bool CheckpointWriter::Commit()
+{
+  if (fp == nullptr) { return false; }
+  good = good && fflush(fp) == 0;
+#ifndef _WIN32
+  good = good && fsync(fileno(fp)) == 0;
+#endif
+  good = fclose(fp) == 0 && good;
+  fp = nullptr;
+  if (good) {
+#ifdef _WIN32
+    remove(path.c_str()); // rename does not replace files on windows
+#endif
+    good = rename(tmpPath.c_str(), path.c_str()) == 0;
+  }
+  if (!good) { remove(tmpPath.c_str()); }
+  return good;
+}
+///--------------------------------------------------------------------------//
+CheckpointReader::CheckpointReader(const std::string &path)
+{
+  fp = fopen(path.c_str(), "rb");
+  good = fp != nullptr;
+}
+CheckpointReader::~CheckpointReader()
+{
+  if (fp != nullptr) { fclose(fp); }
+}
+void CheckpointReader::Read(void *data, size_t bytes)
+{
+  if (good && bytes > 0) { good = fread(data, 1, bytes, fp) == bytes; }
+}
+}
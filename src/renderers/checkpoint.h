@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+///
+/// \file       checkpoint.h
+/// \author     Qi WU
+///
+/// \brief Binary checkpoint files. A checkpoint is written to a temporary
+///        file next to its destination and renamed over it once complete,
+///        so an interrupted write never replaces the previous checkpoint.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_CHECKPOINT_H
+#define QARAY_CHECKPOINT_H
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Fixed part of a checkpoint, the buffers follow it
+struct CheckpointHeader {
+  char magic[4] = {'Q', 'A', 'C', 'K'};
+  qaUINT version = 3;
+  qaUINT mode = 0;          // rendering mode that wrote the checkpoint
+  qaUINT mpiSize = 1, mpiRank = 0;
+  qaUINT width = 0, height = 0;
+  qaUINT region[4] = {0};
+  qaUINT tileSize = 0, tileCount = 0;
+  qaUINT seed = 0;          // of the random streams, see Sampler_Counter
+  uint64_t passes = 0;      // passes or rounds done
+  uint64_t samples = 0;     // samples per pixel or samples spent
+  qaUINT numPhotons = 0;    // photon maps, 0 when they are not saved
+  qaUINT numCaustics = 0;
+  qaUINT accumulation = 0;  // the accumulation buffers follow the image
+};
+///--------------------------------------------------------------------------//
+class CheckpointWriter {
+ private:
+  std::string path, tmpPath;
+  FILE *fp = nullptr;
+  bool good = false;
+ public:
+  explicit CheckpointWriter(const std::string &path);
+  ~CheckpointWriter();
+  void Write(const void *data, size_t bytes);
+  template<typename T> void Write(const T *data, size_t n)
+  {
+    Write(static_cast<const void *>(data), n * sizeof(T));
+  }
+  //! flush the data to disk and move the file in place
+  bool Commit();
+};
+class CheckpointReader {
+ private:
+  FILE *fp = nullptr;
+  bool good = false;
+ public:
+  explicit CheckpointReader(const std::string &path);
+  ~CheckpointReader();
+  void Read(void *data, size_t bytes);
+  template<typename T> void Read(T *data, size_t n)
+  {
+    Read(static_cast<void *>(data), n * sizeof(T));
+  }
+  bool Good() const { return good; }
+};
+}
+
+#endif //QARAY_CHECKPOINT_H
@@ -0,0 +1,165 @@
+//------------------------------------------------------------------------------
+///
+/// \file       forwarding.cpp
+/// \author     Qi WU
+///
+/// \brief Data-distributed (sort-last) rendering
+///
+//------------------------------------------------------------------------------
+
+#include "forwarding.h"
+#include "objects/objects.h"
+#include "tasking/parallel_range.h"
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+static const size_t grainSize = 256;
+//! Bounds of the meshes held by 'node' and its children, in the
+//! coordinates of the parent of 'node'. Only meshes are split between the
+//! processes, the other objects are traced by every process.
+static void CollectMeshBounds(const Node &node, std::vector<Box> &boxes)
+{
+  const size_t first = boxes.size();
+  const auto *mesh = dynamic_cast<const TriObj *>(node.GetNodeObj());
+  if (mesh != nullptr && mesh->NF() > 0) {
+    boxes.push_back(mesh->GetBoundBox());
+  }
+  for (int c = 0; c < node.GetNumChild(); ++c) {
+    CollectMeshBounds(*node.GetChild(c), boxes);
+  }
+  for (size_t b = first; b < boxes.size(); ++b) {
+    Box box;
+    for (int j = 0; j < 8; ++j) { box += node.TransformFrom(boxes[b].Corner(j)); }
+    boxes[b] = box;
+  }
+}
+static void CollectNodes(const Node &node, std::vector<const Node *> &nodes)
+{
+  nodes.push_back(&node);
+  for (int c = 0; c < node.GetNumChild(); ++c) {
+    CollectNodes(*node.GetChild(c), nodes);
+  }
+}
+//! Unlike Box::IntersectRay, boxes behind the origin are missed
+static bool SegmentHitsBox(const Box &box, const Ray &ray, float tMax)
+{
+  float entry = 0.f, exit = tMax;
+  for (int a = 0; a < 3; ++a) {
+    if (ABS(ray.dir[a]) < 1e-7f) {
+      if (ray.p[a] < box.pmin[a] || ray.p[a] > box.pmax[a]) { return false; }
+      continue;
+    }
+    const float t0 = (box.pmin[a] - ray.p[a]) / ray.dir[a];
+    const float t1 = (box.pmax[a] - ray.p[a]) / ray.dir[a];
+    entry = MAX(entry, MIN(t0, t1));
+    exit = MIN(exit, MAX(t0, t1));
+  }
+  return entry <= exit;
+}
+///--------------------------------------------------------------------------//
+void SceneDomains::Build(Scene &sc)
+{
+  scene = &sc;
+  nodes.clear();
+  nodeIDs.clear();
+  CollectNodes(sc.rootNode, nodes);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    nodeIDs[nodes[i]] = static_cast<qaINT>(i);
+  }
+  local.clear();
+  CollectMeshBounds(sc.rootNode, local);
+}
+void SceneDomains::SetDomains(std::vector<std::vector<Box>> boxes)
+{
+  domains = std::move(boxes);
+  domainBounds.assign(domains.size(), Box());
+  for (size_t p = 0; p < domains.size(); ++p) {
+    for (auto &b : domains[p]) {
+      // padded, so that rounding does not lose the hits of flat meshes
+      const Point3 extent = b.pmax - b.pmin;
+      const Point3 pad(1e-4f * MAX(extent.x, MAX(extent.y, extent.z)) +
+                       1e-6f);
+      b.pmin -= pad;
+      b.pmax += pad;
+      domainBounds[p] += b;
+    }
+  }
+}
+bool SceneDomains::Reaches(size_t process, const Ray &ray, float tMax) const
+{
+  if (domainBounds[process].IsEmpty() ||
+      !SegmentHitsBox(domainBounds[process], ray, tMax)) { return false; }
+  for (auto &b : domains[process]) {
+    if (SegmentHitsBox(b, ray, tMax)) { return true; }
+  }
+  return false;
+}
+///--------------------------------------------------------------------------//
+void SceneDomains::Intersect(const std::vector<ForwardedRay> &rays,
+                             std::vector<ForwardedHit> &hits,
+                             std::vector<qaUCHAR> &found) const
+{
+  hits.resize(rays.size());
+  found.resize(rays.size());
+  const tasking::blocked_range<size_t> range(0, rays.size(), grainSize);
+  tasking::parallel_for(range, [&](const tasking::blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+      DiffRay ray = rays[i].ray;
+      DiffHitInfo hInfo;
+      hInfo.c.z = rays[i].tMax;
+      found[i] = scene->TraceNodeNormal(scene->rootNode, ray, hInfo);
+      if (!found[i]) { continue; }
+      ForwardedHit &hit = hits[i];
+      hit.z = hInfo.c.z;
+      hit.p = hInfo.c.p;
+      hit.N = hInfo.c.N;
+      hit.uvw = hInfo.c.uvw;
+      hit.duvw[0] = hInfo.c.duvw[0];
+      hit.duvw[1] = hInfo.c.duvw[1];
+      hit.x = hInfo.x;
+      hit.y = hInfo.y;
+      hit.mtlID = hInfo.c.mtlID;
+      hit.primID = hInfo.c.primID;
+      hit.node = nodeIDs.at(hInfo.c.node);
+      hit.hasFrontHit = static_cast<qaUCHAR>(hInfo.c.hasFrontHit);
+      hit.hasTexture = static_cast<qaUCHAR>(hInfo.c.hasTexture);
+      hit.index = rays[i].index;
+    }
+  });
+}
+void SceneDomains::Occluded(const std::vector<ForwardedShadow> &shadows,
+                            std::vector<qaUCHAR> &occluded) const
+{
+  occluded.resize(shadows.size());
+  const tasking::blocked_range<size_t> range(0, shadows.size(), grainSize);
+  tasking::parallel_for(range, [&](const tasking::blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+      Ray ray = shadows[i].ray;
+      HitInfo hInfo;
+      hInfo.z = shadows[i].tMax;
+      occluded[i] = scene->TraceNodeShadow(scene->rootNode, ray, hInfo);
+    }
+  });
+}
+void SceneDomains::Merge(const ForwardedHit &hit, DiffHitInfo &hInfo,
+                         qaUCHAR &found) const
+{
+  if (found && !(hit.z < hInfo.c.z)) { return; }
+  // the flags of the path are kept
+  hInfo.c.z = hit.z;
+  hInfo.c.p = hit.p;
+  hInfo.c.N = hit.N;
+  hInfo.c.uvw = hit.uvw;
+  hInfo.c.duvw[0] = hit.duvw[0];
+  hInfo.c.duvw[1] = hit.duvw[1];
+  hInfo.x = hit.x;
+  hInfo.y = hit.y;
+  hInfo.c.mtlID = hit.mtlID;
+  hInfo.c.primID = hit.primID;
+  hInfo.c.node = nodes[hit.node];
+  hInfo.c.hasFrontHit = hit.hasFrontHit != 0;
+  hInfo.c.hasTexture = hit.hasTexture != 0;
+  found = 1;
+}
+///--------------------------------------------------------------------------//
+}
@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+///
+/// \file       forwarding.h
+/// \author     Qi WU
+///
+/// \brief Data-distributed (sort-last) rendering. Every process only keeps
+///        one spatial part of each mesh (see core/partition.h), the nodes,
+///        materials, lights and textures are loaded by all of them. A path
+///        is traced and shaded by the process that started it: its rays are
+///        traced against the local meshes first, then forwarded in batches
+///        to the processes whose meshes they may reach before the closest
+///        hit so far. These send back the closer hits they find, and the
+///        closest of all is shaded.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_FORWARDING_H
+#define QARAY_FORWARDING_H
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+#include "scene/scene.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! The exchanges of a data-distributed render, used by the wavefront
+//! integrator. Every call is collective: all the processes make the same
+//! calls in the same order, also when they have no rays of their own,
+//! because they still have to serve the rays of the others.
+class RayForwarding {
+ public:
+  virtual ~RayForwarding() = default;
+  //! Exchange the bounds of the local meshes, after the scene was loaded
+  //! or moved
+  virtual void Commit(Scene &scene) = 0;
+  //! 'hits' and 'found' hold the hits of the rays with the local meshes,
+  //! closer hits with the meshes of other processes replace them
+  virtual void Intersect(const std::vector<DiffRay> &rays,
+                         std::vector<DiffHitInfo> &hits,
+                         std::vector<qaUCHAR> &found) = 0;
+  //! 'occluded' holds the local results, shadow rays blocked by the meshes
+  //! of other processes are set
+  virtual void Occluded(const std::vector<ShadowRequest> &shadows,
+                        std::vector<qaUCHAR> &occluded) = 0;
+  //! True when 'active' is true on any process
+  virtual bool AnyActive(bool active) = 0;
+};
+///--------------------------------------------------------------------------//
+//! Rays sent to another process, 'index' is the ray of the sender
+struct ForwardedRay {
+  DiffRay ray;
+  float tMax;
+  qaUINT index;
+};
+struct ForwardedShadow {
+  Ray ray;
+  float tMax;
+  qaUINT index;
+};
+//! A hit sent back, in world space. The node is sent as its pre-order
+//! index, which is the same in all processes.
+struct ForwardedHit {
+  float z;
+  Point3 p, N, uvw, duvw[2];
+  HitInfoCore x, y;
+  qaINT mtlID, primID, node;
+  qaUCHAR hasFrontHit, hasTexture;
+  qaUINT index;
+};
+///--------------------------------------------------------------------------//
+//! The part of the exchanges that does not depend on the transport: the
+//! bounds of the meshes of every process and the local traces of the rays
+//! received from the others
+class SceneDomains {
+ private:
+  Scene *scene = nullptr;
+  std::vector<const Node *> nodes; // in pre-order
+  std::unordered_map<const Node *, qaINT> nodeIDs;
+  std::vector<Box> local;           // world bounds of the local meshes
+  std::vector<std::vector<Box>> domains; // of every process
+  std::vector<Box> domainBounds;    // union of the boxes of every process
+ public:
+  //! Number the nodes and collect the bounds of the local meshes, one box
+  //! per mesh instance
+  void Build(Scene &scene);
+  const std::vector<Box> &LocalBoxes() const { return local; }
+  void SetDomains(std::vector<std::vector<Box>> boxes);
+  //! Whether the meshes of 'process' may be hit before 'tMax'
+  bool Reaches(size_t process, const Ray &ray, float tMax) const;
+  //! Trace received rays against the local meshes, 'hits[i]' is valid
+  //! where 'found[i]' is set
+  void Intersect(const std::vector<ForwardedRay> &rays,
+                 std::vector<ForwardedHit> &hits,
+                 std::vector<qaUCHAR> &found) const;
+  void Occluded(const std::vector<ForwardedShadow> &shadows,
+                std::vector<qaUCHAR> &occluded) const;
+  //! Keep 'hit' if it is closer than the current hit of its ray. Hits of
+  //! the same distance keep the one seen first.
+  void Merge(const ForwardedHit &hit, DiffHitInfo &hInfo,
+             qaUCHAR &found) const;
+};
+///--------------------------------------------------------------------------//
+}
+
+#endif //QARAY_FORWARDING_H
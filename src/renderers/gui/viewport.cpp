@@ -348,7 +348,7 @@ void DrawProgressBar(float done)
 void DrawRenderProgressBar()
 {
   int rp = renderImage.GetNumRenderedPixels();
-  int np = renderImage.GetWidth() * renderImage.GetHeight();
+  int np = renderImage.GetNumPixelsToRender();
   if (rp >= np) return;
   float done = (float) rp / (float) np;
   DrawProgressBar(done);
@@ -642,14 +642,14 @@ void TriObj::ViewportDisplay(const Material *mtl) const
     }
     for (int j = 0; j < 3; j++) {
       if (HasTextureVertices(i)) {
-        auto& vt_id = F(i).v[j]->texcoord_index;;
+        auto& vt_id = F(i).v[j].texcoord_index;;
         glTexCoord3fv(&VT(vt_id).x);
       }
       if (HasNormals(i)) {
-        auto& vn_id = F(i).v[j]->normal_index;;
+        auto& vn_id = F(i).v[j].normal_index;;
         glNormal3fv(&VN(vn_id).x);
       }
-      glVertex3fv(&V(F(i).v[j]->vertex_index).x);
+      glVertex3fv(&V(F(i).v[j].vertex_index).x);
     }
   }
   glEnd();
@@ -827,7 +827,7 @@ bool TextureFile::SetViewportTexture() const
       const auto dst_idx = 3 * ((height - y - 1) * width + 0);
       const auto src_idx = y * width + 0;
       std::memcpy(&flip[dst_idx],
-                  &(data[src_idx].r),
+                  &(pixels[src_idx].r),
                   3 * width * sizeof(qaUCHAR));
     }
     glGenTextures(1, &viewportTextureID);
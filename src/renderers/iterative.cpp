@@ -0,0 +1,133 @@
+//------------------------------------------------------------------------------
+///
+/// \file       iterative.cpp
+/// \author     Qi WU
+///
+/// \brief Iterative path tracer
+///
+//------------------------------------------------------------------------------
+
+#include "iterative.h"
+#include "materials/materials.h"
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+/// Pick one of the scattered rays with a probability proportional to the
+/// luminance of its weight, returns the weight of the pick divided by that
+/// probability
+///--------------------------------------------------------------------------//
+static size_t SelectRay(const std::vector<ScatterRay> &rays, Color3f &weight)
+{
+  if (rays.size() == 1) {
+    weight = rays[0].weight;
+    return 0;
+  }
+  float sum = 0.f;
+  for (auto &r : rays) { sum += MAX(ColorLuma(r.weight), 0.f); }
+  float u;
+  rng->local().Get1f(u);
+  size_t k = MIN(static_cast<size_t>(u * rays.size()), rays.size() - 1);
+  float pdf = 1.f / rays.size();
+  if (sum > 0.f) {
+    float select = u * sum;
+    for (k = 0; k + 1 < rays.size(); ++k) {
+      select -= MAX(ColorLuma(rays[k].weight), 0.f);
+      if (select < 0.f) { break; }
+    }
+    pdf = MAX(ColorLuma(rays[k].weight), 0.f) / sum;
+  }
+  weight = pdf > 0.f ? rays[k].weight / pdf : Color3f(0.f);
+  return k;
+}
+///--------------------------------------------------------------------------//
+Color3f IterativeIntegrator::Trace(Scene &scene, const DiffRay &cameraRay,
+                                   const Point3 &uv, float &depth)
+{
+  Color3f color(0.f);
+  depth = BIGFLOAT;
+  paths.clear();
+  // the stream of the sample was started by the camera ray
+  Sampler_Counter &sampler = rng->local();
+  paths.push_back({cameraRay, Color3f(1.f), Color3f(0.f),
+                   Material::maxBounce, 0, false,
+                   Sampler_Counter::NextPath(0, 0)});
+  while (!paths.empty()) {
+    PathState path = paths.back();
+    paths.pop_back();
+    while (true) {
+      //
+      // Intersect
+      //
+      DiffHitInfo hInfo;
+      hInfo.c.hasDiffuseHit = path.diffuseHit;
+      if (!scene.TraceNodeNormal(scene.rootNode, path.ray, hInfo)) {
+        color += path.throughput * (path.depth == 0 ?
+            scene.background.Sample(uv) :
+            scene.environment.SampleEnvironment(path.ray.c.dir));
+        break;
+      }
+      if (path.depth == 0) { depth = hInfo.c.z; }
+      if (!hInfo.c.hasFrontHit) {
+        path.throughput *= Attenuation(path.absorption, hInfo.c.z);
+      }
+      //
+      // Shade, materials that cannot scatter end the path recursively
+      //
+      const Material *mtl = hInfo.c.node->GetMaterial();
+      sampler.SetPath(path.key);
+      rec.Clear();
+      if (!mtl->Scatter(path.ray, hInfo, scene.lights, path.bounce, rec)) {
+        color += path.throughput *
+            mtl->Shade(path.ray, hInfo, scene.lights, path.bounce);
+        break;
+      }
+      color += path.throughput * rec.radiance;
+      for (auto &sr : rec.shadows) {
+        HitInfo shadowHit;
+        shadowHit.z = sr.tMax;
+        if (!scene.TraceNodeShadow(scene.rootNode, sr.ray, shadowHit)) {
+          color += path.throughput * sr.contrib;
+        }
+      }
+      if (rec.rays.empty()) { break; }
+      //
+      // Split at the first bounce only
+      //
+      if (path.depth == 0 && rec.rays.size() > 1) {
+        for (size_t k = 0; k < rec.rays.size(); ++k) {
+          const ScatterRay &r = rec.rays[k];
+          paths.push_back({r.ray, path.throughput * r.weight, r.absorption,
+                           path.bounce - 1, 1, r.diffuseHit,
+                           Sampler_Counter::NextPath(path.key,
+                                                     static_cast<qaUINT>(k))});
+        }
+        break;
+      }
+      Color3f weight;
+      const size_t selected = SelectRay(rec.rays, weight);
+      const ScatterRay &next = rec.rays[selected];
+      path.ray = next.ray;
+      path.throughput *= weight;
+      path.absorption = next.absorption;
+      path.diffuseHit = next.diffuseHit;
+      --path.bounce;
+      ++path.depth;
+      //
+      // Russian roulette
+      //
+      if (path.depth > rouletteDepth) {
+        const float q = MIN(1.f, MAX(path.throughput.r,
+                                     MAX(path.throughput.g,
+                                         path.throughput.b)));
+        float u;
+        sampler.Get1f(u);
+        if (u >= q) { break; }
+        path.throughput /= q;
+      }
+      path.key = Sampler_Counter::NextPath(path.key,
+                                           static_cast<qaUINT>(selected));
+    }
+  }
+  return color;
+}
+}
@@ -0,0 +1,53 @@
+//------------------------------------------------------------------------------
+///
+/// \file       iterative.h
+/// \author     Qi WU
+///
+/// \brief Iterative path tracer. A path is followed in a loop, carrying its
+///        throughput, instead of recursing in Material::Shade. Only the
+///        first bounce may split into several rays (all the rays returned
+///        by Material::Scatter are followed), deeper bounces keep a single
+///        ray. After a minimum depth paths are terminated by Russian
+///        roulette on their throughput.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_ITERATIVE_H
+#define QARAY_ITERATIVE_H
+#pragma once
+
+#include <cstddef>
+#include <vector>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+#include "scene/scene.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+class IterativeIntegrator {
+ private:
+  struct PathState {
+    DiffRay ray;
+    Color3f throughput;
+    Color3f absorption;
+    int bounce; // bounces left
+    int depth;  // bounces done
+    bool diffuseHit;
+    qaUINT key; // random stream of the next vertex, see Sampler_Counter
+  };
+  int rouletteDepth;
+  std::vector<PathState> paths; // split paths waiting to be traced
+  ScatterRecord rec;
+ public:
+  //! Russian roulette starts after 'rouletteDepth' bounces
+  explicit IterativeIntegrator(int rouletteDepth)
+      : rouletteDepth(rouletteDepth) {}
+  //! Radiance of a camera ray, 'uv' is its background coordinate and
+  //! 'depth' receives the distance to the first hit
+  Color3f Trace(Scene &scene, const DiffRay &ray, const Point3 &uv,
+                float &depth);
+};
+}
+
+#endif //QARAY_ITERATIVE_H
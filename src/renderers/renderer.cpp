@@ -26,18 +26,18 @@
 ///--------------------------------------------------------------------------//
 
 #include "renderer.h"
+#include "renderers/checkpoint.h"
+#include "fb/accumfile.h"
+#include "core/sharing.h"
+#include "tasking/work_stealing.h"
+#include "tasking/numa.h"
 #include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 namespace qaray {
 ///--------------------------------------------------------------------------//
-float LinearToSRGB(const float c)
-{
-  const float a = 0.055f;
-  if (c < 0.0031308f) { return 12.92f * c; }
-  else { return (1.f + a) * POW(c, 1.f / 2.4f) - a; }
-}
-///--------------------------------------------------------------------------//
 enum TimeState { START_FRAME, STOP_FRAME, KILL_FRAME };
 void TimeFrame(TimeState state)
 {
@@ -64,7 +64,14 @@ void Renderer::KillTimer() { TimeFrame(KILL_FRAME); }
 ///--------------------------------------------------------------------------//
 /// Constructor
 ///--------------------------------------------------------------------------//
-Renderer::Renderer(RendererParam &param) : param(param)
+Renderer::Renderer(RendererParam &param)
+    : param(param),
+      nextTile(0),
+      wavefront(WavefrontIntegrator()),
+      iterative(IterativeIntegrator(static_cast<int>(param.rouletteDepth))),
+      numRays(0),
+      progressPixels(0),
+      startTime(std::chrono::steady_clock::now())
 {
   tasking::signal_start();
 }
@@ -92,9 +99,24 @@ void Renderer::ComputeScene(FrameBuffer &fb, Scene &sc)
   //! canvas
   pixelW = static_cast<size_t>(scene->camera.imgWidth);
   pixelH = static_cast<size_t>(scene->camera.imgHeight);
+  Sampler_Sobol::SetBlueNoise(param.blueNoise, pixelW);
   pixelRegion[0] = pixelRegion[1] = 0;
   pixelRegion[2] = pixelW;
   pixelRegion[3] = pixelH;
+  if (param.useCrop) {
+    const size_t x0 = MIN(param.crop[0], pixelW);
+    const size_t y0 = MIN(param.crop[1], pixelH);
+    const size_t x1 = MIN(param.crop[2], pixelW);
+    const size_t y1 = MIN(param.crop[3], pixelH);
+    if (x0 < x1 && y0 < y1) {
+      pixelRegion[0] = x0;
+      pixelRegion[1] = y0;
+      pixelRegion[2] = x1;
+      pixelRegion[3] = y1;
+    } else if (mpiRank == 0) {
+      printf("\nWarning: empty crop window, rendering the full image\n");
+    }
+  }
   pixelSize[0] = pixelRegion[2] - pixelRegion[0];
   pixelSize[1] = pixelRegion[3] - pixelRegion[1];
   //! frame
@@ -105,17 +127,45 @@ void Renderer::ComputeScene(FrameBuffer &fb, Scene &sc)
   sampleCountBuffer = image->GetSampleCount();
   irradianceCountBuffer = image->GetIrradianceComputationImage();
   maskBuffer = image->GetMasks();
+  // the denoiser reads the mean and the variance of every pixel from the
+  // accumulation buffers, the other modes fill them as well
+  if (param.KeepAccumulation()) {
+    image->AllocateAccumulationBuffer();
+    accumBuffer = image->GetAccumulation();
+    accumCountBuffer = image->GetAccumulationCount();
+    accumM2Buffer = image->GetAccumulationM2();
+  } else {
+    accumBuffer = nullptr;
+    accumCountBuffer = nullptr;
+    accumM2Buffer = nullptr;
+  }
+  if (param.denoise) { image->AllocateFeatureBuffers(); }
+  if (param.UseAccumulation()) {
+    if (param.timeBudget > 0.f) {
+      // progress is counted in percent of the time budget
+      numPasses = 100;
+    } else if (param.adaptiveSPP > 0) {
+      // progress is counted in samples by the adaptive scheduler
+      numPasses = param.adaptiveSPP;
+    } else {
+      numPasses = (LocalSampleLimit() + param.progressiveSPP - 1) /
+          param.progressiveSPP;
+    }
+    image->SetNumPasses(static_cast<qaINT>(numPasses));
+  }
   //! tiles
-  tileDimX = static_cast<size_t>(CEIL(static_cast<float>(pixelSize[0]) /
-      static_cast<float>(tileSize)));
-  tileDimY = static_cast<size_t>(CEIL(static_cast<float>(pixelSize[1]) /
-      static_cast<float>(tileSize)));
-  tileCount = tileDimX * tileDimY;
-  //-------------------------------------------------------------------------//
-  // Initialize Photon Map
-  //-------------------------------------------------------------------------//
-  // TODO: Photon Map for MPI Mode
+  ComputeTiles();
+  //! continue an interrupted render
+  if (param.resume) { LoadCheckpoint(); }
+  //! photons
   scene->usePhotonMap = param.usePhotonMap;
+  BuildPhotonMaps();
+};
+///--------------------------------------------------------------------------//
+/// Initialize Photon Map
+///--------------------------------------------------------------------------//
+void Renderer::BuildPhotonMaps()
+{
   if (param.photonMapSize > 0 &&
       param.causticsMapSize > 0 &&
       param.usePhotonMap)
@@ -127,169 +177,215 @@ void Renderer::ComputeScene(FrameBuffer &fb, Scene &sc)
     scene->causticsmap.size = param.causticsMapSize;
     scene->causticsmap.radius = param.causticsMapRadius;
     scene->causticsmap.bounce = param.causticsMapBounce;
-    std::chrono::time_point<std::chrono::system_clock> t1, t2;
+    if (photonsRestored) {
+      photonsRestored = false;
+      photonsCurrent = true;
+      return;
+    }
+    if (photonsCurrent) {
+      if (mpiRank == 0) { printf("\nPhoton maps reused\n"); }
+      return;
+    }
     //! find out all point lights
     std::vector<Light *> photonLights;
     for (auto light : scene->lights) {
       if (light->IsPhotonSource()) { photonLights.push_back(light); }
     }
-    const qaFLOAT lightScale = 1.f / static_cast<qaFLOAT>(photonLights.size());
     //-----------------------------------------------------------------------//
     // Photon Map
     //-----------------------------------------------------------------------//
-    {
-      //---------------------------------------------------------------------//
-      t1 = std::chrono::system_clock::now();
-      //---------------------------------------------------------------------//
-      scene->photonmap.map.CreateAllPhotons(param.photonMapSize);
-      //! generate the photon map
-      qaUINT numPhotonsRec(0);
-      qaUINT numOfEmittedRays(0);
-      while (true) {
-        Light *light;
-        //! randomly pick a light
-        if (photonLights.size() == 1) { light = photonLights[0]; }
-        else {
-          qaFLOAT r;
-          rng->local().Get1f(r);
-          size_t id = MIN(FLOOR(r * photonLights.size()), photonLights.size() - 1);
-          light = photonLights[id];
-        }
-        //! generate one photons
-        DiffRay ray = light->RandomPhoton();
-        ray.Normalize();
-        DiffHitInfo hInfo;
-        hInfo.Init();
-        Color3f intensity = light->GetPhotonIntensity(ray.c.dir) * lightScale;
-        qaBOOL finished = false; // whether the map is filled
-        qaBOOL recorded = false; // whether a photon is recorded
-        //! trace photon
-        size_t bounce = 0;
-        while (bounce < param.photonMapBounce) {
-          //! trace the photon
-          if (scene->TraceNodeNormal(scene->rootNode, ray, hInfo)) {
-            const Material *mtl = hInfo.c.node->GetMaterial();
-            //! if it is a diffuse surface
-            if (mtl->IsPhotonSurface(0) && bounce != 0) {
-              //! fetch a photon index
-              size_t idx = numPhotonsRec++;
-              //! check if the map is filled
-              if (idx >= param.photonMapSize) {
-                finished = true;
-                break;
-              }
-              else {
-                scene->photonmap.map[idx].position = hInfo.c.p;
-                scene->photonmap.map[idx].SetDirection(ray.c.dir);
-                scene->photonmap.map[idx].SetPower(intensity);
-                recorded = true;
-              }
-            }
-            if (mtl->RandomPhotonBounce(ray, intensity, hInfo)) {
-              ++bounce;
-              ray.Normalize();
-              hInfo.Init();
-            } else { break; }
-          } else { break; }
-        }
-        if (recorded) { ++numOfEmittedRays; }
-        if (finished) { break; }
-      }
-      scene->photonmap.map.ScalePhotonPowers(1.f / numOfEmittedRays);
-      scene->photonmap.map.PrepareForIrradianceEstimation();
-      //---------------------------------------------------------------------//
-      t2 = std::chrono::system_clock::now();
-      std::chrono::duration<double> dt = t2 - t1;
-      printf("\nPhoton Map Takes %f s to Build\n", dt.count());
-      FILE *fp = fopen("photonmap.dat", "wb");
-      auto x = scene->photonmap.map.NumPhotons();
-      fwrite(scene->photonmap.map.GetPhotons(), sizeof(cyPhotonMap::Photon),
-             scene->photonmap.map.NumPhotons(), fp);
-      fclose(fp);
-      //---------------------------------------------------------------------//
-    }
+    TracePhotons(scene->photonmap, photonLights, false);
+    SavePhotons(scene->photonmap, "photonmap.dat");
     //-----------------------------------------------------------------------//
     // Caustics Map
     //-----------------------------------------------------------------------//
-    {
-      //---------------------------------------------------------------------//
-      t1 = std::chrono::system_clock::now();
-      //---------------------------------------------------------------------//
-      scene->causticsmap.map.CreateAllPhotons(param.causticsMapSize);
-      //! generate the photon map
-      qaUINT numPhotonsRec(0);
-      qaUINT numOfEmittedRays(0);
-      while (true) {
-        Light *light;
-        //! randomly pick a light
-        if (photonLights.size() == 1) { light = photonLights[0]; }
-        else {
-          qaFLOAT r;
-          rng->local().Get1f(r);
-          size_t id = MIN(static_cast<size_t>(CEIL(r * photonLights.size())),
-                          photonLights.size() - 1);
-          light = photonLights[id];
-        }
-        //! generate one photons
-        DiffRay ray = light->RandomPhoton();
-        ray.Normalize();
-        DiffHitInfo hInfo;
-        hInfo.Init();
-        Color3f intensity = light->GetPhotonIntensity(ray.c.dir) * lightScale;
-        qaBOOL finished = false; // whether the map is filled
-        qaBOOL recorded = false; // whether a photon is recorded
-        //! trace photon
-        size_t bounce = 0;
-        while (bounce < param.causticsMapBounce) {
-          //! trace the photon
-          if (scene->TraceNodeNormal(scene->rootNode, ray, hInfo)) {
-            const Material *mtl = hInfo.c.node->GetMaterial();
-            //! if it is a diffuse surface
-            if (mtl->IsPhotonSurface(0) &&
-                !hInfo.c.hasDiffuseHit &&
-                bounce != 0)
-            {
-              //! fetch a photon index
-              size_t idx = numPhotonsRec++;
-              //! check if the map is filled
-              if (idx >= param.causticsMapSize) {
-                finished = true;
-                break;
-              }
-              else {
-                scene->causticsmap.map[idx].position = hInfo.c.p;
-                scene->causticsmap.map[idx].SetDirection(ray.c.dir);
-                scene->causticsmap.map[idx].SetPower(intensity);
-                recorded = true;
-              }
-            }
-            if (mtl->RandomPhotonBounce(ray, intensity, hInfo)) {
-              bool diffuseHit = hInfo.c.hasDiffuseHit;
-              ++bounce;
-              ray.Normalize();
-              hInfo.Init();
-              hInfo.c.hasDiffuseHit = (diffuseHit || mtl->IsPhotonSurface(0));
-            } else { break; }
-          } else { break; }
+    TracePhotons(scene->causticsmap, photonLights, true);
+    SavePhotons(scene->causticsmap, "caustics.dat");
+    photonsCurrent = true;
+  }
+}
+///--------------------------------------------------------------------------//
+/// Fill a photon map by tracing photon paths in parallel. A path is counted
+/// as emitted when it stores at least one photon. For caustics only photons
+/// that have not bounced off a diffuse surface yet are stored. Every rank
+/// traces its share of the photons along its own paths (path p of rank r is
+/// p * mpiSize + r), then the shares are gathered so that all ranks build
+/// the same map. The paths are traced in rounds and the photons of a round
+/// are kept in the order of the paths, up to the share, so that the map
+/// does not depend on the number of threads. The caustics map has its own
+/// streams, its paths are independent of those of the global map.
+///--------------------------------------------------------------------------//
+void Renderer::TracePhotons(PhotonMap &pm,
+                            const std::vector<Light *> &photonLights,
+                            bool caustics)
+{
+  std::chrono::time_point<std::chrono::system_clock> t1, t2;
+  t1 = std::chrono::system_clock::now();
+  UnsharePhotons(pm);
+  if (photonLights.empty()) { pm.map.CreateAllPhotons(0); return; }
+  const qaFLOAT lightScale = 1.f / static_cast<qaFLOAT>(photonLights.size());
+  const size_t quota =
+      pm.size / mpiSize + (mpiRank < pm.size % mpiSize ? 1 : 0);
+  pm.map.CreateAllPhotons(static_cast<qaUINT>(quota));
+  const qaUINT streamPixel = caustics ? Sampler_Counter::causticsPixel
+                                      : Sampler_Counter::photonPixel;
+  auto TracePath = [&](size_t pathIndex,
+                       std::vector<cyPhotonMap::Photon> &photons) {
+    rng->local().StartSample(streamPixel,
+                             static_cast<qaUINT>(pathIndex * mpiSize +
+                                                 mpiRank));
+    Light *light;
+    //! randomly pick a light
+    if (photonLights.size() == 1) { light = photonLights[0]; }
+    else {
+      qaFLOAT r;
+      rng->local().Get1f(r);
+      size_t id = MIN(static_cast<size_t>(FLOOR(r * photonLights.size())),
+                      photonLights.size() - 1);
+      light = photonLights[id];
+    }
+    //! generate one photons
+    DiffRay ray = light->RandomPhoton();
+    ray.Normalize();
+    DiffHitInfo hInfo;
+    hInfo.Init();
+    Color3f intensity = light->GetPhotonIntensity(ray.c.dir) * lightScale;
+    //! trace photon
+    size_t bounce = 0;
+    while (bounce < pm.bounce) {
+      //! trace the photon
+      if (!scene->TraceNodeNormal(scene->rootNode, ray, hInfo)) { break; }
+      const Material *mtl = hInfo.c.node->GetMaterial();
+      //! if it is a diffuse surface
+      if (mtl->IsPhotonSurface(0) &&
+          !(caustics && hInfo.c.hasDiffuseHit) &&
+          bounce != 0)
+      {
+        cyPhotonMap::Photon photon;
+        photon.position = hInfo.c.p;
+        photon.SetDirection(ray.c.dir);
+        photon.SetPower(intensity);
+        photons.push_back(photon);
+      }
+      if (!mtl->RandomPhotonBounce(ray, intensity, hInfo)) { break; }
+      bool diffuseHit = hInfo.c.hasDiffuseHit;
+      ++bounce;
+      ray.Normalize();
+      hInfo.Init();
+      if (caustics) {
+        hInfo.c.hasDiffuseHit = (diffuseHit || mtl->IsPhotonSurface(0));
+      }
+    }
+  };
+  //! paths are traced in rounds until the map is filled. The chunks of a
+  //! round are fixed, each one buffers the photons of its paths in order.
+  const size_t pathsPerRound = MAX(quota / 4, size_t(1024));
+  const size_t chunkSize = 64;
+  const size_t numChunks = (pathsPerRound + chunkSize - 1) / chunkSize;
+  std::vector<std::vector<cyPhotonMap::Photon>> chunkPhotons(numChunks);
+  std::vector<qaUINT> pathPhotons(pathsPerRound);
+  size_t numStored = 0, numEmitted = 0;
+  size_t emptyRounds = 0;
+  size_t numRounds = 0;
+  while (numStored < quota && emptyRounds < 16) {
+    const size_t before = numStored;
+    const size_t first = numRounds++ * pathsPerRound;
+    tasking::parallel_for_each(size_t(0), numChunks, 1, [&](size_t c) {
+      auto &photons = chunkPhotons[c];
+      photons.clear();
+      const size_t end = MIN((c + 1) * chunkSize, pathsPerRound);
+      for (size_t p = c * chunkSize; p < end; ++p) {
+        const size_t n = photons.size();
+        TracePath(first + p, photons);
+        pathPhotons[p] = static_cast<qaUINT>(photons.size() - n);
+      }
+    });
+    //! a path counts as emitted when at least one of its photons is kept
+    for (size_t c = 0; c < numChunks && numStored < quota; ++c) {
+      const auto &photons = chunkPhotons[c];
+      const size_t end = MIN((c + 1) * chunkSize, pathsPerRound);
+      size_t i = 0;
+      for (size_t p = c * chunkSize; p < end && numStored < quota; ++p) {
+        const size_t n = MIN(size_t(pathPhotons[p]), quota - numStored);
+        if (n > 0) { ++numEmitted; }
+        for (size_t j = 0; j < n; ++j) {
+          pm.map[static_cast<qaUINT>(numStored++)] = photons[i + j];
         }
-        if (recorded) { ++numOfEmittedRays; }
-        if (finished) { break; }
+        i += pathPhotons[p];
       }
-      scene->causticsmap.map.ScalePhotonPowers(1.f / numOfEmittedRays);
-      scene->causticsmap.map.PrepareForIrradianceEstimation();
-      //---------------------------------------------------------------------//
-      t2 = std::chrono::system_clock::now();
-      std::chrono::duration<double> dt = t2 - t1;
-      printf("\nCaustics Map Takes %f s to Build\n", dt.count());
-      FILE *fp = fopen("caustics.dat", "wb");
-      auto x = scene->causticsmap.map.NumPhotons();
-      fwrite(scene->causticsmap.map.GetPhotons(), sizeof(cyPhotonMap::Photon),
-             scene->causticsmap.map.NumPhotons(), fp);
-      fclose(fp);
-      //---------------------------------------------------------------------//
     }
+    emptyRounds = (numStored == before) ? emptyRounds + 1 : 0;
   }
-};
+  std::vector<std::vector<cyPhotonMap::Photon>>().swap(chunkPhotons);
+  pm.map.CreateAllPhotons(static_cast<qaUINT>(numStored));
+  const std::chrono::duration<double> traced =
+      std::chrono::system_clock::now() - t1;
+  GatherPhotons(pm.map, numEmitted);
+  //! with a shared scene the map is built by the loaders only
+  const NodeSharing *sharing = GetNodeSharing();
+  if (sharing == nullptr || sharing->IsLoader()) {
+    //! give up when the scene cannot store photons. An empty map cannot be
+    //! queried, so a single photon without power is kept in that case.
+    const size_t numStored = pm.map.NumPhotons();
+    if (numStored < pm.size) {
+      if (mpiRank == 0) {
+        printf("\nWarning: only %zu of %zu photons could be stored\n",
+               numStored, pm.size);
+      }
+      if (numStored == 0) {
+        pm.map.CreateAllPhotons(1);
+        pm.map[0].position = Point3(0.f);
+        pm.map[0].SetDirection(Point3(0.f, 0.f, 1.f));
+        pm.map[0].SetPower(Color3f(0.f));
+      }
+    }
+    pm.map.ScalePhotonPowers(1.f / MAX(numEmitted, size_t(1)));
+    pm.map.PrepareForIrradianceEstimation();
+  }
+  SharePhotons(pm);
+  t2 = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt = t2 - t1;
+  if (mpiRank == 0) {
+    printf("\n%s Map Takes %f s to Build (%f s tracing on %zu ranks)\n",
+           caustics ? "Caustics" : "Photon", dt.count(), traced.count(),
+           mpiSize);
+  }
+}
+void Renderer::GatherPhotons(cyPhotonMap &, size_t &) {}
+void Renderer::SharePhotons(PhotonMap &pm)
+{
+  NodeSharing *sharing = GetNodeSharing();
+  if (sharing == nullptr) { return; }
+  size_t bytes = 0;
+  if (sharing->IsLoader()) {
+    bytes = pm.map.NumStored() * sizeof(cyPhotonMap::Photon);
+    pm.shared = sharing->Share(pm.map.GetStoredPhotons(), bytes);
+  } else {
+    pm.shared = sharing->Share(nullptr, bytes);
+  }
+  if (pm.shared == nullptr) { return; }
+  pm.map.UseStoredPhotons(
+      reinterpret_cast<const cyPhotonMap::Photon *>(pm.shared),
+      static_cast<qaUINT>(bytes / sizeof(cyPhotonMap::Photon)));
+}
+void Renderer::UnsharePhotons(PhotonMap &pm)
+{
+  if (pm.shared == nullptr) { return; }
+  pm.map.Clear();
+  GetNodeSharing()->Release(pm.shared);
+  pm.shared = nullptr;
+}
+void Renderer::SavePhotons(PhotonMap &pm, const char *file)
+{
+  // the maps of all ranks are the same
+  if (mpiRank != 0) { return; }
+  FILE *fp = fopen(file, "wb");
+  if (fp == nullptr) { return; }
+  const cyPhotonMap &map = pm.map; // it may be a shared one
+  fwrite(map.GetPhotons(), sizeof(cyPhotonMap::Photon), map.NumPhotons(),
+         fp);
+  fclose(fp);
+}
 void Renderer::Init() {}
 void Renderer::Terminate()
 {
@@ -297,6 +393,56 @@ void Renderer::Terminate()
   scene->causticsmap.Clear();
 };
 ///--------------------------------------------------------------------------//
+/// Camera ray of the next sample of pixel (i, j), 'uv' is the background
+/// coordinate of the sample
+///--------------------------------------------------------------------------//
+DiffRay Renderer::CameraRay(size_t i, size_t j, SuperSampler &sampler,
+                            Point3 &uv)
+{
+  // every sample draws its own random stream, see Sampler_Counter
+  rng->local().StartSample(static_cast<qaUINT>(j * pixelW + i),
+                           static_cast<qaUINT>(sampler.GetSampleID()));
+  const Point3 texpos = sampler.NewPixelSample() + Point3(i, j, 0.f);
+  const Point3 cpt = screenA + texpos.x * screenU + texpos.y * screenV;
+  const Point3
+      xpt = screenA + (texpos.x + DiffRay::dx) * screenU + texpos.y * screenV;
+  const Point3
+      ypt = screenA + texpos.x * screenU + (texpos.y + DiffRay::dy) * screenV;
+  Point3 campos = scene->camera.pos;
+  if (dof > 0.1f) {
+    const Point3 dofSample = sampler.NewDofSample(dof);
+    campos += dofSample.x * screenX + dofSample.y * screenY;
+  }
+  DiffRay ray(campos, cpt - campos,
+              campos, xpt - campos,
+              campos, ypt - campos);
+  ray.Normalize();
+  uv = Point3(texpos.x / pixelW, texpos.y / pixelH, 0.f);
+  return ray;
+}
+///--------------------------------------------------------------------------//
+/// Trace one camera sample through pixel (i, j)
+///--------------------------------------------------------------------------//
+Color3f Renderer::SampleRender(size_t i, size_t j, SuperSampler &sampler,
+                               float &depth)
+{
+  Point3 uv;
+  DiffRay ray = CameraRay(i, j, sampler, uv);
+  if (param.integrator == INTEGRATOR_ITERATIVE) {
+    return iterative.local().Trace(*scene, ray, uv, depth);
+  }
+  DiffHitInfo hInfo;
+  hInfo.c.z = BIGFLOAT;
+  bool hasHit = scene->TraceNodeNormal(scene->rootNode, ray, hInfo);
+  depth = hasHit ? hInfo.c.z : BIGFLOAT;
+  if (hasHit) {
+    return hInfo.c.node->GetMaterial()->Shade(ray, hInfo, scene->lights,
+                                              Material::maxBounce);
+  } else {
+    return scene->background.Sample(uv);
+  }
+}
+///--------------------------------------------------------------------------//
 /// Render each individual pixel
 ///--------------------------------------------------------------------------//
 void Renderer::PixelRender(size_t i, size_t j, size_t tile_idx)
@@ -309,66 +455,1081 @@ void Renderer::PixelRender(size_t i, size_t j, size_t tile_idx)
   // start looping
   while (sampler.Loop()) {
     // calculate one sample
-    const Point3 texpos = sampler.NewPixelSample() + Point3(i, j, 0.f);
-    const Point3 cpt = screenA + texpos.x * screenU + texpos.y * screenV;
-    const Point3
-        xpt = screenA + (texpos.x + DiffRay::dx) * screenU + texpos.y * screenV;
-    const Point3
-        ypt = screenA + texpos.x * screenU + (texpos.y + DiffRay::dy) * screenV;
-    Point3 campos = scene->camera.pos;
-    if (dof > 0.1f) {
-      const Point3 dofSample = sampler.NewDofSample(dof);
-      campos += dofSample.x * screenX + dofSample.y * screenY;
-    }
-    DiffRay ray(campos, cpt - campos,
-                campos, xpt - campos,
-                campos, ypt - campos);
-    ray.Normalize();
-    DiffHitInfo hInfo;
-    hInfo.c.z = BIGFLOAT;
-    bool hasHit = scene->TraceNodeNormal(scene->rootNode, ray, hInfo);
-    Color3f localColor;
-    if (hasHit) {
-      localColor =
-          hInfo.c.node->GetMaterial()->Shade(ray, hInfo, scene->lights,
-                                             Material::maxBounce);
-    } else {
-      const float u = texpos.x / pixelW;
-      const float v = texpos.y / pixelH;
-      localColor = scene->background.Sample(Point3(u, v, 0.f));
-    }
+    float sampleDepth;
+    const Color3f localColor = SampleRender(i, j, sampler, sampleDepth);
     // calculate depth for the first sample only
-    if (sampler.GetSampleID() == 0) { depth = hasHit ? hInfo.c.z : BIGFLOAT; }
+    if (sampler.GetSampleID() == 0) { depth = sampleDepth; }
     // calculate moving average
     sampler.Accumulate(localColor);
     // increment
     sampler.Increment();
   }
-  // post process color3f
-  Color3f color = sampler.GetColor();
-  if (param.useSRGB) {
-    color.r = LinearToSRGB(color.r);
-    color.g = LinearToSRGB(color.g);
-    color.b = LinearToSRGB(color.b);
-  }
-  color.r = MAX(0.f, MIN(1.f, color.r));
-  color.g = MAX(0.f, MIN(1.f, color.g));
-  color.b = MAX(0.f, MIN(1.f, color.b));
   // write to frame buffer
   const size_t idx = (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
-  colorBuffer[idx].r = static_cast<qaUCHAR>(roundf(color.r * 255.f));
-  colorBuffer[idx].g = static_cast<qaUCHAR>(roundf(color.g * 255.f));
-  colorBuffer[idx].b = static_cast<qaUCHAR>(roundf(color.b * 255.f));
+  colorBuffer[idx] = ToColor24(sampler.GetColor(), param.useSRGB);
   depthBuffer[idx] = depth;
   sampleCountBuffer[idx] = static_cast<qaUCHAR>(255.f * sampler.GetSampleID() /
       static_cast<qaFLOAT >(param.sppMax));
   maskBuffer[idx] = 1;
+  // input of the denoiser
+  if (accumBuffer != nullptr) {
+    const int n = sampler.GetSampleID();
+    accumBuffer[idx] = sampler.GetColor() * static_cast<float>(n);
+    accumM2Buffer[idx] = sampler.GetLumaM2();
+    accumCountBuffer[idx] = static_cast<qaUINT>(n);
+  }
+}
+///--------------------------------------------------------------------------//
+/// Add up to 'spp' samples to the accumulation buffer of one pixel. The
+/// sample sequence is continued from the number of samples already taken.
+///--------------------------------------------------------------------------//
+void Renderer::ProgressivePixelRender(size_t i, size_t j, size_t spp)
+{
+  const size_t idx = (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+  const size_t sBegin = accumCountBuffer[idx];
+  const size_t sEnd = MIN(sBegin + spp, LocalSampleLimit());
+  if (sEnd <= sBegin) { return; }
+  SuperSamplerProgressive sampler(static_cast<int>(sBegin),
+                                  static_cast<int>(sEnd - sBegin),
+                                  static_cast<int>(sampleStride),
+                                  static_cast<int>(sampleOffset));
+  while (sampler.Loop()) {
+    float sampleDepth;
+    const Color3f localColor = SampleRender(i, j, sampler, sampleDepth);
+    if (sampler.GetSampleID() == 0) { depthBuffer[idx] = sampleDepth; }
+    sampler.Accumulate(localColor);
+    sampler.Increment();
+  }
+  // every pixel belongs to exactly one tile, so no synchronization is needed
+  accumBuffer[idx] += sampler.GetColor();
+  accumM2Buffer[idx] += sampler.GetLumaM2();
+  accumCountBuffer[idx] += static_cast<qaUINT>(sEnd - sBegin);
+  maskBuffer[idx] = 1;
+}
+///--------------------------------------------------------------------------//
+/// Add up to 'spp' samples to every pixel of a region, returns the number
+/// of samples taken
+///--------------------------------------------------------------------------//
+size_t Renderer::ProgressiveTileRender(const size_t region[4], size_t spp)
+{
+  if (param.integrator == INTEGRATOR_WAVEFRONT) {
+    return WavefrontProgressiveTileRender(region, spp);
+  }
+  size_t numSamples = 0;
+  for (size_t j = region[1]; j < region[3]; ++j) {
+    for (size_t i = region[0]; i < region[2]; ++i) {
+      if (tasking::has_stop_signal()) { return numSamples; }
+      const size_t idx =
+          (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+      const size_t before = accumCountBuffer[idx];
+      ProgressivePixelRender(i, j, spp);
+      numSamples += accumCountBuffer[idx] - before;
+    }
+  }
+  return numSamples;
+}
+///--------------------------------------------------------------------------//
+/// Run the samplers of a region with the wavefront integrator. Every wave
+/// holds the next sample of each pixel whose sampler still loops, so that
+/// pixels are sampled exactly as by the per pixel kernels. The depth of the
+/// first sample is written to 'depth' (one entry per sampler).
+///--------------------------------------------------------------------------//
+void Renderer::WavefrontSamples(const size_t region[4],
+                                const std::vector<SuperSampler *> &samplers,
+                                float *depth)
+{
+  WavefrontIntegrator &integrator = wavefront.local();
+  const size_t w = region[2] - region[0];
+  CameraWave wave;
+  std::vector<size_t> pixels;
+  while (!tasking::has_stop_signal()) {
+    wave.Clear();
+    pixels.clear();
+    for (size_t p = 0; p < samplers.size(); ++p) {
+      if (!samplers[p]->Loop()) { continue; }
+      Point3 uv;
+      const DiffRay ray =
+          CameraRay(region[0] + p % w, region[1] + p / w, *samplers[p], uv);
+      wave.Push(ray, uv, rng->local().GetPixel(), rng->local().GetSample());
+      pixels.push_back(p);
+    }
+    if (pixels.empty()) { break; }
+    integrator.Trace(*scene, wave);
+    for (size_t k = 0; k < pixels.size(); ++k) {
+      SuperSampler &sampler = *samplers[pixels[k]];
+      if (sampler.GetSampleID() == 0) { depth[pixels[k]] = wave.depth[k]; }
+      sampler.Accumulate(wave.radiance[k]);
+      sampler.Increment();
+    }
+  }
+}
+///--------------------------------------------------------------------------//
+/// Wavefront version of PixelRender for a whole region
+///--------------------------------------------------------------------------//
+void Renderer::WavefrontTileRender(const size_t region[4])
+{
+  const size_t w = region[2] - region[0];
+  const size_t numPixels = w * (region[3] - region[1]);
+  std::vector<SuperSamplerHalton> samplers;
+  std::vector<SuperSampler *> pointers(numPixels);
+  std::vector<float> depth(numPixels, 0.f);
+  samplers.reserve(numPixels);
+  for (size_t p = 0; p < numPixels; ++p) {
+    samplers.emplace_back(Color3f(0.005f, 0.001f, 0.005f),
+                          static_cast<int>(param.sppMin),
+                          static_cast<int>(param.sppMax));
+    pointers[p] = &samplers[p];
+  }
+  WavefrontSamples(region, pointers, depth.data());
+  for (size_t p = 0; p < numPixels; ++p) {
+    const size_t i = region[0] + p % w, j = region[1] + p / w;
+    const size_t idx =
+        (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+    colorBuffer[idx] = ToColor24(samplers[p].GetColor(), param.useSRGB);
+    depthBuffer[idx] = depth[p];
+    sampleCountBuffer[idx] = static_cast<qaUCHAR>
+        (255.f * samplers[p].GetSampleID() /
+            static_cast<qaFLOAT >(param.sppMax));
+    maskBuffer[idx] = 1;
+    if (accumBuffer != nullptr) {
+      const int n = samplers[p].GetSampleID();
+      accumBuffer[idx] = samplers[p].GetColor() * static_cast<float>(n);
+      accumM2Buffer[idx] = samplers[p].GetLumaM2();
+      accumCountBuffer[idx] = static_cast<qaUINT>(n);
+    }
+  }
+}
+///--------------------------------------------------------------------------//
+/// Wavefront version of ProgressiveTileRender
+///--------------------------------------------------------------------------//
+size_t Renderer::WavefrontProgressiveTileRender(const size_t region[4],
+                                                size_t spp)
+{
+  const size_t w = region[2] - region[0];
+  const size_t numPixels = w * (region[3] - region[1]);
+  std::vector<SuperSamplerProgressive> samplers;
+  std::vector<SuperSampler *> pointers(numPixels);
+  std::vector<size_t> index(numPixels), count(numPixels);
+  std::vector<float> depth(numPixels);
+  samplers.reserve(numPixels);
+  for (size_t p = 0; p < numPixels; ++p) {
+    const size_t i = region[0] + p % w, j = region[1] + p / w;
+    index[p] = (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+    const size_t sBegin = accumCountBuffer[index[p]];
+    const size_t sEnd =
+        MAX(sBegin, MIN(sBegin + spp, LocalSampleLimit()));
+    count[p] = sEnd - sBegin;
+    depth[p] = depthBuffer[index[p]];
+    samplers.emplace_back(static_cast<int>(sBegin),
+                          static_cast<int>(count[p]),
+                          static_cast<int>(sampleStride),
+                          static_cast<int>(sampleOffset));
+    pointers[p] = &samplers[p];
+  }
+  WavefrontSamples(region, pointers, depth.data());
+  size_t numSamples = 0;
+  for (size_t p = 0; p < numPixels; ++p) {
+    if (count[p] == 0) { continue; }
+    const size_t idx = index[p];
+    depthBuffer[idx] = depth[p];
+    accumBuffer[idx] += samplers[p].GetColor();
+    accumM2Buffer[idx] += samplers[p].GetLumaM2();
+    accumCountBuffer[idx] += static_cast<qaUINT>(count[p]);
+    maskBuffer[idx] = 1;
+    numSamples += count[p];
+  }
+  return numSamples;
+}
+///--------------------------------------------------------------------------//
+/// Interleave the bits of the tile coordinates (Morton / Z-order curve)
+///--------------------------------------------------------------------------//
+static size_t MortonCode(size_t x, size_t y)
+{
+  size_t code = 0;
+  for (size_t b = 0; b < sizeof(size_t) * 4; ++b) {
+    code |= ((x >> b) & size_t(1)) << (2 * b);
+    code |= ((y >> b) & size_t(1)) << (2 * b + 1);
+  }
+  return code;
+}
+void Renderer::SortTilesMorton(std::vector<size_t> &tiles) const
+{
+  std::sort(tiles.begin(), tiles.end(), [&](size_t a, size_t b) {
+    return MortonCode(a % tileDimX, a / tileDimX) <
+        MortonCode(b % tileDimX, b / tileDimX);
+  });
+}
+///--------------------------------------------------------------------------//
+/// Pick the tile size and build the list of local tiles in Morton order.
+/// Without a user defined size, the largest power of two that still gives
+/// every thread about 16 tiles is used.
+///--------------------------------------------------------------------------//
+void Renderer::ComputeTiles()
+{
+  const size_t minTiles = 16 * tasking::get_num_of_threads() * mpiSize;
+  if (param.tileSize > 0) {
+    tileSize = param.tileSize;
+  } else {
+    for (tileSize = 64; tileSize > 4; tileSize /= 2) {
+      const size_t n = ((pixelSize[0] + tileSize - 1) / tileSize) *
+          ((pixelSize[1] + tileSize - 1) / tileSize);
+      if (n >= minTiles) { break; }
+    }
+  }
+  tileDimX = (pixelSize[0] + tileSize - 1) / tileSize;
+  tileDimY = (pixelSize[1] + tileSize - 1) / tileSize;
+  tileCount = tileDimX * tileDimY;
+  // tiles are interleaved over MPI ranks, unless the ranks split the
+  // samples of every pixel
+  localTiles.clear();
+  const bool sampleSplit = UseSampleSplit();
+  for (size_t k = sampleSplit ? 0 : mpiRank; k < tileCount;
+       k += sampleSplit ? 1 : mpiSize) {
+    localTiles.push_back(k);
+  }
+  sampleStride = sampleSplit ? mpiSize : 1;
+  sampleOffset = sampleSplit ? mpiRank : 0;
+  SortTilesMorton(localTiles);
+  // with dynamic tiles the ranks claim runs of the whole image instead
+  tileOrder.resize(tileCount);
+  for (size_t k = 0; k < tileCount; ++k) { tileOrder[k] = k; }
+  SortTilesMorton(tileOrder);
+  tileDeps.clear();
+  if (param.trackDependencies) { tileDeps.resize(tileCount); }
+  progress.passes = progress.samples = 0;
+  progress.tiles.assign(tileCount, 0);
+  // a tile lives on the node that holds the framebuffer rows of its center
+  tileNode.clear();
+  if (tasking::numa_num_nodes() > 1) {
+    tileNode.resize(tileCount, 0);
+    for (auto k : localTiles) {
+      size_t region[4];
+      TileRegion(k, region);
+      const size_t row = (region[1] + region[3]) / 2 - pixelRegion[1];
+      tileNode[k] = image->GetRowNode(static_cast<qaINT>(row));
+    }
+  }
+  if (mpiRank == 0) {
+    printf("\nTile size %zu, %zu tiles\n", tileSize, tileCount);
+  }
+}
+///--------------------------------------------------------------------------//
+/// Pixel range of a tile
+///--------------------------------------------------------------------------//
+void Renderer::TileRegion(size_t k, size_t region[4]) const
+{
+  const size_t tileX(k % tileDimX);
+  const size_t tileY(k / tileDimX);
+  region[0] = MIN(pixelRegion[2], tileX * tileSize + pixelRegion[0]);
+  region[1] = MIN(pixelRegion[3], tileY * tileSize + pixelRegion[1]);
+  region[2] = MIN(pixelRegion[2], (tileX + 1) * tileSize + pixelRegion[0]);
+  region[3] = MIN(pixelRegion[3], (tileY + 1) * tileSize + pixelRegion[1]);
+}
+///--------------------------------------------------------------------------//
+/// Distribute tiles over threads and call the kernel with the pixel region
+/// of each of them. Each tile is a single task, workers start from
+/// contiguous runs of the list and steal from each other once they are
+/// done. All the local tiles are rendered when 'tiles' is null.
+///--------------------------------------------------------------------------//
+void Renderer::TileRegionRender(const std::function<void(size_t,
+                                                         const size_t *)>
+                                &kernel, const std::vector<size_t> *tiles)
+{
+  const std::vector<size_t> &list = tiles ? *tiles : localTiles;
+  progressPixels = 0;
+  progressTotal = 0;
+  for (auto k : list) {
+    size_t region[4];
+    TileRegion(k, region);
+    progressTotal += (region[2] - region[0]) * (region[3] - region[1]);
+  }
+  progressTotal = MAX(progressTotal, size_t(1));
+  std::vector<tasking::WorkerStats> stats;
+  tasking::work_stealing_for(list, [&](size_t k) {
+    RenderTile(k, kernel);
+  }, param.reportTileStats ? &stats : nullptr,
+     tileNode.empty() ? nullptr : &tileNode);
+  if (param.reportTileStats) {
+    printf("\nrank %zu tile statistics:\n", mpiRank);
+    tasking::print_worker_stats(stats);
+  }
+}
+///--------------------------------------------------------------------------//
+/// Call the kernel for one tile and account for its rays and pixels
+///--------------------------------------------------------------------------//
+void Renderer::RenderTile(size_t k, const std::function<void(size_t,
+                                                            const size_t *)>
+                          &kernel)
+{
+  size_t region[4];
+  TileRegion(k, region);
+  const size_t numPixels = (region[2] - region[0]) * (region[3] - region[1]);
+  const size_t raysBefore = Scene::GetThreadRayCount();
+  // a tile is only rendered by one thread at a time, the items it touches
+  // are added to its dependency set directly
+  if (!tileDeps.empty()) { Scene::SetThreadDependencies(&tileDeps[k]); }
+  kernel(k, region);
+  Scene::SetThreadDependencies(nullptr);
+  numRays += Scene::GetThreadRayCount() - raysBefore;
+  // accumulating modes report their progress once a pass is resolved
+  if (param.UseAccumulation()) { return; }
+  image->IncrementNumRenderPixel(static_cast<int>(numPixels));
+  // the tile that crosses a tenth of the pixels to render reports it
+  const size_t before = progressPixels.fetch_add(numPixels);
+  const size_t done = before + numPixels;
+  if (before * 10 / progressTotal != done * 10 / progressTotal) {
+    printf("rank %zu completed %.1f %%\n", mpiRank,
+           MIN(100.f, 100.f * done / progressTotal));
+  }
+}
+///--------------------------------------------------------------------------//
+/// Render tiles claimed from the tile order shared by all ranks (see
+/// ClaimTiles) until none is left. Chunks shrink with the number of tiles
+/// left (guided self-scheduling) and the next chunk is claimed while the
+/// current one is still being rendered. The tiles this rank rendered become
+/// its local tiles.
+///--------------------------------------------------------------------------//
+void Renderer::DynamicTileRender(const std::function<void(size_t,
+                                                          const size_t *)>
+                                 &kernel)
+{
+  const size_t numThreads = MAX(size_t(1), tasking::get_num_of_threads());
+  std::vector<size_t> claimed;
+  size_t seen = 0; // position of the shared counter at the last claim
+  size_t numClaims = 0;
+  // the tiles are not known in advance, an even share is assumed
+  progressPixels = 0;
+  progressTotal = MAX(NumLocalPixels(), size_t(1));
+  auto Refill = [&](std::vector<size_t> &chunk) {
+    const size_t left = tileCount - MIN(seen, tileCount);
+    const size_t n = MAX(numThreads, left / (8 * mpiSize));
+    const size_t first = ClaimTiles(n);
+    ++numClaims;
+    seen = first + n;
+    for (size_t i = first; i < MIN(first + n, tileCount); ++i) {
+      chunk.push_back(tileOrder[i]);
+      claimed.push_back(tileOrder[i]);
+    }
+    return first + n < tileCount;
+  };
+  std::vector<tasking::WorkerStats> stats;
+  tasking::dynamic_for(Refill, numThreads, [&](size_t k) {
+    RenderTile(k, kernel);
+  }, param.reportTileStats ? &stats : nullptr);
+  if (param.reportTileStats) {
+    printf("\nrank %zu tile statistics (%zu tiles in %zu claims):\n",
+           mpiRank, claimed.size(), numClaims);
+    tasking::print_worker_stats(stats);
+  }
+  localTiles = claimed;
+  SortTilesMorton(localTiles);
+}
+///--------------------------------------------------------------------------//
+/// Single process version of the shared tile counter
+///--------------------------------------------------------------------------//
+size_t Renderer::ClaimTiles(size_t n) { return nextTile.fetch_add(n); }
+void Renderer::ResetTileClaims() { nextTile = 0; }
+bool Renderer::UseDynamicTiles() const
+{
+  return param.dynamicTiles && !param.UseAccumulation() &&
+      param.checkpointInterval <= 0.f && !param.resume;
+}
+///--------------------------------------------------------------------------//
+/// With sample splitting rank r takes the samples r, r + mpiSize, ... of
+/// every pixel, so that the ranks together draw the same samples as a
+/// single rank would. The adaptive scheduler places samples from the local
+/// error estimate and keeps splitting the tiles.
+///--------------------------------------------------------------------------//
+bool Renderer::UseSampleSplit() const
+{
+  return param.sampleSplit && mpiSize > 1 && param.UseAccumulation() &&
+      param.adaptiveSPP == 0;
+}
+size_t Renderer::LocalSampleLimit() const
+{
+  const size_t limit = param.SampleLimit();
+  if (!UseSampleSplit()) { return limit; }
+  return (limit + mpiSize - 1 - mpiRank) / mpiSize;
+}
+size_t Renderer::NumLocalPixels() const
+{
+  const size_t numPixels = pixelSize[0] * pixelSize[1];
+  return UseSampleSplit() ? numPixels : numPixels / mpiSize;
+}
+///--------------------------------------------------------------------------//
+/// Call the kernel for every pixel of the tiles
+///--------------------------------------------------------------------------//
+void Renderer::TileRender(const std::function<void(size_t, size_t, size_t)>
+                          &kernel, const std::vector<size_t> *tiles)
+{
+  TileRegionRender([&](size_t k, const size_t *region) {
+    for (size_t j = region[1]; j < region[3]; ++j) {
+      for (size_t i = region[0]; i < region[2]; ++i) {
+        if (!tasking::has_stop_signal()) { kernel(i, j, k); }
+      }
+    }
+  }, tiles);
+}
+///--------------------------------------------------------------------------//
+/// Render the image in passes of progressiveSPP samples per pixel
+///--------------------------------------------------------------------------//
+void Renderer::ProgressiveRender()
+{
+  image->IncrementNumRenderPixel(static_cast<int>(MIN(progress.passes,
+      numPasses) * pixelSize[0] * pixelSize[1]));
+  for (size_t pass = progress.passes; pass < numPasses; ++pass) {
+    if (tasking::has_stop_signal()) { break; }
+    TileRegionRender([&](size_t, const size_t *region) {
+      ProgressiveTileRender(region, param.progressiveSPP);
+    });
+    image->ResolveAccumulation(param.useSRGB,
+                               static_cast<qaUINT>(param.sppMax));
+    // the last pass is filtered by ThreadRender
+    if (param.denoisePasses && pass + 1 < numPasses) { Denoise(); }
+    image->IncrementNumRenderPixel(static_cast<int>(pixelSize[0] *
+        pixelSize[1]));
+    // an interrupted pass is done again when resuming, the pixels it
+    // reached keep their samples
+    if (!tasking::has_stop_signal()) { progress.passes = pass + 1; }
+    CheckpointIfDue();
+    if (mpiRank == 0) {
+      std::cout << "pass " << pass + 1 << " / " << numPasses << std::endl;
+    }
+  }
+}
+///--------------------------------------------------------------------------//
+/// Data-distributed version of WavefrontTileRender. The waves are traced by
+/// this thread, so that the exchanges of all the ranks line up, and hold the
+/// next sample of every pixel of a batch of local tiles. Once its tiles are
+/// done a rank keeps tracing empty waves until the other ranks are done
+/// too, it still serves their rays.
+///--------------------------------------------------------------------------//
+void Renderer::DistributedRender()
+{
+  // pixels of a batch, a wave is sent in a few messages per rank
+  const size_t batchSize = size_t(1) << 16;
+  forwarding->Commit(*scene);
+  WavefrontIntegrator &integrator = wavefront.local();
+  std::vector<SuperSamplerHalton> samplers;
+  std::vector<size_t> index; // frame buffer index of every sampler
+  std::vector<float> depth;
+  std::vector<size_t> pixels;
+  CameraWave wave;
+  size_t next = 0; // next entry of localTiles
+  auto Resolve = [&]() {
+    for (size_t p = 0; p < samplers.size(); ++p) {
+      const size_t idx = index[p];
+      colorBuffer[idx] = ToColor24(samplers[p].GetColor(), param.useSRGB);
+      depthBuffer[idx] = depth[p];
+      sampleCountBuffer[idx] = static_cast<qaUCHAR>
+          (255.f * samplers[p].GetSampleID() /
+              static_cast<qaFLOAT >(param.sppMax));
+      maskBuffer[idx] = 1;
+      if (accumBuffer != nullptr) {
+        const int n = samplers[p].GetSampleID();
+        accumBuffer[idx] = samplers[p].GetColor() * static_cast<float>(n);
+        accumM2Buffer[idx] = samplers[p].GetLumaM2();
+        accumCountBuffer[idx] = static_cast<qaUINT>(n);
+      }
+    }
+    image->IncrementNumRenderPixel(static_cast<int>(samplers.size()));
+    samplers.clear();
+    index.clear();
+    depth.clear();
+  };
+  while (true) {
+    wave.Clear();
+    pixels.clear();
+    for (size_t p = 0; p < samplers.size(); ++p) {
+      if (tasking::has_stop_signal() || !samplers[p].Loop()) { continue; }
+      const size_t i = index[p] % pixelSize[0] + pixelRegion[0];
+      const size_t j = index[p] / pixelSize[0] + pixelRegion[1];
+      Point3 uv;
+      const DiffRay ray = CameraRay(i, j, samplers[p], uv);
+      wave.Push(ray, uv, rng->local().GetPixel(), rng->local().GetSample());
+      pixels.push_back(p);
+    }
+    if (pixels.empty()) {
+      Resolve();
+      if (next < localTiles.size() && !tasking::has_stop_signal()) {
+        while (next < localTiles.size() && samplers.size() < batchSize) {
+          size_t region[4];
+          TileRegion(localTiles[next++], region);
+          for (size_t j = region[1]; j < region[3]; ++j) {
+            for (size_t i = region[0]; i < region[2]; ++i) {
+              samplers.emplace_back(Color3f(0.005f, 0.001f, 0.005f),
+                                    static_cast<int>(param.sppMin),
+                                    static_cast<int>(param.sppMax));
+              index.push_back((j - pixelRegion[1]) * pixelSize[0] +
+                  i - pixelRegion[0]);
+              depth.push_back(0.f);
+            }
+          }
+        }
+        continue;
+      }
+    }
+    if (!forwarding->AnyActive(!pixels.empty())) { break; }
+    integrator.Trace(*scene, wave, forwarding);
+    for (size_t k = 0; k < pixels.size(); ++k) {
+      SuperSamplerHalton &sampler = samplers[pixels[k]];
+      if (sampler.GetSampleID() == 0) { depth[pixels[k]] = wave.depth[k]; }
+      sampler.Accumulate(wave.radiance[k]);
+      sampler.Increment();
+    }
+  }
+}
+///--------------------------------------------------------------------------//
+/// Estimate the relative error of the mean of every tile, then smooth the
+/// estimates over the 3x3 tile neighborhood since per-pixel variances are
+/// unreliable at low sample counts. With the denoiser, the error is the one
+/// left after filtering (see Denoise), so that samples go where the filter
+/// cannot remove the noise.
+///--------------------------------------------------------------------------//
+void Renderer::ComputeTileError(std::vector<float> &tileError) const
+{
+  const qaFLOAT *denoisedVar = image->GetDenoisedVariance();
+  std::vector<float> rawError(tileCount, 0.f);
+  // the tiles of the other ranks have no samples here, they are left out
+  // of the smoothing so that the error does not depend on the rank count
+  std::vector<char> sampled(tileCount, 0);
+  tasking::parallel_for_each(size_t(0), tileCount, 16, [&](size_t k) {
+    size_t region[4];
+    TileRegion(k, region);
+    float sum = 0.f;
+    size_t num = 0;
+    for (size_t j = region[1]; j < region[3]; ++j) {
+      for (size_t i = region[0]; i < region[2]; ++i) {
+        const size_t idx =
+            (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+        const float n = static_cast<float>(accumCountBuffer[idx]);
+        if (param.denoise && n > 0.f) {
+          const float mean = ColorLuma(accumBuffer[idx]) / n;
+          sum += SQRT(denoisedVar[idx]) / (mean + 0.01f);
+          ++num;
+          continue;
+        }
+        if (n < 2.f) { continue; }
+        const float mean = ColorLuma(accumBuffer[idx]) / n;
+        const float var =
+            MAX(0.f, accumM2Buffer[idx] / n - mean * mean) * n / (n - 1.f);
+        sum += SQRT(var / n) / (mean + 0.01f);
+        ++num;
+      }
+    }
+    rawError[k] = num > 0 ? sum / num : 0.f;
+    sampled[k] = num > 0;
+  });
+  tileError.assign(tileCount, 0.f);
+  for (size_t k = 0; k < tileCount; ++k) {
+    const auto tx = static_cast<int>(k % tileDimX);
+    const auto ty = static_cast<int>(k / tileDimX);
+    float sum = 0.f;
+    int num = 0;
+    for (int y = MAX(ty - 1, 0); y <= MIN(ty + 1, (int) tileDimY - 1); ++y) {
+      for (int x = MAX(tx - 1, 0); x <= MIN(tx + 1, (int) tileDimX - 1); ++x) {
+        if (!sampled[y * tileDimX + x]) { continue; }
+        sum += rawError[y * tileDimX + x];
+        ++num;
+      }
+    }
+    tileError[k] = num > 0 ? sum / num : 0.f;
+  }
+}
+///--------------------------------------------------------------------------//
+/// First-hit normal and albedo of every pixel, the features of the denoiser.
+/// They are taken with the first sample of the pixel, like the z-buffer.
+///--------------------------------------------------------------------------//
+void Renderer::RenderFeatures()
+{
+  tasking::parallel_for_each(size_t(0), localTiles.size(), 1, [&](size_t t) {
+    size_t region[4];
+    TileRegion(localTiles[t], region);
+    RenderTileFeatures(region);
+  });
+}
+void Renderer::RenderTileFeatures(const size_t region[4])
+{
+  Point3 *normal = image->GetNormals();
+  Color3f *albedo = image->GetAlbedo();
+  for (size_t j = region[1]; j < region[3]; ++j) {
+    for (size_t i = region[0]; i < region[2]; ++i) {
+      const size_t idx =
+          (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+      SuperSamplerProgressive sampler(0, 1);
+      Point3 uv;
+      DiffRay ray = CameraRay(i, j, sampler, uv);
+      DiffHitInfo hInfo;
+      hInfo.c.z = BIGFLOAT;
+      if (scene->TraceNodeNormal(scene->rootNode, ray, hInfo)) {
+        const Point3 N = normalize(hInfo.c.N);
+        normal[idx] = dot(N, ray.c.dir) > 0.f ? -N : N;
+        albedo[idx] = hInfo.c.node->GetMaterial()->Albedo(hInfo);
+      } else {
+        normal[idx] = Point3(0.f);
+        albedo[idx] = Color3f(1.f);
+      }
+    }
+  }
+}
+///--------------------------------------------------------------------------//
+/// Filter the accumulated image into the color buffer, returns the time it
+/// took in seconds
+///--------------------------------------------------------------------------//
+double Renderer::Denoise()
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  image->DenoiseAccumulation(param.useSRGB);
+  const std::chrono::duration<double> dt =
+      std::chrono::steady_clock::now() - t0;
+  return dt.count();
+}
+///--------------------------------------------------------------------------//
+/// Spend an image-wide sample budget where the estimated error is largest.
+/// After a uniform pass of sppMin samples, batches are dispatched to the
+/// worst tiles until the budget is used or all tiles reach the target error.
+///--------------------------------------------------------------------------//
+void Renderer::AdaptiveRender()
+{
+  const size_t batch =
+      param.progressiveSPP > 0 ? param.progressiveSPP : MAX(param.sppMin, 1);
+  const size_t numLocalPixels = NumLocalPixels();
+  const size_t budget = param.adaptiveSPP * numLocalPixels;
+  const auto target = static_cast<size_t>(image->GetNumPixelsToRender());
+  std::vector<size_t> &tileSamples = progress.tiles;
+  std::vector<float> tileError;
+  size_t &spent = progress.samples;
+  size_t &round = progress.passes;
+  auto RenderRound = [&](const std::vector<size_t> &tiles, size_t spp) {
+    std::atomic<size_t> numSamples(0);
+    TileRegionRender([&](size_t k, const size_t *region) {
+      // a tile is a single task, its counter has only one writer
+      const size_t n = ProgressiveTileRender(region, spp);
+      tileSamples[k] += n;
+      numSamples += n;
+    }, &tiles);
+    spent += numSamples;
+    image->ResolveAccumulation(param.useSRGB,
+                               static_cast<qaUINT>(param.sppMax));
+    const auto done = static_cast<size_t>(image->GetNumRenderedPixels());
+    if (done + 1 < target) {
+      image->IncrementNumRenderPixel
+          (static_cast<int>(MIN(numSamples.load(), target - 1 - done)));
+    }
+    // an interrupted round is not counted, so that a resumed render does
+    // the uniform pass again when it was cut
+    if (!tasking::has_stop_signal()) { ++round; }
+    CheckpointIfDue();
+  };
+  //! uniform pass, unless it was done before the render got resumed
+  if (round == 0) { RenderRound(localTiles, MAX(param.sppMin, 1)); }
+  //! adaptive passes
+  std::vector<size_t> selected;
+  while (spent < budget && !tasking::has_stop_signal()) {
+    if (param.denoise) { Denoise(); }
+    ComputeTileError(tileError);
+    selected.clear();
+    for (auto k : localTiles) {
+      size_t region[4];
+      TileRegion(k, region);
+      const size_t cap =
+          param.sppMax * (region[2] - region[0]) * (region[3] - region[1]);
+      if (tileError[k] > param.adaptiveError && tileSamples[k] < cap) {
+        selected.push_back(k);
+      }
+    }
+    if (selected.empty()) { break; }
+    // a round covers at most a quarter of the local tiles, worst first,
+    // and never more than what is left in the budget
+    std::sort(selected.begin(), selected.end(), [&](size_t a, size_t b) {
+      return tileError[a] > tileError[b];
+    });
+    const size_t samplesPerTile = batch * tileSize * tileSize;
+    const size_t roundTiles = (localTiles.size() + 3) / 4;
+    const size_t maxTiles = MAX(size_t(1), MIN(roundTiles,
+        (budget - spent + samplesPerTile - 1) / samplesPerTile));
+    selected.resize(MIN(selected.size(), maxTiles));
+    SortTilesMorton(selected);
+    // when only a few tiles are left they get proportionally more samples
+    const size_t left =
+        (budget - spent) / (selected.size() * tileSize * tileSize);
+    const size_t spp = CLAMP(MIN(batch * roundTiles / selected.size(), left),
+                             batch, param.sppMax);
+    RenderRound(selected, spp);
+  }
+  image->MarkRenderDone();
+  if (mpiRank == 0) {
+    float maxError = 0.f;
+    if (param.denoise) { Denoise(); }
+    ComputeTileError(tileError);
+    for (auto k : localTiles) { maxError = MAX(maxError, tileError[k]); }
+    printf("\nAdaptive sampling: %zu rounds, %.2f spp on average, "
+           "max tile error %f\n", round,
+           spent / static_cast<float>(numLocalPixels), maxError);
+  }
+}
+///--------------------------------------------------------------------------//
+/// Render progressive passes until the time budget is used. The cost of a
+/// sample per pixel is measured on every pass and the pass that would cross
+/// the deadline is shrunk to what still fits. Without a fixed pass size the
+/// passes double, so that resolving the image stays cheap. A watchdog stops
+/// the tiles at the deadline in case the estimate was too optimistic, but
+/// the first pass always completes so that every pixel has a sample. With
+/// the denoiser, the first pass is filtered once to time it and the
+/// deadline is moved forward by the cost of the final filter.
+///--------------------------------------------------------------------------//
+void Renderer::TimedRender()
+{
+  using clock = std::chrono::steady_clock;
+  auto Seconds = [](clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  };
+  // a small part of the slot is kept to write the output
+  const double budget = param.timeBudget;
+  double deadline = 0.97 * budget;
+  auto ToTimePoint = [&](double seconds) {
+    return startTime + std::chrono::duration_cast<clock::duration>
+        (std::chrono::duration<double>(seconds));
+  };
+  clock::time_point hardDeadline = ToTimePoint(deadline);
+  std::mutex watchdogLock;
+  std::condition_variable watchdogWakeup;
+  bool finished = false;
+  std::atomic<size_t> pass(0);
+  std::thread watchdog([&]() {
+    std::unique_lock<std::mutex> guard(watchdogLock);
+    for (;;) {
+      const clock::time_point until = hardDeadline;
+      if (watchdogWakeup.wait_until(guard, until, [&]() {
+        return finished || hardDeadline != until;
+      })) {
+        if (finished) { break; }
+        continue; // the deadline moved
+      }
+      if (pass > 0) { tasking::signal_stop(); }
+      break;
+    }
+  });
+  const size_t limit = LocalSampleLimit();
+  const auto target = static_cast<size_t>(image->GetNumPixelsToRender());
+  const clock::time_point renderStart = clock::now();
+  size_t batch = param.progressiveSPP > 0 ? param.progressiveSPP : 1;
+  size_t &spp = progress.samples; // samples per pixel taken so far
+  const size_t sppStart = spp;    // taken before the render got resumed
+  double costPerSPP = 0.0;   // seconds per sample per pixel
+  double timingCost = 0.0;   // spent timing the denoiser
+  while (spp < limit && !tasking::has_stop_signal()) {
+    size_t n = MIN(batch, limit - spp);
+    if (pass > 0) {
+      const double left = deadline - Seconds(clock::now() - startTime);
+      const auto fit = static_cast<size_t>(MAX(0.0, left / costPerSPP));
+      if (fit == 0) { break; }
+      n = MIN(n, fit);
+    }
+    const clock::time_point passStart = clock::now();
+    TileRegionRender([&](size_t, const size_t *region) {
+      ProgressiveTileRender(region, n);
+    });
+    spp += n;
+    image->ResolveAccumulation(param.useSRGB, static_cast<qaUINT>(spp));
+    // the first pass is filtered to time the denoiser, see below
+    if (param.denoisePasses && pass > 0) { Denoise(); }
+    // pessimistic estimate: the last pass or the average, whichever is
+    // worse, plus 10% for the variation between passes
+    const double passCost = Seconds(clock::now() - passStart) / n;
+    const double meanCost =
+        (Seconds(clock::now() - renderStart) - timingCost) / (spp - sppStart);
+    costPerSPP = 1.1 * MAX(passCost, meanCost);
+    if (param.denoise && pass == 0) {
+      timingCost = Denoise();
+      std::lock_guard<std::mutex> guard(watchdogLock);
+      deadline -= 1.2 * timingCost;
+      hardDeadline = ToTimePoint(deadline);
+      watchdogWakeup.notify_all();
+    }
+    if (param.progressiveSPP == 0) { batch = spp; }
+    ++pass;
+    const double elapsed = Seconds(clock::now() - startTime);
+    const auto done = static_cast<size_t>(image->GetNumRenderedPixels());
+    const auto now = static_cast<size_t>(target * MIN(1.0, elapsed / budget));
+    if (now > done) {
+      image->IncrementNumRenderPixel(static_cast<int>(now - done));
+    }
+    if (mpiRank == 0) {
+      printf("pass %zu: %zu spp, %.2f s left\n", pass.load(), n,
+             MAX(0.0, budget - elapsed));
+    }
+    CheckpointIfDue();
+  }
+  {
+    std::lock_guard<std::mutex> guard(watchdogLock);
+    finished = true;
+  }
+  watchdogWakeup.notify_all();
+  watchdog.join();
+  // an interrupted pass leaves some pixels with fewer samples
+  image->ResolveAccumulation(param.useSRGB, static_cast<qaUINT>(MAX(spp, 1)));
+  image->MarkRenderDone();
+  const size_t numLocalPixels = NumLocalPixels();
+  size_t numSamples = 0;
+  for (size_t i = 0; i < pixelSize[0] * pixelSize[1]; ++i) {
+    numSamples += accumCountBuffer[i];
+  }
+  const double renderTime = Seconds(clock::now() - renderStart);
+  printf("\nrank %zu: time budget %.2f s, %zu passes in %.2f s, "
+         "%.2f spp per pixel, %.2f Mrays/s\n", mpiRank, budget, pass.load(),
+         renderTime, numSamples / static_cast<double>(numLocalPixels),
+         numRays / MAX(renderTime, 1e-9) * 1e-6);
+}
+///--------------------------------------------------------------------------//
+/// Render the tiles that are not done yet. With checkpoints they are split
+/// into batches, a checkpoint can be written after every batch and only
+/// the tiles of completed batches are marked as done.
+///--------------------------------------------------------------------------//
+void Renderer::RenderTileBatches(const std::function<void(const std::vector
+                                 <size_t> &)> &render)
+{
+  std::vector<size_t> todo;
+  size_t numRestored = 0;
+  for (auto k : localTiles) {
+    if (progress.tiles[k] == 0) {
+      todo.push_back(k);
+    } else { // restored from a checkpoint
+      size_t region[4];
+      TileRegion(k, region);
+      numRestored += (region[2] - region[0]) * (region[3] - region[1]);
+      for (size_t j = region[1]; j < region[3]; ++j) {
+        for (size_t i = region[0]; i < region[2]; ++i) {
+          maskBuffer[(j - pixelRegion[1]) * pixelSize[0] + i -
+              pixelRegion[0]] = 1;
+        }
+      }
+    }
+  }
+  image->IncrementNumRenderPixel(static_cast<int>(numRestored));
+  const size_t batchSize = param.checkpointInterval > 0.f ?
+                           MAX(size_t(1), (todo.size() + 31) / 32) :
+                           MAX(size_t(1), todo.size());
+  std::vector<size_t> batch;
+  for (size_t b = 0; b < todo.size(); b += batchSize) {
+    batch.assign(todo.begin() + b,
+                 todo.begin() + MIN(b + batchSize, todo.size()));
+    render(batch);
+    if (tasking::has_stop_signal()) { break; }
+    for (auto k : batch) { progress.tiles[k] = 1; }
+    CheckpointIfDue();
+  }
+}
+///--------------------------------------------------------------------------//
+/// Checkpoints. Every rank writes its own file with the accumulation and
+/// image buffers, the progress of the render and the seed of the random
+/// streams, optionally with the photon maps. The random numbers of a sample
+/// are keyed on its pixel and index (see Sampler_Counter), so a resumed
+/// render that continues from the sample counts draws the same numbers as
+/// an uninterrupted one, and it reuses the photon maps when they were
+/// saved.
+///--------------------------------------------------------------------------//
+qaUINT Renderer::RenderMode() const
+{
+  // the samples of a split render are not those of a tiled one
+  const qaUINT split = UseSampleSplit() ? 4 : 0;
+  if (param.timeBudget > 0.f) { return 3 | split; }
+  if (param.adaptiveSPP > 0) { return 2; }
+  if (param.progressiveSPP > 0) { return 1 | split; }
+  return 0;
+}
+std::string Renderer::CheckpointFile() const
+{
+  return "checkpoint_rank_" + std::to_string(mpiRank) + FrameSuffix() +
+      ".dat";
+}
+std::string Renderer::FrameSuffix() const
+{
+  if (frame < 0) { return ""; }
+  char str[16];
+  snprintf(str, sizeof(str), "_%04d", frame);
+  return str;
+}
+//! header describing the current render
+static CheckpointHeader MakeHeader(qaUINT mode, size_t mpiSize,
+                                   size_t mpiRank, size_t pixelW,
+                                   size_t pixelH, const size_t region[4],
+                                   size_t tileSize, size_t tileCount)
+{
+  CheckpointHeader h;
+  h.mode = mode;
+  h.mpiSize = static_cast<qaUINT>(mpiSize);
+  h.mpiRank = static_cast<qaUINT>(mpiRank);
+  h.width = static_cast<qaUINT>(pixelW);
+  h.height = static_cast<qaUINT>(pixelH);
+  for (int i = 0; i < 4; ++i) { h.region[i] = static_cast<qaUINT>(region[i]); }
+  h.tileSize = static_cast<qaUINT>(tileSize);
+  h.tileCount = static_cast<qaUINT>(tileCount);
+  return h;
+}
+bool Renderer::SaveCheckpoint()
+{
+  const auto t1 = std::chrono::steady_clock::now();
+  CheckpointHeader h = MakeHeader(RenderMode(), mpiSize, mpiRank, pixelW,
+                                  pixelH, pixelRegion, tileSize, tileCount);
+  h.seed = Sampler_Counter::GetSeed();
+  h.passes = progress.passes;
+  h.samples = progress.samples;
+  h.accumulation = accumBuffer != nullptr;
+  if (param.checkpointPhotons && scene->usePhotonMap) {
+    h.numPhotons = scene->photonmap.map.NumPhotons();
+    h.numCaustics = scene->causticsmap.map.NumPhotons();
+  }
+  const std::vector<uint64_t> tiles(progress.tiles.begin(),
+                                    progress.tiles.end());
+  const size_t n = pixelSize[0] * pixelSize[1];
+  CheckpointWriter out(CheckpointFile());
+  out.Write(&h, 1);
+  out.Write(tiles.data(), tiles.size());
+  out.Write(colorBuffer, n);
+  out.Write(depthBuffer, n);
+  out.Write(sampleCountBuffer, n);
+  out.Write(maskBuffer, n);
+  if (accumBuffer != nullptr) {
+    out.Write(accumBuffer, n);
+    out.Write(accumM2Buffer, n);
+    out.Write(accumCountBuffer, n);
+  }
+  if (h.numPhotons > 0) {
+    const cyPhotonMap &photons = scene->photonmap.map;
+    const cyPhotonMap &caustics = scene->causticsmap.map;
+    out.Write(photons.GetPhotons(), h.numPhotons);
+    out.Write(caustics.GetPhotons(), h.numCaustics);
+  }
+  if (!out.Commit()) {
+    fprintf(stderr, "rank %zu: failed to write %s\n", mpiRank,
+            CheckpointFile().c_str());
+    return false;
+  }
+  const std::chrono::duration<double> dt =
+      std::chrono::steady_clock::now() - t1;
+  printf("rank %zu: checkpoint written in %f s\n", mpiRank, dt.count());
+  return true;
+}
+bool Renderer::LoadCheckpoint()
+{
+  const std::string file = CheckpointFile();
+  CheckpointReader in(file);
+  CheckpointHeader h;
+  in.Read(&h, 1);
+  if (!in.Good()) {
+    printf("\nrank %zu: no checkpoint to resume from\n", mpiRank);
+    return false;
+  }
+  // the checkpoint has to come from the same frame, mode and tiling
+  const CheckpointHeader e = MakeHeader(RenderMode(), mpiSize, mpiRank,
+                                        pixelW, pixelH, pixelRegion,
+                                        tileSize, tileCount);
+  if (std::string(h.magic, 4) != std::string(e.magic, 4) ||
+      h.version != e.version || h.mode != e.mode ||
+      h.mpiSize != e.mpiSize || h.mpiRank != e.mpiRank ||
+      h.width != e.width || h.height != e.height ||
+      !std::equal(h.region, h.region + 4, e.region) ||
+      h.tileSize != e.tileSize || h.tileCount != e.tileCount ||
+      h.accumulation != static_cast<qaUINT>(accumBuffer != nullptr)) {
+    printf("\nrank %zu: %s does not match this render, starting over\n",
+           mpiRank, file.c_str());
+    return false;
+  }
+  const size_t n = pixelSize[0] * pixelSize[1];
+  std::vector<uint64_t> tiles(tileCount);
+  std::vector<Color3c> color(n);
+  std::vector<float> depth(n);
+  std::vector<qaUCHAR> sampleCount(n), mask(n);
+  std::vector<Color3f> accum;
+  std::vector<qaFLOAT> accumM2;
+  std::vector<qaUINT> accumCount;
+  in.Read(tiles.data(), tiles.size());
+  in.Read(color.data(), n);
+  in.Read(depth.data(), n);
+  in.Read(sampleCount.data(), n);
+  in.Read(mask.data(), n);
+  if (accumBuffer != nullptr) {
+    accum.resize(n);
+    accumM2.resize(n);
+    accumCount.resize(n);
+    in.Read(accum.data(), n);
+    in.Read(accumM2.data(), n);
+    in.Read(accumCount.data(), n);
+  }
+  std::vector<cyPhotonMap::Photon> photons(h.numPhotons);
+  std::vector<cyPhotonMap::Photon> caustics(h.numCaustics);
+  in.Read(photons.data(), photons.size());
+  in.Read(caustics.data(), caustics.size());
+  if (!in.Good()) {
+    printf("\nrank %zu: %s is truncated, starting over\n", mpiRank,
+           file.c_str());
+    return false;
+  }
+  std::copy(color.begin(), color.end(), colorBuffer);
+  std::copy(depth.begin(), depth.end(), depthBuffer);
+  std::copy(sampleCount.begin(), sampleCount.end(), sampleCountBuffer);
+  std::copy(mask.begin(), mask.end(), maskBuffer);
+  if (accumBuffer != nullptr) {
+    std::copy(accum.begin(), accum.end(), accumBuffer);
+    std::copy(accumM2.begin(), accumM2.end(), accumM2Buffer);
+    std::copy(accumCount.begin(), accumCount.end(), accumCountBuffer);
+  }
+  progress.passes = h.passes;
+  progress.samples = h.samples;
+  progress.tiles.assign(tiles.begin(), tiles.end());
+  Sampler_Counter::SetSeed(h.seed);
+  if (param.usePhotonMap && !photons.empty()) {
+    auto Restore = [](PhotonMap &pm,
+                      const std::vector<cyPhotonMap::Photon> &src) {
+      pm.map.CreateAllPhotons(static_cast<qaUINT>(src.size()));
+      std::copy(src.begin(), src.end(), pm.map.GetPhotons());
+      pm.map.PrepareForIrradianceEstimation();
+    };
+    Restore(scene->photonmap, photons);
+    Restore(scene->causticsmap, caustics);
+    photonsRestored = true;
+  }
+  printf("\nrank %zu: resuming from %s (%zu passes, %zu samples)\n",
+         mpiRank, file.c_str(), progress.passes, progress.samples);
+  return true;
+}
+bool Renderer::SaveAccumulation(const std::string &file) const
+{
+  if (accumBuffer == nullptr) { return false; }
+  AccumFileHeader h;
+  h.width = static_cast<qaUINT>(pixelSize[0]);
+  h.height = static_cast<qaUINT>(pixelSize[1]);
+  h.x0 = static_cast<qaUINT>(pixelRegion[0]);
+  h.y0 = static_cast<qaUINT>(pixelRegion[1]);
+  h.imageWidth = static_cast<qaUINT>(pixelW);
+  h.imageHeight = static_cast<qaUINT>(pixelH);
+  h.seed = Sampler_Counter::GetSeed();
+  h.mpiRank = static_cast<qaUINT>(mpiRank);
+  if (!WriteAccumFile(file, h, accumBuffer, accumCountBuffer,
+                      accumM2Buffer)) {
+    fprintf(stderr, "rank %zu: failed to write %s\n", mpiRank, file.c_str());
+    return false;
+  }
+  return true;
+}
+void Renderer::CheckpointIfDue()
+{
+  if (param.checkpointInterval <= 0.f) { return; }
+  const auto now = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> dt = now - lastCheckpoint;
+  if (dt.count() < param.checkpointInterval) { return; }
+  SaveCheckpoint();
+  lastCheckpoint = std::chrono::steady_clock::now();
 }
 ///--------------------------------------------------------------------------//
 /// Setup rendering tasks for each threads
 ///--------------------------------------------------------------------------//
 void Renderer::ThreadRender()
 {
+  // the timer synchronizes the ranks, nobody claims a tile before the
+  // shared counter is reset
+  ResetTileClaims();
   //-------------------------------------------------------------------------//
   // Start timing
   //-------------------------------------------------------------------------//
@@ -380,45 +1541,172 @@ void Renderer::ThreadRender()
     printf("\nRunning with %zu threads on rank %zu\n",
            tasking::get_num_of_threads(), mpiRank);
   }
-  const auto tileStart(static_cast<size_t>(mpiRank));
-  const auto tileStop(static_cast<size_t>(tileCount));
-  const auto tileStep(static_cast<size_t>(mpiSize));
   tasking::init();
-  tasking::parallel_for(tileStart, tileStop, tileStep, [&](size_t k) {
-    const size_t tileX(k % tileDimX);
-    const size_t tileY(k / tileDimX);
-    const size_t iStart =
-        MIN(pixelRegion[2], tileX * tileSize + pixelRegion[0]);
-    const size_t jStart =
-        MIN(pixelRegion[3], tileY * tileSize + pixelRegion[1]);
-    const size_t iEnd =
-        MIN(pixelRegion[2], (tileX + 1) * tileSize + pixelRegion[0]);
-    const size_t jEnd =
-        MIN(pixelRegion[3], (tileY + 1) * tileSize + pixelRegion[1]);
-    const size_t numPixels = (iEnd - iStart) * (jEnd - jStart);
-    tasking::parallel_for(size_t(0), numPixels, size_t(1), [=](size_t idx) {
-      const size_t j = jStart + idx / (iEnd - iStart);
-      const size_t i = iStart + idx % (iEnd - iStart);
-      if (!tasking::has_stop_signal()) { PixelRender(i, j, k); }
-    });
-    image->IncrementNumRenderPixel(static_cast<int>(numPixels));
-    
-    if (k % 1000 == mpiRank) 
-    {
-      size_t completed = image->GetNumRenderedPixels();
-      float percentage = 100.f * (float)completed / (pixelW * pixelH);
-      std::cout << std::fixed
-		<< "rank " << mpiRank 
-		<< " competed " 		
-		<< percentage * mpiSize
-		<< " % "
-		<< std::endl;            
+  numRays = 0;
+  lastCheckpoint = std::chrono::steady_clock::now();
+  const bool dynamicTiles = UseDynamicTiles();
+  // accumulated pixels restored from a checkpoint are part of the image
+  if (accumBuffer != nullptr) {
+    for (size_t i = 0; i < pixelSize[0] * pixelSize[1]; ++i) {
+      if (accumCountBuffer[i] > 0) { maskBuffer[i] = 1; }
     }
-
-  });
+  }
+  // dynamic tiles are only known once they are claimed
+  if (param.denoise && !dynamicTiles) { RenderFeatures(); }
+  if (forwarding != nullptr) {
+    DistributedRender();
+  } else if (param.timeBudget > 0.f) {
+    TimedRender();
+  } else if (param.adaptiveSPP > 0) {
+    AdaptiveRender();
+  } else if (param.progressiveSPP > 0) {
+    ProgressiveRender();
+  } else if (dynamicTiles) {
+    DynamicTileRender([&](size_t k, const size_t *region) {
+      if (param.denoise) { RenderTileFeatures(region); }
+      if (param.integrator == INTEGRATOR_WAVEFRONT) {
+        WavefrontTileRender(region);
+        return;
+      }
+      for (size_t j = region[1]; j < region[3]; ++j) {
+        for (size_t i = region[0]; i < region[2]; ++i) {
+          if (!tasking::has_stop_signal()) { PixelRender(i, j, k); }
+        }
+      }
+    });
+  } else if (param.integrator == INTEGRATOR_WAVEFRONT) {
+    RenderTileBatches([&](const std::vector<size_t> &tiles) {
+      TileRegionRender([&](size_t, const size_t *region) {
+        WavefrontTileRender(region);
+      }, &tiles);
+    });
+  } else {
+    RenderTileBatches([&](const std::vector<size_t> &tiles) {
+      TileRender([&](size_t i, size_t j, size_t k) {
+        PixelRender(i, j, k);
+      }, &tiles);
+    });
+  }
+  // with several ranks the image is filtered once it is gathered
+  if (param.denoise && mpiSize == 1) {
+    const double t = Denoise();
+    printf("\nrank %zu: denoised in %f s\n", mpiRank, t);
+  }
+  if (param.checkpointInterval > 0.f) { SaveCheckpoint(); }
   //-------------------------------------------------------------------------//
   // Stop timing
   //-------------------------------------------------------------------------//
   StopTimer();
+  if (param.reportRayStats) {
+    const size_t numLocalPixels = NumLocalPixels();
+    printf("rank %zu traced %zu rays, %.1f rays per pixel\n", mpiRank,
+           numRays.load(), numRays / static_cast<double>(numLocalPixels));
+  }
+}
+///--------------------------------------------------------------------------//
+/// Re-render the tiles whose dependency sets contain one of the edited
+/// items, all the other pixels keep their values. Accumulated tiles are
+/// restarted with the number of samples they had. Photons carry the light
+/// of every material and light, so with a photon map the maps are rebuilt
+/// and the whole image is rendered again. Returns the number of pixels
+/// rendered.
+///--------------------------------------------------------------------------//
+size_t Renderer::RenderDirty(const std::vector<const ItemBase *> &edited)
+{
+  std::vector<size_t> dirty;
+  if (scene->usePhotonMap) {
+    photonsCurrent = false;
+    BuildPhotonMaps();
+    dirty = localTiles;
+  } else if (tileDeps.empty()) {
+    if (mpiRank == 0) {
+      printf("\nWarning: no dependencies were recorded, "
+             "rendering the full image\n");
+    }
+    dirty = localTiles;
+  } else {
+    for (auto k : localTiles) {
+      const auto &deps = tileDeps[k];
+      for (auto item : edited) {
+        if (std::find(deps.begin(), deps.end(), item) != deps.end()) {
+          dirty.push_back(k);
+          break;
+        }
+      }
+    }
+  }
+  size_t numPixels = 0;
+  for (auto k : dirty) {
+    size_t region[4];
+    TileRegion(k, region);
+    numPixels += (region[2] - region[0]) * (region[3] - region[1]);
+    if (!tileDeps.empty()) { tileDeps[k].clear(); } // recorded again
+  }
+  numRays = 0;
+  // the albedo of the edited materials changed
+  if (param.denoise) { RenderFeatures(); }
+  if (param.UseAccumulation()) {
+    TileRegionRender([&](size_t, const size_t *region) {
+      size_t spp = 0;
+      for (size_t j = region[1]; j < region[3]; ++j) {
+        for (size_t i = region[0]; i < region[2]; ++i) {
+          const size_t idx =
+              (j - pixelRegion[1]) * pixelSize[0] + i - pixelRegion[0];
+          spp = MAX(spp, static_cast<size_t>(accumCountBuffer[idx]));
+          accumBuffer[idx] = Color3f(0.f);
+          accumM2Buffer[idx] = 0.f;
+          accumCountBuffer[idx] = 0;
+        }
+      }
+      ProgressiveTileRender(region, spp);
+    }, &dirty);
+    qaUINT sppMax = 1;
+    for (size_t i = 0; i < pixelSize[0] * pixelSize[1]; ++i) {
+      sppMax = MAX(sppMax, accumCountBuffer[i]);
+    }
+    image->ResolveAccumulation(param.useSRGB, sppMax);
+  } else if (param.integrator == INTEGRATOR_WAVEFRONT) {
+    TileRegionRender([&](size_t, const size_t *region) {
+      WavefrontTileRender(region);
+    }, &dirty);
+  } else {
+    TileRender([&](size_t i, size_t j, size_t k) {
+      PixelRender(i, j, k);
+    }, &dirty);
+  }
+  if (param.denoise && mpiSize == 1) { Denoise(); }
+  printf("\nrank %zu re-rendered %zu of %zu tiles, %zu pixels, %zu rays\n",
+         mpiRank, dirty.size(), localTiles.size(), numPixels, numRays.load());
+  return numPixels;
+}
+void Renderer::RenderEdits(const std::vector<const ItemBase *> &edited)
+{
+  StartTimer();
+  tasking::init();
+  RenderDirty(edited);
+  StopTimer();
+}
+///--------------------------------------------------------------------------//
+/// Set the scene to every frame in turn and render it, the images of a
+/// frame are written as soon as it is done. Meshes, their BVHs and the
+/// textures stay loaded, the photon maps are kept while no node moves
+/// (lights are not animated).
+///--------------------------------------------------------------------------//
+void Renderer::RenderAnimation(FrameBuffer &fb, Scene &sc, Animation &anim,
+                               int first, int last)
+{
+  for (int f = first; f <= last && !Interrupted(); ++f) {
+    const auto t0 = std::chrono::steady_clock::now();
+    if (anim.Apply(sc, f)) { photonsCurrent = false; }
+    frame = f;
+    startTime = t0; // the time budget is per frame
+    ComputeScene(fb, sc);
+    Render();
+    if (mpiRank == 0) {
+      const std::chrono::duration<double> dt =
+          std::chrono::steady_clock::now() - t0;
+      printf("\nFrame %d of %d done in %f s\n", f, last, dt.count());
+    }
+  }
 }
 }
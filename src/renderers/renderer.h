@@ -34,24 +34,60 @@
 #include <iostream>
 #include <atomic>
 #include <algorithm>
+#include <chrono>
 #include <functional>
+#include <string>
+#include <vector>
 ///--------------------------------------------------------------------------//
 #include "math/math.h"
 #include "scene/scene.h"
+#include "scene/animation.h"
+#include "renderers/wavefront.h"
+#include "renderers/forwarding.h"
+#include "renderers/iterative.h"
 ///--------------------------------------------------------------------------//
-#include "tasking/parallel_for.h"
+#include "tasking/parallel_range.h"
 ///--------------------------------------------------------------------------//
 
 namespace qaray {
 ///--------------------------------------------------------------------------//
+enum IntegratorType {
+  INTEGRATOR_RECURSIVE, // Material::Shade recursion
+  INTEGRATOR_WAVEFRONT, // see wavefront.h
+  INTEGRATOR_ITERATIVE  // see iterative.h
+};
 struct RendererParam {
   qaBOOL useSRGB = true;
   size_t sppMax = 8;
+  qaBOOL sppMaxFixed = false; // sppMax was given, it also caps timed renders
   size_t sppMin = 4;
   qaBOOL usePhotonMap = false;
   size_t photonMapSize = size_t(10000);
   size_t photonMapBounce = 20;
   qaFLOAT photonMapRadius = 0.2f;
+  size_t progressiveSPP = 0; // samples per pass, 0 disables progressive mode
+  size_t adaptiveSPP = 0;    // average spp budget of the adaptive scheduler
+  qaFLOAT adaptiveError = 0.01f; // relative error at which a tile is done
+  qaFLOAT timeBudget = 0.f;  // seconds, renders passes until the deadline
+  size_t tileSize = 0;       // tile size in pixels, 0 picks one automatically
+  qaBOOL reportTileStats = false; // print per-thread load after every pass
+  IntegratorType integrator = INTEGRATOR_RECURSIVE;
+  size_t rouletteDepth = 3;  // bounces before Russian roulette (iterative)
+  qaBOOL reportRayStats = false; // print the number of rays traced
+  qaBOOL useCrop = false;    // render only the crop window
+  size_t crop[4] = {0};      // crop window [x0 y0 x1 y1) in pixels
+  qaBOOL trackDependencies = false; // record the items every tile depends on
+  qaFLOAT checkpointInterval = 0.f; // seconds between checkpoints, 0 = off
+  qaBOOL checkpointPhotons = false; // also store the photon maps
+  qaBOOL resume = false;     // continue from the checkpoint of the last run
+  qaBOOL blueNoise = false;  // blue-noise error distribution, see Sampler_Sobol
+  qaBOOL denoise = false;    // filter the final image, see fb/denoiser.h
+  qaBOOL denoisePasses = false; // also filter the image after every pass
+  qaBOOL saveAccumulation = false; // write the raw samples, see fb/accumfile.h
+  qaBOOL dynamicTiles = false; // ranks claim tiles at run time (single pass)
+  qaBOOL sampleSplit = false; // ranks share the pixels and split the samples
+  qaBOOL nodeShared = false; // one copy of the scene per host, see sharing.h
+  qaBOOL dataDistributed = false; // meshes split over ranks, see forwarding.h
   size_t causticsMapSize = size_t(1000);
   size_t causticsMapBounce = 20;
   qaFLOAT causticsMapRadius = 1.0f;
@@ -62,9 +98,58 @@ struct RendererParam {
   void SetCausticsMapBounce(size_t b) { causticsMapBounce = b; }
   void SetCausticsMapSize(size_t sz) { causticsMapSize = sz; }
   void SetCausticsMapRadius(qaFLOAT r) { causticsMapRadius = r; }
-  void SetSPPMax(int spp) { sppMax = static_cast<size_t>(spp); }
+  void SetSPPMax(int spp)
+  {
+    sppMax = static_cast<size_t>(spp);
+    sppMaxFixed = true;
+  }
   void SetSPPMin(int spp) { sppMin = static_cast<size_t>(spp); }
   void SetSRGBFlag(bool flag) { useSRGB = flag; }
+  void SetProgressiveSPP(int spp) { progressiveSPP = static_cast<size_t>(spp); }
+  void SetAdaptiveSPP(int spp) { adaptiveSPP = static_cast<size_t>(spp); }
+  void SetAdaptiveError(qaFLOAT e) { adaptiveError = e; }
+  void SetTimeBudget(qaFLOAT seconds) { timeBudget = seconds; }
+  void SetTileSize(int size) { tileSize = static_cast<size_t>(size); }
+  void SetTileStatsFlag(bool flag) { reportTileStats = flag; }
+  void SetIntegrator(IntegratorType type) { integrator = type; }
+  void SetRouletteDepth(int d) { rouletteDepth = static_cast<size_t>(d); }
+  void SetRayStatsFlag(bool flag) { reportRayStats = flag; }
+  void SetCropWindow(int x0, int y0, int x1, int y1)
+  {
+    useCrop = true;
+    crop[0] = static_cast<size_t>(MAX(x0, 0));
+    crop[1] = static_cast<size_t>(MAX(y0, 0));
+    crop[2] = static_cast<size_t>(MAX(x1, 0));
+    crop[3] = static_cast<size_t>(MAX(y1, 0));
+  }
+  void SetDependencyFlag(bool flag) { trackDependencies = flag; }
+  void SetCheckpointInterval(qaFLOAT seconds) { checkpointInterval = seconds; }
+  void SetCheckpointPhotonsFlag(bool flag) { checkpointPhotons = flag; }
+  void SetResumeFlag(bool flag) { resume = flag; }
+  void SetBlueNoiseFlag(bool flag) { blueNoise = flag; }
+  void SetDenoiseFlag(bool flag) { denoise = flag; }
+  void SetDenoisePassesFlag(bool flag) { denoisePasses = flag; }
+  void SetSaveAccumulationFlag(bool flag) { saveAccumulation = flag; }
+  void SetDynamicTilesFlag(bool flag) { dynamicTiles = flag; }
+  void SetSampleSplitFlag(bool flag) { sampleSplit = flag; }
+  void SetNodeSharedFlag(bool flag) { nodeShared = flag; }
+  void SetDataDistributedFlag(bool flag) { dataDistributed = flag; }
+  qaBOOL UseAccumulation() const
+  {
+    return progressiveSPP > 0 || adaptiveSPP > 0 || timeBudget > 0.f;
+  }
+  //! the other modes fill the accumulation buffers too when they are read
+  //! after the render
+  qaBOOL KeepAccumulation() const
+  {
+    return UseAccumulation() || denoise || saveAccumulation;
+  }
+  //! samples per pixel at which the accumulating modes stop, timed renders
+  //! are only limited by the clock unless sppMax was given
+  size_t SampleLimit() const
+  {
+    return (timeBudget > 0.f && !sppMaxFixed) ? size_t(1) << 24 : sppMax;
+  }
 };
 ///--------------------------------------------------------------------------//
 class Renderer {
@@ -80,6 +165,10 @@ class Renderer {
   qaUCHAR *sampleCountBuffer;
   qaUCHAR *irradianceCountBuffer;
   qaUCHAR *maskBuffer;
+  Color3f *accumBuffer = nullptr; // linear radiance sums (progressive mode
+                                  // or denoiser input)
+  qaUINT *accumCountBuffer = nullptr;
+  qaFLOAT *accumM2Buffer = nullptr;
   //! canvas
   size_t pixelW, pixelH;       // global size in pixel
   size_t pixelRegion[4] = {0}; // local image offset [x y]
@@ -90,24 +179,134 @@ class Renderer {
   Point3 screenX, screenY, screenZ;
   Point3 screenU, screenV, screenA;
   //! multi-threading information
-  const size_t tileSize = 4; // this value should be platform dependent
+  size_t tileSize = 4;
   size_t tileDimX = 0;
   size_t tileDimY = 0;
   size_t tileCount = 0;
+  std::vector<size_t> localTiles; // tiles of this rank in Morton order
+  std::vector<size_t> tileOrder;  // all the tiles in Morton order
+  std::atomic<size_t> nextTile;   // next entry of tileOrder to claim
+  std::vector<int> tileNode;      // memory node of every tile (NUMA mode)
+  //! materials and lights seen by every tile, for dirty-region renders
+  std::vector<std::vector<const ItemBase *>> tileDeps;
+  //! wavefront integrator of every thread
+  tasking::ThreadLocalStorage<WavefrontIntegrator> wavefront;
+  tasking::ThreadLocalStorage<IterativeIntegrator> iterative;
+  //! rays traced by the tile kernels
+  std::atomic<size_t> numRays;
+  //! pixels of the tiles rendered so far and in total, for the progress
+  std::atomic<size_t> progressPixels;
+  size_t progressTotal = 1;
+  //! progressive rendering
+  size_t numPasses = 1; // number of passes, or sample budget when adaptive
+  //! local sample s of a pixel is sample s * sampleStride + sampleOffset
+  //! of its sequence, see UseSampleSplit
+  size_t sampleStride = 1;
+  size_t sampleOffset = 0;
+  //! progress of the current render, saved in checkpoints
+  struct RenderProgress {
+    size_t passes = 0;  // passes (progressive) or rounds (adaptive) done
+    size_t samples = 0; // spp done (timed) or samples spent (adaptive)
+    std::vector<size_t> tiles; // samples (adaptive) or 1 once rendered
+  } progress;
+  std::chrono::steady_clock::time_point lastCheckpoint;
+  bool photonsRestored = false; // photon maps were read from a checkpoint
+  bool photonsCurrent = false;  // photon maps match the scene geometry
+  //! frame of an animation, -1 for a single image
+  int frame = -1;
+  //! the time budget counts from the creation of the renderer
+  std::chrono::steady_clock::time_point startTime;
   //! MPI information
   size_t mpiSize = 1;
   size_t mpiRank = 0;
+  //! exchanges of a data-distributed render, null otherwise
+  RayForwarding *forwarding = nullptr;
  public:
   explicit Renderer(RendererParam &param);
   void ComputeScene(FrameBuffer &renderImage, Scene &scene);
+  void BuildPhotonMaps();
   void ThreadRender();
+  size_t RenderDirty(const std::vector<const ItemBase *> &edited);
+  void TracePhotons(PhotonMap &pm, const std::vector<Light *> &photonLights,
+                    bool caustics);
+  void SavePhotons(PhotonMap &pm, const char *file);
+  //! Replace the photons of 'map' by those of all ranks, in rank order,
+  //! and 'numEmitted' by the paths emitted by all ranks. When the scene is
+  //! shared by the ranks of a host only the loaders receive the photons.
+  virtual void GatherPhotons(cyPhotonMap &map, size_t &numEmitted);
+  //! Keep a single copy of a prepared photon map per host, and free it
+  //! before the map is traced again (see NodeSharing)
+  void SharePhotons(PhotonMap &pm);
+  void UnsharePhotons(PhotonMap &pm);
+  void ComputeTiles();
+  void SortTilesMorton(std::vector<size_t> &tiles) const;
+  void TileRegion(size_t k, size_t region[4]) const;
+  void TileRegionRender(const std::function<void(size_t, const size_t *)>
+                        &kernel, const std::vector<size_t> *tiles = nullptr);
+  void TileRender(const std::function<void(size_t, size_t, size_t)> &kernel,
+                  const std::vector<size_t> *tiles = nullptr);
+  void RenderTile(size_t k, const std::function<void(size_t, const size_t *)>
+                  &kernel);
+  void DynamicTileRender(const std::function<void(size_t, const size_t *)>
+                         &kernel);
+  bool UseDynamicTiles() const;
+  //! Every rank renders all the pixels with its own share of the samples,
+  //! the accumulation buffers of the ranks are added up at the end
+  bool UseSampleSplit() const;
+  //! Samples per pixel at which this rank stops
+  size_t LocalSampleLimit() const;
+  //! Pixels rendered by this rank
+  size_t NumLocalPixels() const;
+  //! Claim 'n' entries of tileOrder, returns the index of the first one
+  //! (which may be past the end). All ranks share the counter.
+  virtual size_t ClaimTiles(size_t n);
+  virtual void ResetTileClaims();
+  DiffRay CameraRay(size_t i, size_t j, SuperSampler &sampler, Point3 &uv);
+  Color3f SampleRender(size_t i, size_t j, SuperSampler &sampler, float &depth);
   void PixelRender(size_t i, size_t j, size_t tile_idx);
+  void ProgressivePixelRender(size_t i, size_t j, size_t spp);
+  size_t ProgressiveTileRender(const size_t region[4], size_t spp);
+  void WavefrontSamples(const size_t region[4],
+                        const std::vector<SuperSampler *> &samplers,
+                        float *depth);
+  void WavefrontTileRender(const size_t region[4]);
+  size_t WavefrontProgressiveTileRender(const size_t region[4], size_t spp);
+  void ProgressiveRender();
+  //! Render the local tiles when every rank only holds a part of the
+  //! meshes, see RayForwarding
+  void DistributedRender();
+  void ComputeTileError(std::vector<float> &tileError) const;
+  void RenderFeatures();
+  void RenderTileFeatures(const size_t region[4]);
+  double Denoise();
+  void AdaptiveRender();
+  void TimedRender();
+  void RenderTileBatches(const std::function<void(const std::vector<size_t> &)>
+                         &render);
+  qaUINT RenderMode() const;
+  std::string CheckpointFile() const;
+  //! "_<frame>" suffix of the output files, empty for a single image
+  std::string FrameSuffix() const;
+  bool SaveCheckpoint();
+  //! Write the accumulation buffers of this rank
+  bool SaveAccumulation(const std::string &file) const;
+  bool LoadCheckpoint();
+  void CheckpointIfDue();
   virtual void StartTimer();
   virtual void StopTimer();
   virtual void KillTimer();
   virtual void Init();
   virtual void Terminate();
   virtual void Render() = 0;
+  //! Re-render what the edited items (materials or lights, replaced in the
+  //! scene already) touched during the last render
+  virtual void RenderEdits(const std::vector<const ItemBase *> &edited);
+  //! Render frames [first, last] of an animation with the scene kept
+  //! loaded, photon maps are only rebuilt when the geometry moved
+  void RenderAnimation(FrameBuffer &renderImage, Scene &scene,
+                       Animation &anim, int first, int last);
+  //! Whether the user asked to stop (Ctrl-C)
+  virtual bool Interrupted() const { return false; }
 };
 }
 
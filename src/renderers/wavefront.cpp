@@ -0,0 +1,192 @@
+//------------------------------------------------------------------------------
+///
+/// \file       wavefront.cpp
+/// \author     Qi WU
+///
+/// \brief Wavefront path tracer
+///
+//------------------------------------------------------------------------------
+
+#include "wavefront.h"
+#include "forwarding.h"
+#include "materials/materials.h"
+#include "tasking/parallel_range.h"
+#include <algorithm>
+
+namespace qaray {
+//! The rays of a stage are spread over the tasking pool when the wave is
+//! traced by the main thread of a data-distributed render, the integrators
+//! of the tile kernels run on a worker thread already
+template<typename Body>
+static void ForEachRay(size_t n, bool parallel, const Body &body)
+{
+  if (!parallel) {
+    for (size_t i = 0; i < n; ++i) { body(i); }
+    return;
+  }
+  const tasking::blocked_range<size_t> range(0, n, 256);
+  tasking::parallel_for(range, [&](const tasking::blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i < r.end(); ++i) { body(i); }
+  });
+}
+///--------------------------------------------------------------------------//
+void PathQueue::Clear()
+{
+  ray.clear();
+  throughput.clear();
+  absorption.clear();
+  sample.clear();
+  bounce.clear();
+  diffuseHit.clear();
+  path.clear();
+}
+void PathQueue::Push(const DiffRay &r, const Color3f &weight,
+                     const Color3f &sigma, qaUINT s, qaINT b, bool diffuse,
+                     qaUINT key)
+{
+  ray.push_back(r);
+  throughput.push_back(weight);
+  absorption.push_back(sigma);
+  sample.push_back(s);
+  bounce.push_back(b);
+  diffuseHit.push_back(static_cast<qaUCHAR>(diffuse));
+  path.push_back(key);
+}
+///--------------------------------------------------------------------------//
+/// Every path of the queue is traced once. Misses pick up the background
+/// (camera rays) or the environment, and hits seen from inside are
+/// attenuated by the medium the path went through, as in the recursive
+/// ComputeSecondaryRay.
+///--------------------------------------------------------------------------//
+void WavefrontIntegrator::Intersect(Scene &scene, CameraWave &wave,
+                                    bool primary)
+{
+  const size_t n = current.Size();
+  hits.resize(n);
+  found.resize(n);
+  ForEachRay(n, forwarding != nullptr, [&](size_t i) {
+    DiffHitInfo &hInfo = hits[i];
+    hInfo.Init();
+    hInfo.c.hasDiffuseHit = current.diffuseHit[i] != 0;
+    found[i] = scene.TraceNodeNormal(scene.rootNode, current.ray[i], hInfo);
+  });
+  // the meshes of the other processes may hold closer hits
+  if (forwarding != nullptr) {
+    forwarding->Intersect(current.ray, hits, found);
+  }
+  active.clear();
+  for (size_t i = 0; i < n; ++i) {
+    const qaUINT s = current.sample[i];
+    const DiffHitInfo &hInfo = hits[i];
+    if (!found[i]) {
+      wave.radiance[s] += current.throughput[i] * (primary ?
+          scene.background.Sample(wave.uv[s]) :
+          scene.environment.SampleEnvironment(current.ray[i].c.dir));
+      continue;
+    }
+    if (primary) { wave.depth[s] = hInfo.c.z; }
+    if (!hInfo.c.hasFrontHit) {
+      current.throughput[i] *= Attenuation(current.absorption[i], hInfo.c.z);
+    }
+    active.push_back(static_cast<qaUINT>(i));
+  }
+}
+///--------------------------------------------------------------------------//
+/// Group the hits by material so that the shading stage runs the same code
+/// on consecutive paths
+///--------------------------------------------------------------------------//
+void WavefrontIntegrator::SortByMaterial()
+{
+  keys.resize(current.Size());
+  for (auto i : active) {
+    keys[i] = std::make_pair(hits[i].c.node->GetMaterial(), hits[i].c.mtlID);
+  }
+  std::sort(active.begin(), active.end(), [&](qaUINT a, qaUINT b) {
+    return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+  });
+}
+///--------------------------------------------------------------------------//
+/// Resolve the local shading of every hit. Materials that support it hand
+/// back their shadow rays and continuation rays, the others are shaded
+/// recursively. Every path vertex draws from its own random stream, so the
+/// order in which the paths are shaded does not matter.
+///--------------------------------------------------------------------------//
+void WavefrontIntegrator::Shade(Scene &scene, CameraWave &wave)
+{
+  next.Clear();
+  shadows.clear();
+  shadowSample.clear();
+  Sampler_Counter &sampler = rng->local();
+  for (auto i : active) {
+    const qaUINT s = current.sample[i];
+    const Color3f &weight = current.throughput[i];
+    const Material *mtl = keys[i].first;
+    sampler.StartSample(wave.pixel[s], wave.sample[s]);
+    sampler.SetPath(current.path[i]);
+    rec.Clear();
+    if (!mtl->Scatter(current.ray[i], hits[i], scene.lights,
+                      current.bounce[i], rec))
+    {
+      wave.radiance[s] += weight * mtl->Shade(current.ray[i], hits[i],
+                                              scene.lights, current.bounce[i]);
+      continue;
+    }
+    wave.radiance[s] += weight * rec.radiance;
+    for (auto &sr : rec.shadows) {
+      shadows.push_back({weight * sr.contrib, sr.ray, sr.tMax});
+      shadowSample.push_back(s);
+    }
+    for (size_t k = 0; k < rec.rays.size(); ++k) {
+      const ScatterRay &r = rec.rays[k];
+      next.Push(r.ray, weight * r.weight, r.absorption, s,
+                current.bounce[i] - 1, r.diffuseHit,
+                Sampler_Counter::NextPath(current.path[i],
+                                          static_cast<qaUINT>(k)));
+    }
+  }
+}
+///--------------------------------------------------------------------------//
+void WavefrontIntegrator::TraceShadows(Scene &scene, CameraWave &wave)
+{
+  occluded.resize(shadows.size());
+  ForEachRay(shadows.size(), forwarding != nullptr, [&](size_t k) {
+    HitInfo hInfo;
+    hInfo.z = shadows[k].tMax;
+    occluded[k] =
+        scene.TraceNodeShadow(scene.rootNode, shadows[k].ray, hInfo);
+  });
+  if (forwarding != nullptr) { forwarding->Occluded(shadows, occluded); }
+  for (size_t k = 0; k < shadows.size(); ++k) {
+    if (!occluded[k]) { wave.radiance[shadowSample[k]] += shadows[k].contrib; }
+  }
+}
+///--------------------------------------------------------------------------//
+void WavefrontIntegrator::Trace(Scene &scene, CameraWave &wave,
+                                RayForwarding *forwarding)
+{
+  this->forwarding = forwarding;
+  const size_t n = wave.Size();
+  wave.radiance.assign(n, Color3f(0.f));
+  wave.depth.assign(n, BIGFLOAT);
+  // generate
+  current.Clear();
+  for (size_t s = 0; s < n; ++s) {
+    current.Push(wave.ray[s], Color3f(1.f), Color3f(0.f),
+                 static_cast<qaUINT>(s), Material::maxBounce, false,
+                 Sampler_Counter::NextPath(0, 0));
+  }
+  bool primary = true;
+  // the processes of a data-distributed render serve each other's rays
+  // until all of them are done
+  while (forwarding != nullptr ? forwarding->AnyActive(current.Size() > 0) :
+         current.Size() > 0) {
+    Intersect(scene, wave, primary);
+    SortByMaterial();
+    Shade(scene, wave);
+    TraceShadows(scene, wave);
+    // continuations become the next wave
+    std::swap(current, next);
+    primary = false;
+  }
+}
+}
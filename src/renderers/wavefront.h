@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+///
+/// \file       wavefront.h
+/// \author     Qi WU
+///
+/// \brief Wavefront path tracer. Instead of recursing in Material::Shade, a
+///        whole batch of camera paths is advanced one bounce at a time by
+///        separate stages: intersect, sort by material, shade and trace
+///        shadow rays. Path states live in structure-of-arrays queues, the
+///        continuations of a bounce are compacted into the next queue.
+///        In data-distributed renders the intersect and shadow stages also
+///        forward their rays to the other processes (see forwarding.h).
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_WAVEFRONT_H
+#define QARAY_WAVEFRONT_H
+#pragma once
+
+#include <cstddef>
+#include <vector>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+#include "scene/scene.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Camera samples of a wave. The caller fills 'ray', 'uv' (background
+//! coordinate of the sample) and the random stream of the sample ('pixel'
+//! and 'sample', see Sampler_Counter), Trace() fills 'radiance' and 'depth'.
+struct CameraWave {
+  std::vector<DiffRay> ray;
+  std::vector<Point3> uv;
+  std::vector<qaUINT> pixel;
+  std::vector<qaUINT> sample;
+  std::vector<Color3f> radiance;
+  std::vector<float> depth;
+  size_t Size() const { return ray.size(); }
+  void Clear()
+  {
+    ray.clear();
+    uv.clear();
+    pixel.clear();
+    sample.clear();
+  }
+  void Push(const DiffRay &r, const Point3 &texcoord, qaUINT p, qaUINT s)
+  {
+    ray.push_back(r);
+    uv.push_back(texcoord);
+    pixel.push_back(p);
+    sample.push_back(s);
+  }
+};
+///--------------------------------------------------------------------------//
+//! Paths alive at one bounce, one array per field
+struct PathQueue {
+  std::vector<DiffRay> ray;
+  std::vector<Color3f> throughput;
+  std::vector<Color3f> absorption; // of the medium the ray travels through
+  std::vector<qaUINT> sample;      // camera sample the path belongs to
+  std::vector<qaINT> bounce;       // bounces left
+  std::vector<qaUCHAR> diffuseHit;
+  std::vector<qaUINT> path;        // random stream of the next vertex
+  size_t Size() const { return ray.size(); }
+  void Clear();
+  void Push(const DiffRay &r, const Color3f &weight, const Color3f &sigma,
+            qaUINT s, qaINT b, bool diffuse, qaUINT key);
+};
+///--------------------------------------------------------------------------//
+class RayForwarding;
+class WavefrontIntegrator {
+ private:
+  //! queues are kept between waves to avoid reallocating them
+  PathQueue current, next;
+  std::vector<DiffHitInfo> hits;
+  std::vector<qaUCHAR> found; // paths of 'current' with a hit in 'hits'
+  std::vector<qaUINT> active; // paths of 'current' that hit something
+  std::vector<std::pair<const Material *, qaINT>> keys;
+  std::vector<ShadowRequest> shadows;
+  std::vector<qaUINT> shadowSample;
+  std::vector<qaUCHAR> occluded;
+  ScatterRecord rec;
+  RayForwarding *forwarding = nullptr;
+ public:
+  //! Trace all the camera samples of the wave. With 'forwarding' the call
+  //! is collective, every bounce runs on all the processes until none of
+  //! them has paths left, and the rays of a stage are traced by all the
+  //! threads of the tasking pool.
+  void Trace(Scene &scene, CameraWave &wave,
+             RayForwarding *forwarding = nullptr);
+ private:
+  void Intersect(Scene &scene, CameraWave &wave, bool primary);
+  void SortByMaterial();
+  void Shade(Scene &scene, CameraWave &wave);
+  void TraceShadows(Scene &scene, CameraWave &wave);
+};
+}
+
+#endif //QARAY_WAVEFRONT_H
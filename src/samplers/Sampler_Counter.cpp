@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+///
+/// \file       Sampler_Counter.cpp
+/// \author     Qi WU
+///
+/// \brief Counter-based random numbers
+///
+//------------------------------------------------------------------------------
+
+#include "Sampler_Counter.h"
+
+namespace qaray {
+static qaUINT globalSeed = 0;
+void Sampler_Counter::SetSeed(qaUINT seed) { globalSeed = seed; }
+qaUINT Sampler_Counter::GetSeed() { return globalSeed; }
+///--------------------------------------------------------------------------//
+/// pcg4d hash, from Jarzynski and Olano, "Hash Functions for GPU Rendering"
+/// (JCGT 2020). All four outputs depend on all four inputs.
+///--------------------------------------------------------------------------//
+static inline void Pcg4d(qaUINT v[4])
+{
+  for (int i = 0; i < 4; ++i) { v[i] = v[i] * 1664525U + 1013904223U; }
+  v[0] += v[1] * v[3];
+  v[1] += v[2] * v[0];
+  v[2] += v[0] * v[1];
+  v[3] += v[1] * v[2];
+  for (int i = 0; i < 4; ++i) { v[i] ^= v[i] >> 16; }
+  v[0] += v[1] * v[3];
+  v[1] += v[2] * v[0];
+  v[2] += v[0] * v[1];
+  v[3] += v[1] * v[2];
+}
+qaUINT Sampler_Counter::NextPath(qaUINT path, qaUINT child)
+{
+  qaUINT v[4] = {path, child, 0x9e3779b9U, 0x85ebca6bU};
+  Pcg4d(v);
+  return v[0] | 1U; // 0 is the camera path
+}
+void Sampler_Counter::StartSample(qaUINT p, qaUINT s)
+{
+  pixel = p;
+  sample = s;
+  SetPath(0);
+}
+void Sampler_Counter::SetPath(qaUINT p)
+{
+  path = p;
+  dim = 0;
+  numLanes = 0;
+}
+qaUINT Sampler_Counter::DimensionKey(qaUINT d, bool withPixel) const
+{
+  qaUINT v[4] = {withPixel ? pixel : 0U, path ^ (globalSeed * 0x27d4eb2dU),
+                 d, 0x165667b1U};
+  Pcg4d(v);
+  return v[0];
+}
+//! the 24 high bits give a float in [0, 1)
+qaFLOAT Sampler_Counter::Next()
+{
+  if (numLanes == 0) {
+    lanes[0] = pixel;
+    lanes[1] = sample;
+    lanes[2] = path ^ (globalSeed * 0x27d4eb2dU);
+    lanes[3] = dim++;
+    Pcg4d(lanes);
+    numLanes = 4;
+  }
+  return static_cast<qaFLOAT>(lanes[--numLanes] >> 8) * (1.f / 16777216.f);
+}
+void Sampler_Counter::Get1f(qaFLOAT &r1) { r1 = Next(); }
+void Sampler_Counter::Get2f(qaFLOAT &r1, qaFLOAT &r2)
+{
+  r1 = Next();
+  r2 = Next();
+}
+void Sampler_Counter::Get3f(qaFLOAT &r1, qaFLOAT &r2, qaFLOAT &r3)
+{
+  r1 = Next();
+  r2 = Next();
+  r3 = Next();
+}
+void Sampler_Counter::GetNf(qaFLOAT *r, size_t n)
+{
+  for (size_t i = 0; i < n; ++i) { r[i] = Next(); }
+}
+}
@@ -0,0 +1,60 @@
+//------------------------------------------------------------------------------
+///
+/// \file       Sampler_Counter.h
+/// \author     Qi WU
+///
+/// \brief Counter-based random numbers. Every number is a hash of a key
+///        (pixel, sample index, path, dimension) instead of the next state
+///        of a generator, so a sample draws the same numbers whichever
+///        thread or rank renders it and in whatever order. The renderer
+///        sets the key of the sample and of every path vertex, the
+///        dimension counts the numbers drawn since.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_SAMPLER_COUNTER_H
+#define QARAY_SAMPLER_COUNTER_H
+#pragma once
+
+#include <cstddef>
+#include "core/sampler.h"
+#include "math/math.h"
+
+namespace qaray {
+class Sampler_Counter : public Sampler {
+ protected:
+  qaUINT pixel = 0, sample = 0, path = 0;
+  qaUINT dim = 0;        // next counter of the key
+  //! Hash of (pixel, path, seed, dimension 'd') that does not depend on the
+  //! sample. Without 'withPixel' the key is the same in every pixel.
+  qaUINT DimensionKey(qaUINT d, bool withPixel) const;
+ private:
+  qaUINT lanes[4];       // one hash gives four numbers
+  qaUINT numLanes = 0;   // lanes not used yet
+  qaFLOAT Next();
+ public:
+  //! Start the camera sample 'sample' of a pixel, its camera path is 0
+  void StartSample(qaUINT pixel, qaUINT sample);
+  //! Continue the current sample on another path vertex
+  void SetPath(qaUINT path);
+  qaUINT GetPath() const { return path; }
+  qaUINT GetPixel() const { return pixel; }
+  qaUINT GetSample() const { return sample; }
+  //! Key of the 'child'-th vertex following 'path'
+  static qaUINT NextPath(qaUINT path, qaUINT child);
+  //! Global seed mixed into every key, 0 by default
+  static void SetSeed(qaUINT seed);
+  static qaUINT GetSeed();
+  //! Pixel indices reserved for the photon paths of the global and the
+  //! caustics maps
+  static const qaUINT photonPixel = 0xffffffffU;
+  static const qaUINT causticsPixel = 0xfffffffeU;
+  void Get1f(qaFLOAT &r1) override;
+  void Get2f(qaFLOAT &r1, qaFLOAT &r2) override;
+  void Get3f(qaFLOAT &r1, qaFLOAT &r2, qaFLOAT &r3) override;
+  //! Batch generation of n numbers
+  virtual void GetNf(qaFLOAT *r, size_t n);
+};
+}
+
+#endif //QARAY_SAMPLER_COUNTER_H
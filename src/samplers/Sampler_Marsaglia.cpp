@@ -26,34 +26,46 @@
 
 #include <ctime>
 #include <cstdlib>
+#include <atomic>
 #include "Sampler_Marsaglia.h"
 
 namespace qaray {
+//! every sampler draws its own stream, seeded from the run seed and the
+//! index of the stream
+static const qaUINT streamSeed = static_cast<qaUINT>(time(nullptr));
+static std::atomic<qaUINT> streamCount(0);
+//! integer hash (lowbias32 by Chris Wellons)
+static qaUINT Hash(qaUINT x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
 void Sampler_Marsaglia::Init() {
   if (!initialized) {
     /* The seed word must be initialized to non-zero */
-    srand (static_cast<unsigned int>(time(nullptr)));
-    seed[0] = static_cast<qaUINT>(rand()) % 999999999 + 1;
-    seed[1] = static_cast<qaUINT>(rand()) % 999999999 + 1;
-    seed[2] = static_cast<qaUINT>(rand()) % 999999999 + 1;
-    seed[3] = static_cast<qaUINT>(rand()) % 999999999 + 1;
+    const qaUINT stream = streamCount++;
+    for (qaUINT k = 0; k < 4; ++k) {
+      seed[k] = Hash(Hash(streamSeed) ^ (4 * stream + k)) % 999999999 + 1;
+    }
     initialized = true;
   }
 }
 qaFLOAT Sampler_Marsaglia::xorshift32(qaUINT state[4])
 {
-  Init();
   /* Algorithm "xor" from p. 4 of Marsaglia, "Xorshift RNGs" */
   auto x = state[0];
   x ^= x << 13;
   x ^= x >> 17;
   x ^= x << 5;
   state[0] = x;
-  return x / (qaFLOAT) (pow(2, 32) - 1);
+  return x * (1.f / 4294967295.f);
 }
 qaFLOAT Sampler_Marsaglia::xorshift128(qaUINT state[4])
 {
-  Init();
   /* Algorithm "xor128" from p. 5 of Marsaglia, "Xorshift RNGs" */
   uint32_t s, t = state[3];
   t ^= t << 11;
@@ -62,19 +74,22 @@ qaFLOAT Sampler_Marsaglia::xorshift128(qaUINT state[4])
   t ^= s;
   t ^= s >> 19;
   state[0] = t;
-  return t / (qaFLOAT) (pow(2, 32) - 1);
+  return t * (1.f / 4294967295.f);
 }
 void Sampler_Marsaglia::Get1f(qaFLOAT &r1)
 {
+  Init();
   r1 = xorshift32(seed);
 }
 void Sampler_Marsaglia::Get2f(qaFLOAT &r1, qaFLOAT &r2)
 {
+  Init();
   r1 = xorshift32(seed);
   r2 = xorshift32(seed);
 }
 void Sampler_Marsaglia::Get3f(qaFLOAT &r1, qaFLOAT &r2, qaFLOAT &r3)
 {
+  Init();
   r1 = xorshift32(seed);
   r2 = xorshift32(seed);
   r3 = xorshift32(seed);
@@ -0,0 +1,258 @@
+//------------------------------------------------------------------------------
+///
+/// \file       Sampler_Sobol.cpp
+/// \author     Qi WU
+///
+/// \brief Owen-scrambled Sobol sequence
+///
+//------------------------------------------------------------------------------
+
+#include "Sampler_Sobol.h"
+#include <vector>
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+/// Generator matrices of the first four Sobol dimensions, one column per bit
+/// of the index (Joe and Kuo direction numbers)
+///--------------------------------------------------------------------------//
+static const qaUINT sobolMatrices[4][32] = {
+    {0x80000000U, 0x40000000U, 0x20000000U, 0x10000000U,
+     0x08000000U, 0x04000000U, 0x02000000U, 0x01000000U,
+     0x00800000U, 0x00400000U, 0x00200000U, 0x00100000U,
+     0x00080000U, 0x00040000U, 0x00020000U, 0x00010000U,
+     0x00008000U, 0x00004000U, 0x00002000U, 0x00001000U,
+     0x00000800U, 0x00000400U, 0x00000200U, 0x00000100U,
+     0x00000080U, 0x00000040U, 0x00000020U, 0x00000010U,
+     0x00000008U, 0x00000004U, 0x00000002U, 0x00000001U},
+    {0x80000000U, 0xc0000000U, 0xa0000000U, 0xf0000000U,
+     0x88000000U, 0xcc000000U, 0xaa000000U, 0xff000000U,
+     0x80800000U, 0xc0c00000U, 0xa0a00000U, 0xf0f00000U,
+     0x88880000U, 0xcccc0000U, 0xaaaa0000U, 0xffff0000U,
+     0x80008000U, 0xc000c000U, 0xa000a000U, 0xf000f000U,
+     0x88008800U, 0xcc00cc00U, 0xaa00aa00U, 0xff00ff00U,
+     0x80808080U, 0xc0c0c0c0U, 0xa0a0a0a0U, 0xf0f0f0f0U,
+     0x88888888U, 0xccccccccU, 0xaaaaaaaaU, 0xffffffffU},
+    {0x80000000U, 0xc0000000U, 0x60000000U, 0x90000000U,
+     0xe8000000U, 0x5c000000U, 0x8e000000U, 0xc5000000U,
+     0x68800000U, 0x9cc00000U, 0xee600000U, 0x55900000U,
+     0x80680000U, 0xc09c0000U, 0x60ee0000U, 0x90550000U,
+     0xe8808000U, 0x5cc0c000U, 0x8e606000U, 0xc5909000U,
+     0x6868e800U, 0x9c9c5c00U, 0xeeee8e00U, 0x5555c500U,
+     0x8000e880U, 0xc0005cc0U, 0x60008e60U, 0x9000c590U,
+     0xe8006868U, 0x5c009c9cU, 0x8e00eeeeU, 0xc5005555U},
+    {0x80000000U, 0xc0000000U, 0x20000000U, 0x50000000U,
+     0xf8000000U, 0x74000000U, 0xa2000000U, 0x93000000U,
+     0xd8800000U, 0x25400000U, 0x59e00000U, 0xe6d00000U,
+     0x78080000U, 0xb40c0000U, 0x82020000U, 0xc3050000U,
+     0x208f8000U, 0x51474000U, 0xfbea2000U, 0x75d93000U,
+     0xa0858800U, 0x914e5400U, 0xdbe79e00U, 0x25db6d00U,
+     0x58800080U, 0xe54000c0U, 0x79e00020U, 0xb6d00050U,
+     0x800800f8U, 0xc00c0074U, 0x200200a2U, 0x50050093U}
+};
+static inline qaUINT Sobol(qaUINT index, int d)
+{
+  qaUINT x = 0;
+  for (int bit = 0; index != 0; ++bit, index >>= 1) {
+    if (index & 1U) { x ^= sobolMatrices[d][bit]; }
+  }
+  return x;
+}
+static inline qaUINT ReverseBits(qaUINT x)
+{
+  x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+  x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+  x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+  return (x >> 16) | (x << 16);
+}
+///--------------------------------------------------------------------------//
+/// Nested uniform (Owen) scramble in base 2. The Laine-Karras style hash
+/// only lets lower bits affect higher ones, on reversed bits that means
+/// every bit is flipped depending on the bits above it only. Constants from
+/// Vegdahl, "Building a Better LK Hash" (2021).
+///--------------------------------------------------------------------------//
+static inline qaUINT OwenScramble(qaUINT x, qaUINT seed)
+{
+  x = ReverseBits(x);
+  x ^= x * 0x3d20adeaU;
+  x += seed;
+  x *= (seed >> 16) | 1U;
+  x ^= x * 0x05526c56U;
+  x ^= x * 0x53a22864U;
+  return ReverseBits(x);
+}
+static inline qaUINT HashCombine(qaUINT seed, qaUINT v)
+{
+  // murmur3 finalizer
+  qaUINT h = seed ^ (v * 0x9e3779b9U);
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
+}
+///--------------------------------------------------------------------------//
+/// Blue-noise ranking mask, built once by void-and-cluster (Ulichney, "The
+/// void-and-cluster method for dither array generation", 1993). The mask
+/// holds the rank of every texel, so any threshold of it is a blue-noise
+/// point set.
+///--------------------------------------------------------------------------//
+static const int maskBits = 6;
+static const int maskSize = 1 << maskBits;
+static const int maskArea = maskSize * maskSize;
+static bool blueNoise = false;
+static size_t blueNoiseWidth = 1;
+//! ranks fill the high bits of the first sample
+static const qaUINT maskHigh = ~(0xffffffffU >> (2 * maskBits));
+static std::vector<qaUINT> blueNoiseMask;
+namespace {
+struct VoidAndCluster {
+  std::vector<float> kernel; // gaussian of the toroidal offset
+  std::vector<float> energy;
+  std::vector<char> pattern;
+  VoidAndCluster() : kernel(maskArea), energy(maskArea, 0.f),
+                     pattern(maskArea, 0)
+  {
+    const float sigma = 1.5f;
+    for (int y = 0; y < maskSize; ++y) {
+      for (int x = 0; x < maskSize; ++x) {
+        const int dx = MIN(x, maskSize - x), dy = MIN(y, maskSize - y);
+        kernel[y * maskSize + x] =
+            exp(-static_cast<float>(dx * dx + dy * dy) / (2.f * sigma * sigma));
+      }
+    }
+  }
+  void Toggle(int p, bool on)
+  {
+    pattern[p] = static_cast<char>(on);
+    const float sign = on ? 1.f : -1.f;
+    const int px = p & (maskSize - 1), py = p >> maskBits;
+    for (int q = 0; q < maskArea; ++q) {
+      const int dx = ((q & (maskSize - 1)) - px) & (maskSize - 1);
+      const int dy = ((q >> maskBits) - py) & (maskSize - 1);
+      energy[q] += sign * kernel[dy * maskSize + dx];
+    }
+  }
+  //! densest set texel ('on') or emptiest unset texel
+  int Extreme(bool on) const
+  {
+    int best = -1;
+    for (int q = 0; q < maskArea; ++q) {
+      if ((pattern[q] != 0) != on) { continue; }
+      if (best < 0 || (on ? energy[q] > energy[best] :
+                             energy[q] < energy[best])) {
+        best = q;
+      }
+    }
+    return best;
+  }
+};
+}
+static void BuildBlueNoiseMask()
+{
+  VoidAndCluster vc;
+  // initial pattern: a tenth of the texels, relaxed until the tightest
+  // cluster is also the largest void
+  const int numInitial = maskArea / 10;
+  int ones = 0;
+  for (qaUINT k = 0; ones < numInitial; ++k) {
+    const int p = static_cast<int>(HashCombine(0x2545f491U, k) % maskArea);
+    if (!vc.pattern[p]) {
+      vc.Toggle(p, true);
+      ++ones;
+    }
+  }
+  for (int it = 0; it < maskArea; ++it) {
+    const int cluster = vc.Extreme(true);
+    vc.Toggle(cluster, false);
+    const int hole = vc.Extreme(false);
+    vc.Toggle(hole, true);
+    if (hole == cluster) { break; }
+  }
+  const VoidAndCluster initial = vc;
+  std::vector<int> rank(maskArea, 0);
+  // ranks below the initial pattern: remove the tightest clusters first
+  for (ones = numInitial; ones > 0; --ones) {
+    const int cluster = vc.Extreme(true);
+    vc.Toggle(cluster, false);
+    rank[cluster] = ones - 1;
+  }
+  // ranks above it: fill the largest voids first
+  vc = initial;
+  for (ones = numInitial; ones < maskArea; ++ones) {
+    const int hole = vc.Extreme(false);
+    vc.Toggle(hole, true);
+    rank[hole] = ones;
+  }
+  blueNoiseMask.resize(maskArea);
+  for (int q = 0; q < maskArea; ++q) {
+    blueNoiseMask[q] = static_cast<qaUINT>(rank[q]) << (32 - 2 * maskBits);
+  }
+}
+void Sampler_Sobol::SetBlueNoise(bool enable, size_t width)
+{
+  blueNoise = enable;
+  blueNoiseWidth = MAX(width, size_t(1));
+  if (enable && blueNoiseMask.empty()) { BuildBlueNoiseMask(); }
+}
+bool Sampler_Sobol::GetBlueNoise() { return blueNoise; }
+///--------------------------------------------------------------------------//
+void Sampler_Sobol::Point(qaUINT s, qaUINT d, qaUINT *x, int n) const
+{
+  const qaUINT seed = DimensionKey(d, true);
+  // shuffling the index in the same way keeps power of two prefixes of the
+  // samples stratified
+  const qaUINT index = OwenScramble(s, seed);
+  for (int k = 0; k < n; ++k) {
+    x[k] = OwenScramble(Sobol(index, k),
+                        HashCombine(seed, static_cast<qaUINT>(k + 1)));
+  }
+}
+void Sampler_Sobol::NextPoint(qaFLOAT *r, int n)
+{
+  const qaUINT d = dim++;
+  qaUINT x[4];
+  Point(sample, d, x, n);
+  if (blueNoise && pixel != photonPixel && pixel != causticsPixel) {
+    qaUINT first[4];
+    Point(0, d, first, n);
+    // the mask offsets of a dimension are the same in every pixel
+    const qaUINT key = DimensionKey(d, false);
+    const size_t px = pixel % blueNoiseWidth, py = pixel / blueNoiseWidth;
+    for (int k = 0; k < n; ++k) {
+      const qaUINT h = HashCombine(key, static_cast<qaUINT>(k + 1));
+      const size_t mx = (px + h) & (maskSize - 1);
+      const size_t my = (py + (h >> maskBits)) & (maskSize - 1);
+      // a digital shift is itself an Owen scramble, unlike a toroidal
+      // shift it keeps the points a net
+      x[k] ^= (blueNoiseMask[(my << maskBits) + mx] ^ first[k]) & maskHigh;
+    }
+  }
+  for (int k = 0; k < n; ++k) {
+    r[k] = static_cast<qaFLOAT>(x[k] >> 8) * (1.f / 16777216.f);
+  }
+}
+void Sampler_Sobol::Get1f(qaFLOAT &r1) { NextPoint(&r1, 1); }
+void Sampler_Sobol::Get2f(qaFLOAT &r1, qaFLOAT &r2)
+{
+  qaFLOAT r[2];
+  NextPoint(r, 2);
+  r1 = r[0];
+  r2 = r[1];
+}
+void Sampler_Sobol::Get3f(qaFLOAT &r1, qaFLOAT &r2, qaFLOAT &r3)
+{
+  qaFLOAT r[3];
+  NextPoint(r, 3);
+  r1 = r[0];
+  r2 = r[1];
+  r3 = r[2];
+}
+void Sampler_Sobol::GetNf(qaFLOAT *r, size_t n)
+{
+  for (size_t i = 0; i < n; i += 4) {
+    NextPoint(r + i, static_cast<int>(n - i < 4 ? n - i : 4));
+  }
+}
+}
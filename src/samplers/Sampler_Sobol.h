@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+///
+/// \file       Sampler_Sobol.h
+/// \author     Qi WU
+///
+/// \brief Owen-scrambled Sobol sequence, after Burley, "Practical Hash-based
+///        Owen Scrambling" (JCGT 2020). The sample index of the pixel is the
+///        index in the sequence. Every request (Get1f, Get2f, Get3f) is a new
+///        dimension of the sample: it takes the first Sobol dimensions and
+///        scrambles them, and also shuffles the index, with a seed hashed
+///        from the key of Sampler_Counter (pixel, path, dimension). Padding
+///        the decisions this way keeps each of them well stratified over the
+///        samples of a pixel while different decisions and pixels stay
+///        uncorrelated.
+///
+///        In blue-noise mode the points of a pixel are also XOR-ed (a
+///        digital shift) so that the high bits of its first sample are the
+///        rank of a tiled blue-noise mask, read at a different offset for
+///        every dimension. This picks the top scrambling bits from the mask
+///        instead of the hash, as the scrambling keys of Heitz et al., "A
+///        Low-Discrepancy Sampler that Distributes Monte Carlo Errors as a
+///        Blue Noise in Screen Space" (2019). Neighbouring pixels then start
+///        from well spread values and the error of low spp images is a blue
+///        noise, which filters and downsamples better than white noise,
+///        while every pixel keeps an Owen-scrambled net.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_SAMPLER_SOBOL_H
+#define QARAY_SAMPLER_SOBOL_H
+#pragma once
+
+#include <cstddef>
+#include "samplers/Sampler_Counter.h"
+
+namespace qaray {
+class Sampler_Sobol : public Sampler_Counter {
+ private:
+  //! Scrambled point of sample 's' in dimension 'd', 'n' <= 4
+  void Point(qaUINT s, qaUINT d, qaUINT *x, int n) const;
+  //! Point of the current sample in the next dimension
+  void NextPoint(qaFLOAT *r, int n);
+ public:
+  void Get1f(qaFLOAT &r1) override;
+  void Get2f(qaFLOAT &r1, qaFLOAT &r2) override;
+  void Get3f(qaFLOAT &r1, qaFLOAT &r2, qaFLOAT &r3) override;
+  //! Batch generation of n numbers, by groups of four dimensions
+  void GetNf(qaFLOAT *r, size_t n) override;
+  //! Switch the blue-noise mode, 'width' is the image width used to turn the
+  //! pixel index of StartSample back into coordinates
+  static void SetBlueNoise(bool enable, size_t width);
+  static bool GetBlueNoise();
+};
+}
+
+#endif //QARAY_SAMPLER_SOBOL_H
@@ -29,6 +29,6 @@
 
 namespace qaray {
 ///--------------------------------------------------------------------------//
-ThreadSampler *rng = new ThreadSampler(Sampler_Marsaglia());
+ThreadSampler *rng = new ThreadSampler(Sampler_Sobol());
 ///--------------------------------------------------------------------------//
 }
@@ -30,13 +30,15 @@
 #pragma once
 ///--------------------------------------------------------------------------//
 #include "tasking/parallel_for.h"
+#include "samplers/Sampler_Counter.h"
+#include "samplers/Sampler_Sobol.h"
 #include "samplers/Sampler_Marsaglia.h"
 #include "samplers/Sampler_Halton.h"
 #include "samplers/Sampler_mt19937.h"
 ///--------------------------------------------------------------------------//
 namespace qaray {
 ///--------------------------------------------------------------------------//
-typedef tasking::ThreadLocalStorage<Sampler_Marsaglia> ThreadSampler;
+typedef tasking::ThreadLocalStorage<Sampler_Sobol> ThreadSampler;
 extern ThreadSampler *rng;
 ///--------------------------------------------------------------------------//
 }
@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+///
+/// \file       animation.cpp
+/// \author     Qi WU
+///
+/// \brief Keyframed camera and node transformation tracks
+///
+//------------------------------------------------------------------------------
+
+#include "animation.h"
+#include <algorithm>
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Keys around frame 'f' and the weight of the second one
+template<typename T>
+static void Bracket(const std::vector<T> &keys, int f,
+                    const T *&a, const T *&b, float &t)
+{
+  size_t k = 0;
+  while (k + 1 < keys.size() && keys[k + 1].frame <= f) { ++k; }
+  a = b = &keys[k];
+  t = 0.f;
+  if (f > keys[k].frame && k + 1 < keys.size()) {
+    b = &keys[k + 1];
+    t = static_cast<float>(f - a->frame) / static_cast<float>(b->frame - a->frame);
+  }
+}
+template<typename T>
+static void InsertKey(std::vector<T> &keys, const T &key)
+{
+  auto it = std::find_if(keys.begin(), keys.end(),
+                         [&](const T &k) { return k.frame >= key.frame; });
+  if (it != keys.end() && it->frame == key.frame) { *it = key; }
+  else { keys.insert(it, key); }
+}
+static bool SameTransform(const TransformKey &a, const TransformKey &b)
+{
+  return a.scale == b.scale && a.axis == b.axis && a.angle == b.angle &&
+      a.translate == b.translate;
+}
+///--------------------------------------------------------------------------//
+void Animation::AddCameraKey(const CameraKey &key)
+{
+  InsertKey(cameraKeys, key);
+}
+void Animation::AddNodeKey(Node *node, const TransformKey &key)
+{
+  auto track = std::find_if(nodeTracks.begin(), nodeTracks.end(),
+                            [&](const NodeTrack &t) { return t.node == node; });
+  if (track == nodeTracks.end()) {
+    NodeTrack t;
+    t.node = node;
+    t.base = *node;
+    nodeTracks.push_back(t);
+    track = nodeTracks.end() - 1;
+  }
+  InsertKey(track->keys, key);
+}
+///--------------------------------------------------------------------------//
+bool Animation::Apply(Scene &scene, int f)
+{
+  //
+  // camera
+  //
+  if (!cameraKeys.empty()) {
+    const CameraKey *a, *b;
+    float t;
+    Bracket(cameraKeys, f, a, b, t);
+    Camera &cam = scene.camera;
+    cam.pos = glm::mix(a->pos, b->pos, t);
+    cam.dir = glm::normalize(glm::mix(a->target, b->target, t) - cam.pos);
+    const Point3 x = cross(cam.dir, glm::mix(a->up, b->up, t));
+    cam.up = glm::normalize(cross(x, cam.dir));
+    cam.fovy = glm::mix(a->fovy, b->fovy, t);
+    cam.focalDistance = glm::mix(a->focalDistance, b->focalDistance, t);
+    cam.depthOfField = glm::mix(a->depthOfField, b->depthOfField, t);
+  }
+  //
+  // nodes, only the ones whose transformation changed are touched
+  //
+  bool moved = !applied;
+  for (auto &track : nodeTracks) {
+    const TransformKey *a, *b;
+    float t;
+    Bracket(track.keys, f, a, b, t);
+    TransformKey key;
+    key.frame = f;
+    key.scale = glm::mix(a->scale, b->scale, t);
+    key.axis = glm::mix(a->axis, b->axis, t);
+    key.angle = glm::mix(a->angle, b->angle, t);
+    key.translate = glm::mix(a->translate, b->translate, t);
+    if (applied && SameTransform(key, track.current)) { continue; }
+    track.current = key;
+    Transformation &trans = *track.node;
+    trans = track.base;
+    trans.Scale(key.scale.x, key.scale.y, key.scale.z);
+    if (key.angle != 0.f && length(key.axis) > 0.f) {
+      trans.Rotate(glm::normalize(key.axis), key.angle);
+    }
+    trans.Translate(key.translate);
+    moved = true;
+  }
+  if (moved && !nodeTracks.empty()) { scene.rootNode.ComputeChildBoundBox(); }
+  applied = true;
+  return moved;
+}
+}
@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+///
+/// \file       animation.h
+/// \author     Qi WU
+///
+/// \brief Keyframed camera and node transformation tracks. The scene stays
+///        loaded between frames: Apply() only rewrites the camera and the
+///        transformations of the animated nodes, meshes, their BVHs and the
+///        textures are kept. Values are interpolated linearly between keys
+///        and held before the first and after the last key.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_ANIMATION_H
+#define QARAY_ANIMATION_H
+#pragma once
+
+#include <vector>
+///--------------------------------------------------------------------------//
+#include "math/math.h"
+#include "scene/scene.h"
+///--------------------------------------------------------------------------//
+
+namespace qaray {
+///--------------------------------------------------------------------------//
+//! Camera at one frame, fields that a key does not set keep the value of
+//! the camera loaded with the scene (without a target, its direction)
+struct CameraKey {
+  int frame;
+  Point3 pos, target, up;
+  float fovy, focalDistance, depthOfField;
+};
+//! Transformation of a node at one frame. It is applied after the node's
+//! own transformation, in the space of the parent: scale, then rotate, then
+//! translate.
+struct TransformKey {
+  int frame;
+  Point3 scale = Point3(1.f);
+  Point3 axis = Point3(0.f, 0.f, 1.f);
+  float angle = 0.f; // degrees
+  Point3 translate = Point3(0.f);
+};
+struct NodeTrack {
+  Node *node;
+  Transformation base; // transformation loaded with the scene
+  std::vector<TransformKey> keys;
+  TransformKey current; // last applied
+};
+///--------------------------------------------------------------------------//
+class Animation {
+ private:
+  int numFrames = 0;
+  std::vector<CameraKey> cameraKeys;
+  std::vector<NodeTrack> nodeTracks;
+  bool applied = false;
+ public:
+  int GetNumFrames() const { return numFrames; }
+  void SetNumFrames(int n) { numFrames = n; }
+  //! Keys can be added in any order
+  void AddCameraKey(const CameraKey &key);
+  void AddNodeKey(Node *node, const TransformKey &key);
+  //! Set the camera and the animated nodes of 'scene' to frame 'f'. Returns
+  //! whether any geometry moved since the previous call, the bounding boxes
+  //! of the nodes are then updated.
+  bool Apply(Scene &scene, int f);
+};
+}
+
+#endif //QARAY_ANIMATION_H
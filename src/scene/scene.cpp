@@ -26,14 +26,33 @@
 ///--------------------------------------------------------------------------//
 
 #include "scene.h"
+#include <algorithm>
 #include <thread>
 
 namespace qaray {
 //------------------------------------------------------------------------------
+static thread_local size_t threadRayCount = 0;
+size_t Scene::GetThreadRayCount() { return threadRayCount; }
+static thread_local std::vector<const ItemBase *> *threadDeps = nullptr;
+void Scene::SetThreadDependencies(std::vector<const ItemBase *> *deps)
+{
+  threadDeps = deps;
+}
+void Scene::RecordDependency(const ItemBase *item)
+{
+  if (threadDeps == nullptr || item == nullptr) { return; }
+  // a tile only touches a handful of items, a linear search is enough
+  if (std::find(threadDeps->begin(), threadDeps->end(), item) ==
+      threadDeps->end()) {
+    threadDeps->push_back(item);
+  }
+}
+//------------------------------------------------------------------------------
 // Trace the ray within this node and all its children
 //------------------------------------------------------------------------------
 bool Scene::TraceNodeShadow(Node &node, Ray &ray, HitInfo &hInfo)
 {
+  if (&node == &rootNode) { ++threadRayCount; }
   Ray nodeRay = node.ToNodeCoords(ray);
   if (node.GetNodeObj() != nullptr) {
     if (node.GetNodeObj()
@@ -50,6 +69,7 @@ bool Scene::TraceNodeShadow(Node &node, Ray &ray, HitInfo &hInfo)
 bool Scene::TraceNodeNormal(Node &node, DiffRay &ray,
                             DiffHitInfo &hInfo /* it stores results */)
 {
+  if (&node == &rootNode) { ++threadRayCount; }
   bool hasHit = false;
   // We first check if this ray will intersect with the object held by
   // this node
@@ -70,6 +90,9 @@ bool Scene::TraceNodeNormal(Node &node, DiffRay &ray,
     }
   }
   if (hasHit) { node.FromNodeCoords(hInfo); }
+  if (hasHit && &node == &rootNode) {
+    RecordDependency(hInfo.c.node->GetMaterial());
+  }
   return hasHit;
 }
 ///--------------------------------------------------------------------------//
@@ -87,6 +110,8 @@ SuperSamplerHalton::SuperSamplerHalton(const Color3f th,
 
 const Color3f &SuperSamplerHalton::GetColor() const { return color; }
 
+float SuperSamplerHalton::GetLumaM2() const { return lumaM2; }
+
 int SuperSamplerHalton::GetSampleID() const { return s; }
 
 bool SuperSamplerHalton::Loop() const
@@ -96,12 +121,17 @@ bool SuperSamplerHalton::Loop() const
           (color_std.r > th.r || color_std.g > th.g || color_std.b > th.b)));
 }
 
-Point3 SuperSamplerHalton::NewPixelSample()
+//! The first dimension of the sample started by the renderer
+static Point3 PixelSample()
 {
-  return Point3(Halton(s, 11), Halton(s, 13), 0.f);
+  float r1, r2;
+  rng->local().Get2f(r1, r2);
+  return Point3(r1, r2, 0.f);
 }
 
-Point3 SuperSamplerHalton::NewDofSample(const float R)
+Point3 SuperSamplerHalton::NewPixelSample() { return PixelSample(); }
+
+static Point3 DofSample(const float R)
 {
   float r1, r2;
   rng->local().Get2f(r1, r2);
@@ -110,6 +140,8 @@ Point3 SuperSamplerHalton::NewDofSample(const float R)
   return Point3(r * COS(t), r * SIN(t), 0.f);
 }
 
+Point3 SuperSamplerHalton::NewDofSample(const float R) { return DofSample(R); }
+
 void SuperSamplerHalton::Accumulate(const Color3f &localColor)
 {
   const Color3f dc = (localColor - color) / static_cast<float>(s + 1);
@@ -118,8 +150,45 @@ void SuperSamplerHalton::Accumulate(const Color3f &localColor)
                dc * dc * static_cast<float>(s + 1)
                    - color_std / static_cast<float>(s) :
                Color3f(0.0f);
+  const float luma = ColorLuma(localColor);
+  lumaM2 += luma * luma;
 }
 
 void SuperSamplerHalton::Increment() { ++s; }
 
 //------------------------------------------------------------------------------
+
+SuperSamplerProgressive::SuperSamplerProgressive(const int sBegin,
+                                                 const int numSamples,
+                                                 const int stride,
+                                                 const int offset)
+    : sEnd(sBegin + numSamples), stride(stride), offset(offset), s(sBegin) {}
+
+const Color3f &SuperSamplerProgressive::GetColor() const { return color; }
+
+float SuperSamplerProgressive::GetLumaM2() const { return lumaM2; }
+
+int SuperSamplerProgressive::GetSampleID() const
+{
+  return s * stride + offset;
+}
+
+bool SuperSamplerProgressive::Loop() const { return s < sEnd; }
+
+Point3 SuperSamplerProgressive::NewPixelSample() { return PixelSample(); }
+
+Point3 SuperSamplerProgressive::NewDofSample(const float R)
+{
+  return DofSample(R);
+}
+
+void SuperSamplerProgressive::Accumulate(const Color3f &localColor)
+{
+  color += localColor;
+  const float luma = ColorLuma(localColor);
+  lumaM2 += luma * luma;
+}
+
+void SuperSamplerProgressive::Increment() { ++s; }
+
+//------------------------------------------------------------------------------
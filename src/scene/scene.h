@@ -50,6 +50,7 @@ struct PhotonMap {
   size_t size;
   size_t bounce;
   qaFLOAT radius;
+  const char *shared = nullptr; // copy of the map shared by the host
   void Clear() { map.Clear(); }
 };
 class Scene {
@@ -68,6 +69,12 @@ class Scene {
  public:
   bool TraceNodeShadow(Node &node, Ray &ray, HitInfo &hInfo);
   bool TraceNodeNormal(Node &node, DiffRay &ray, DiffHitInfo &hInfo);
+  //! Number of rays the calling thread traced from the root node so far
+  static size_t GetThreadRayCount();
+  //! Collect the materials hit and the lights evaluated by the calling
+  //! thread into 'deps' (no duplicates), nullptr stops recording
+  static void SetThreadDependencies(std::vector<const ItemBase *> *deps);
+  static void RecordDependency(const ItemBase *item);
 };
 extern Scene scene;
 ///--------------------------------------------------------------------------//
@@ -100,12 +107,50 @@ class SuperSamplerHalton : public SuperSampler {
   const int sppMin, sppMax;
   Color3f color_std = Color3f(0.0f, 0.0f, 0.0f);
   Color3f color = Color3f(0.0f, 0.0f, 0.0f);
+  float lumaM2 = 0.0f;
   int s = 0;
  public:
   SuperSamplerHalton(const Color3f th, const int sppMin, const int sppMax);
 
   const Color3f &GetColor() const;
 
+  //! Sum of the squared luminance of the samples
+  float GetLumaM2() const;
+
+  int GetSampleID() const;
+
+  bool Loop() const;
+
+  Point3 NewPixelSample();
+
+  Point3 NewDofSample(const float);
+
+  void Accumulate(const Color3f &localColor);
+
+  void Increment();
+};
+
+//! Draws a fixed range [sBegin, sBegin + numSamples) of the pixel's sample
+//! sequence, so that consecutive progressive passes continue the sequence
+//! instead of repeating it. GetColor returns the sum of the batch and
+//! GetLumaM2 the sum of the squared luminance of the samples. With a
+//! stride, sample s of the range is sample s * stride + offset of the
+//! sequence, so that several MPI ranks draw disjoint samples of a pixel.
+class SuperSamplerProgressive : public SuperSampler {
+ private:
+  const int sEnd;
+  const int stride, offset;
+  Color3f color = Color3f(0.0f, 0.0f, 0.0f);
+  float lumaM2 = 0.0f;
+  int s;
+ public:
+  SuperSamplerProgressive(const int sBegin, const int numSamples,
+                          const int stride = 1, const int offset = 0);
+
+  const Color3f &GetColor() const;
+
+  float GetLumaM2() const;
+
   int GetSampleID() const;
 
   bool Loop() const;
@@ -0,0 +1,337 @@
+//------------------------------------------------------------------------------
+///
+/// \file       native_pool.cpp
+/// \author     Qi WU
+///
+/// \brief Built-in work-stealing thread pool
+///
+//------------------------------------------------------------------------------
+
+#include "native_pool.h"
+#include "numa.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace qaray {
+namespace tasking {
+namespace native {
+//---------------------------------------------------------------------------//
+// Chase-Lev deque, following "Correct and Efficient Work-Stealing for Weak
+// Memory Models" (Le et al. 2013). The owner pushes and pops at the bottom,
+// thieves take from the top. Slots are written with release and read with
+// acquire so the task contents are published together with the pointer.
+//---------------------------------------------------------------------------//
+namespace {
+class WorkStealingDeque {
+ private:
+  struct Array {
+    const long capacity;
+    std::atomic<Task *> *buffer;
+    explicit Array(long c) : capacity(c), buffer(new std::atomic<Task *>[c]) {}
+    ~Array() { delete[] buffer; }
+    Task *Get(long i) const
+    {
+      return buffer[i & (capacity - 1)].load(std::memory_order_acquire);
+    }
+    void Put(long i, Task *t)
+    {
+      buffer[i & (capacity - 1)].store(t, std::memory_order_release);
+    }
+  };
+  std::atomic<long> top;
+  std::atomic<long> bottom;
+  std::atomic<Array *> array;
+  std::vector<std::unique_ptr<Array>> arrays; // keeps retired arrays alive
+ public:
+  WorkStealingDeque() : top(0), bottom(0)
+  {
+    arrays.emplace_back(new Array(256));
+    array.store(arrays.back().get(), std::memory_order_relaxed);
+  }
+  void Push(Task *task)
+  {
+    const long b = bottom.load(std::memory_order_relaxed);
+    const long t = top.load(std::memory_order_acquire);
+    Array *a = array.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) {
+      Array *grown = new Array(a->capacity * 2);
+      for (long i = t; i < b; ++i) { grown->Put(i, a->Get(i)); }
+      arrays.emplace_back(grown);
+      array.store(grown, std::memory_order_release);
+      a = grown;
+    }
+    a->Put(b, task);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  Task *Pop()
+  {
+    const long b = bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = top.load(std::memory_order_relaxed);
+    Task *task = nullptr;
+    if (t <= b) {
+      task = a->Get(b);
+      if (t == b) {
+        // last item, race against thieves
+        if (!top.compare_exchange_strong(t, t + 1,
+                                         std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+          task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+      }
+    } else {
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+  Task *Steal()
+  {
+    long t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const long b = bottom.load(std::memory_order_acquire);
+    if (t >= b) { return nullptr; }
+    Array *a = array.load(std::memory_order_acquire);
+    Task *task = a->Get(t);
+    if (!top.compare_exchange_strong(t, t + 1,
+                                     std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return task;
+  }
+};
+//---------------------------------------------------------------------------//
+class Pool {
+ private:
+  std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+  std::vector<std::thread> threads;
+  //! tasks submitted by threads outside of the pool
+  std::mutex injectLock;
+  std::deque<Task *> injected;
+  //! sleeping
+  std::mutex sleepLock;
+  std::condition_variable wakeup;
+  std::atomic<size_t> numQueued;
+  std::atomic<size_t> numInjected;
+  std::atomic<size_t> numSleeping;
+  std::atomic<bool> stop;
+  //! stored once the deques and the threads exist, zero until then
+  std::atomic<size_t> numWorkers;
+ public:
+  Pool()
+      : numQueued(0), numInjected(0), numSleeping(0), stop(false),
+        numWorkers(0) {}
+  ~Pool() { Stop(); }
+  size_t Size() const { return numWorkers.load(std::memory_order_acquire); }
+  //! Called once, the workers live until the program exits
+  void Start(size_t n);
+  void Stop();
+  void Submit(Task *task);
+  bool ExecuteOne(int self);
+ private:
+  Task *Acquire(int self);
+  void WorkerLoop(int self);
+  void Wake();
+};
+thread_local int workerIndex = -1;
+//---------------------------------------------------------------------------//
+void Pool::Start(size_t n)
+{
+  n = n > 0 ? n : 1;
+  for (size_t i = 0; i < n; ++i) {
+    deques.emplace_back(new WorkStealingDeque());
+  }
+  for (size_t i = 0; i < n; ++i) {
+    threads.emplace_back([this, i]() { WorkerLoop(static_cast<int>(i)); });
+  }
+  // threads that see the count also see the deques
+  numWorkers.store(n, std::memory_order_release);
+}
+void Pool::Stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    stop = true;
+  }
+  wakeup.notify_all();
+  for (auto &t : threads) { t.join(); }
+  threads.clear();
+}
+void Pool::Wake()
+{
+  // numQueued and numSleeping are sequentially consistent, so either the
+  // sleeper sees the new task or we see the sleeper
+  if (numSleeping.load() > 0) {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    wakeup.notify_one();
+  }
+}
+void Pool::Submit(Task *task)
+{
+  if (workerIndex >= 0) {
+    deques[workerIndex]->Push(task);
+  } else {
+    std::lock_guard<std::mutex> guard(injectLock);
+    injected.push_back(task);
+    ++numInjected;
+  }
+  ++numQueued;
+  Wake();
+}
+Task *Pool::Acquire(int self)
+{
+  Task *task = deques[self]->Pop();
+  if (task == nullptr) {
+    // steal from the other workers, starting with the next one
+    const auto n = static_cast<int>(deques.size());
+    for (int v = 1; v < n && task == nullptr; ++v) {
+      task = deques[(self + v) % n]->Steal();
+    }
+  }
+  if (task == nullptr && numInjected.load() > 0) {
+    std::lock_guard<std::mutex> guard(injectLock);
+    if (!injected.empty()) {
+      task = injected.front();
+      injected.pop_front();
+      --numInjected;
+    }
+  }
+  if (task != nullptr) { --numQueued; }
+  return task;
+}
+bool Pool::ExecuteOne(int self)
+{
+  Task *task = Acquire(self);
+  if (task == nullptr) { return false; }
+  TaskGroup *group = task->group;
+  task->Execute();
+  delete task;
+  group->Finish();
+  return true;
+}
+void Pool::WorkerLoop(int self)
+{
+  workerIndex = self;
+  numa_pin_worker(static_cast<size_t>(self), deques.size());
+  while (true) {
+    if (ExecuteOne(self)) { continue; }
+    // spin a little before going to sleep
+    bool found = false;
+    for (int i = 0; i < 64 && !found; ++i) {
+      std::this_thread::yield();
+      found = numQueued.load() > 0;
+    }
+    if (found) { continue; }
+    std::unique_lock<std::mutex> guard(sleepLock);
+    ++numSleeping;
+    wakeup.wait(guard, [&]() {
+      return stop.load() || numQueued.load() > 0;
+    });
+    --numSleeping;
+    if (stop.load() && numQueued.load() == 0) { break; }
+  }
+  workerIndex = -1;
+}
+//---------------------------------------------------------------------------//
+std::mutex poolLock;
+Pool &GetPool()
+{
+  static Pool pool;
+  return pool;
+}
+std::mutex slotLock;
+std::vector<size_t> freeSlots;
+size_t nextSlot = 0;
+//! returns the slot of a thread to the free list when the thread exits
+struct SlotHolder {
+  size_t slot;
+  SlotHolder()
+  {
+    std::lock_guard<std::mutex> guard(slotLock);
+    if (!freeSlots.empty()) {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      slot = nextSlot++;
+    }
+    if (slot >= maxThreadSlots) {
+      fprintf(stderr, "tasking: more than %zu threads use thread local "
+          "storage\n", maxThreadSlots);
+      std::abort();
+    }
+  }
+  ~SlotHolder()
+  {
+    std::lock_guard<std::mutex> guard(slotLock);
+    freeSlots.push_back(slot);
+  }
+};
+}
+//---------------------------------------------------------------------------//
+size_t num_workers()
+{
+  Pool &pool = GetPool();
+  if (pool.Size() == 0) { start(0); }
+  return pool.Size();
+}
+void start(size_t n)
+{
+  // the workers are never replaced: tasks of other threads may be running
+  // on them at any time
+  std::lock_guard<std::mutex> guard(poolLock);
+  Pool &pool = GetPool();
+  if (pool.Size() > 0) { return; }
+  pool.Start(n > 0 ? n : std::max(1u, std::thread::hardware_concurrency()));
+}
+int worker_index() { return workerIndex; }
+size_t thread_slot()
+{
+  static thread_local SlotHolder holder;
+  return holder.slot;
+}
+//---------------------------------------------------------------------------//
+void TaskGroup::Spawn(Task *task)
+{
+  num_workers(); // make sure the pool is running
+  task->group = this;
+  pending.fetch_add(1, std::memory_order_acq_rel);
+  GetPool().Submit(task);
+}
+void TaskGroup::Finish()
+{
+  // only the last task takes the lock, the waiter could otherwise return
+  // and destroy the group before we are done notifying it
+  size_t n = pending.load(std::memory_order_relaxed);
+  while (n > 1) {
+    if (pending.compare_exchange_weak(n, n - 1, std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) { return; }
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    done.notify_all();
+  }
+}
+void TaskGroup::Wait()
+{
+  const int self = workerIndex;
+  if (self >= 0) {
+    // help until the group is over
+    while (!IsDone()) {
+      if (!GetPool().ExecuteOne(self)) { std::this_thread::yield(); }
+    }
+  }
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [&]() { return IsDone(); });
+}
+}
+}
+}
@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+///
+/// \file       native_pool.h
+/// \author     Qi WU
+///
+/// \brief Built-in tasking backend for builds without TBB or OpenMP. A
+///        persistent pool of std::thread workers, each owning a Chase-Lev
+///        deque. Workers push and pop at the bottom of their own deque and
+///        steal from the top of the others. Threads that do not belong to
+///        the pool hand their work to the workers and sleep until it is done.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_NATIVE_POOL_H
+#define QARAY_NATIVE_POOL_H
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace qaray {
+namespace tasking {
+namespace native {
+//---------------------------------------------------------------------------//
+class TaskGroup;
+//! Unit of work scheduled on the pool
+class Task {
+ public:
+  TaskGroup *group = nullptr;
+  virtual ~Task() = default;
+  virtual void Execute() = 0;
+};
+//---------------------------------------------------------------------------//
+//! Fork/join group: Run() forks a task, Wait() returns once every task of
+//! the group has finished. A worker thread keeps executing tasks while it
+//! waits, any other thread sleeps.
+class TaskGroup {
+ private:
+  std::atomic<size_t> pending;
+  std::mutex lock;
+  std::condition_variable done;
+ public:
+  TaskGroup() : pending(0) {}
+  ~TaskGroup() { Wait(); }
+  void Spawn(Task *task);
+  void Wait();
+  void Finish(); //!< called by the pool when one task of the group is over
+  bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+  template<typename F>
+  void Run(const F &f);
+};
+//---------------------------------------------------------------------------//
+//! Number of workers of the pool (starts it when needed)
+size_t num_workers();
+//! Start the pool with n workers, or one per hardware thread when n is 0.
+//! Only the first call (or the first task) starts it, later calls keep the
+//! running workers.
+void start(size_t n);
+//! Index of the calling worker in [0, num_workers()), or -1 if the calling
+//! thread does not belong to the pool
+int worker_index();
+//! Small integer that is unique for every thread that asks for it, used to
+//! index thread local storage
+size_t thread_slot();
+static const size_t maxThreadSlots = 1024;
+//---------------------------------------------------------------------------//
+template<typename F>
+class FunctionTask : public Task {
+  F f;
+ public:
+  explicit FunctionTask(const F &f) : f(f) {}
+  void Execute() override { f(); }
+};
+template<typename F>
+void TaskGroup::Run(const F &f) { Spawn(new FunctionTask<F>(f)); }
+//---------------------------------------------------------------------------//
+//! Recursively splits [begin, end) in halves, forking the upper half,
+//! until a piece holds at most 'grain' indices; body(begin, end) is then
+//! called on it
+template<typename Index, typename Body>
+class RangeTask : public Task {
+  Index begin, end;
+  size_t grain;
+  const Body &body;
+ public:
+  RangeTask(Index b, Index e, size_t g, const Body &body)
+      : begin(b), end(e), grain(g), body(body) {}
+  void Execute() override
+  {
+    Index b = begin, e = end;
+    while (static_cast<size_t>(e - b) > grain) {
+      const Index m = b + static_cast<Index>((e - b) / 2);
+      group->Spawn(new RangeTask(m, e, grain, body));
+      e = m;
+    }
+    body(b, e);
+  }
+};
+template<typename Index, typename Body>
+void parallel_range(Index begin, Index end, size_t grain, const Body &body)
+{
+  if (!(begin < end)) { return; }
+  TaskGroup group;
+  group.Spawn(new RangeTask<Index, Body>(begin, end, grain > 0 ? grain : 1,
+                                         body));
+  group.Wait();
+}
+//---------------------------------------------------------------------------//
+//! Per thread instances of T created lazily from a prototype
+template<typename T>
+class ThreadLocalStorage {
+ private:
+  const T data;
+  std::atomic<T *> *slots;
+ public:
+  explicit ThreadLocalStorage(const T &t)
+      : data(t), slots(new std::atomic<T *>[maxThreadSlots])
+  {
+    for (size_t i = 0; i < maxThreadSlots; ++i) { slots[i] = nullptr; }
+  }
+  ~ThreadLocalStorage()
+  {
+    for (size_t i = 0; i < maxThreadSlots; ++i) { delete slots[i].load(); }
+    delete[] slots;
+  }
+  ThreadLocalStorage(const ThreadLocalStorage &) = delete;
+  ThreadLocalStorage &operator=(const ThreadLocalStorage &) = delete;
+  T &local()
+  {
+    // only the owning thread writes its slot
+    std::atomic<T *> &slot = slots[thread_slot()];
+    T *p = slot.load(std::memory_order_relaxed);
+    if (p == nullptr) {
+      p = new T(data);
+      slot.store(p, std::memory_order_relaxed);
+    }
+    return *p;
+  }
+};
+}
+}
+}
+
+#endif //QARAY_NATIVE_POOL_H
@@ -0,0 +1,251 @@
+//------------------------------------------------------------------------------
+///
+/// \file       numa.cpp
+/// \author     Qi WU
+///
+/// \brief NUMA topology, thread pinning and node aware loops
+///
+//------------------------------------------------------------------------------
+
+#include "numa.h"
+#include "parallel_range.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#ifdef __linux__
+# include <sched.h>
+#endif
+
+namespace qaray {
+namespace tasking {
+//---------------------------------------------------------------------------//
+namespace {
+struct Topology {
+  std::vector<std::vector<int>> nodeCpus; //!< usable cpus of every node
+  std::vector<int> cpuNode;               //!< node of every cpu
+};
+//! parse a sysfs cpu list such as "0-7,16-23"
+std::vector<int> ParseCpuList(const std::string &str)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    int a, b;
+    if (sscanf(item.c_str(), "%d-%d", &a, &b) == 2) {
+      for (int c = a; c <= b; ++c) { cpus.push_back(c); }
+    } else if (sscanf(item.c_str(), "%d", &a) == 1) {
+      cpus.push_back(a);
+    }
+  }
+  return cpus;
+}
+Topology ReadTopology()
+{
+  Topology topo;
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  const bool hasMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  // node ids can have holes, stop after a few missing ones
+  for (int node = 0, missing = 0; missing < 8; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" +
+        std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!file || !std::getline(file, list)) {
+      ++missing;
+      continue;
+    }
+    std::vector<int> cpus;
+    for (int c : ParseCpuList(list)) {
+      if (!hasMask || (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))) {
+        cpus.push_back(c);
+      }
+    }
+    if (cpus.empty()) { continue; }
+    for (int c : cpus) {
+      if (c >= static_cast<int>(topo.cpuNode.size())) {
+        topo.cpuNode.resize(c + 1, 0);
+      }
+      topo.cpuNode[c] = static_cast<int>(topo.nodeCpus.size());
+    }
+    topo.nodeCpus.push_back(cpus);
+  }
+#endif
+  if (topo.nodeCpus.empty()) {
+    const auto n = std::max(1u, std::thread::hardware_concurrency());
+    topo.nodeCpus.emplace_back();
+    for (unsigned int c = 0; c < n; ++c) {
+      topo.nodeCpus[0].push_back(static_cast<int>(c));
+      topo.cpuNode.push_back(0);
+    }
+  }
+  return topo;
+}
+const Topology &GetTopology()
+{
+  static const Topology topo = ReadTopology();
+  return topo;
+}
+bool numaMode = false;
+bool numaReplication = false;
+thread_local int threadNode = -1;
+}
+//---------------------------------------------------------------------------//
+void set_numa_mode(bool enable)
+{
+  numaMode = enable;
+  if (enable) {
+    const Topology &topo = GetTopology();
+    printf("NUMA mode: %zu node(s)\n", topo.nodeCpus.size());
+    for (size_t n = 0; n < topo.nodeCpus.size(); ++n) {
+      printf("  node %zu: %zu cpu(s)\n", n, topo.nodeCpus[n].size());
+    }
+  }
+}
+bool get_numa_mode() { return numaMode; }
+void set_numa_replication(bool enable) { numaReplication = enable; }
+bool get_numa_replication() { return numaMode && numaReplication; }
+size_t numa_num_nodes()
+{
+  return numaMode ? GetTopology().nodeCpus.size() : 1;
+}
+//---------------------------------------------------------------------------//
+//! Worker w gets the node whose share of the cores contains w
+static void WorkerPlace(size_t w, size_t n, int &node, int &cpu)
+{
+  const Topology &topo = GetTopology();
+  size_t total = 0;
+  for (const auto &cpus : topo.nodeCpus) { total += cpus.size(); }
+  const size_t slot = (w % n) * total / n; // position among all cores
+  size_t first = 0;
+  for (size_t k = 0; k < topo.nodeCpus.size(); ++k) {
+    const auto &cpus = topo.nodeCpus[k];
+    if (slot < first + cpus.size()) {
+      node = static_cast<int>(k);
+      cpu = cpus[slot - first];
+      return;
+    }
+    first += cpus.size();
+  }
+  node = 0;
+  cpu = topo.nodeCpus[0][0];
+}
+int numa_worker_node(size_t w, size_t n)
+{
+  if (!numaMode || n == 0) { return 0; }
+  int node, cpu;
+  WorkerPlace(w, n, node, cpu);
+  return node;
+}
+static void PinToCpu(int cpu)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    fprintf(stderr, "tasking: failed to pin a thread to cpu %d\n", cpu);
+  }
+#endif
+}
+void numa_pin_worker(size_t w, size_t n)
+{
+  if (!numaMode || n == 0) { return; }
+  int node, cpu;
+  WorkerPlace(w, n, node, cpu);
+  PinToCpu(cpu);
+  threadNode = node;
+}
+int numa_this_node()
+{
+  if (!numaMode) { return 0; }
+  if (threadNode < 0) {
+    threadNode = 0;
+#ifdef __linux__
+    const Topology &topo = GetTopology();
+    const int cpu = sched_getcpu();
+    if (cpu >= 0 && cpu < static_cast<int>(topo.cpuNode.size())) {
+      threadNode = topo.cpuNode[cpu];
+    }
+#endif
+  }
+  return threadNode;
+}
+//---------------------------------------------------------------------------//
+void numa_first_touch(size_t n,
+                      const std::function<void(size_t, size_t)> &touch,
+                      std::vector<int> &owner)
+{
+  owner.assign(n, 0);
+  // one contiguous band per worker, so that the pages of a band are only
+  // touched by one thread
+  const size_t numWorkers = std::max(size_t(1), get_num_of_threads());
+  parallel_for_each(size_t(0), numWorkers, 1, [&](size_t w) {
+    const size_t begin = w * n / numWorkers;
+    const size_t end = (w + 1) * n / numWorkers;
+    if (begin == end) { return; }
+    touch(begin, end);
+    const int node = numa_this_node();
+    for (size_t i = begin; i < end; ++i) { owner[i] = node; }
+  }, partitioner::STATIC);
+}
+void numa_parallel_for(const std::vector<int> &owner, size_t grain,
+                       const std::function<void(size_t, size_t)> &kernel)
+{
+  grain = std::max(size_t(1), grain);
+  if (!numaMode) {
+    parallel_for(blocked_range<size_t>(0, owner.size(), grain),
+                 [&](const blocked_range<size_t> &r) {
+                   kernel(r.begin(), r.end());
+                 });
+    return;
+  }
+  // cut the index space into chunks that belong to a single node
+  const size_t numNodes = numa_num_nodes();
+  std::vector<std::vector<std::pair<size_t, size_t>>> chunks(numNodes);
+  for (size_t b = 0; b < owner.size();) {
+    size_t e = b + 1;
+    while (e < owner.size() && e - b < grain && owner[e] == owner[b]) { ++e; }
+    chunks[static_cast<size_t>(owner[b]) % numNodes].emplace_back(b, e);
+    b = e;
+  }
+  std::vector<std::atomic<size_t>> next(numNodes);
+  for (auto &c : next) { c = 0; }
+  const size_t numWorkers = std::max(size_t(1), get_num_of_threads());
+  parallel_for_each(size_t(0), numWorkers, 1, [&](size_t) {
+    // own node first, then help the others
+    const size_t home = static_cast<size_t>(numa_this_node()) % numNodes;
+    for (size_t v = 0; v < numNodes; ++v) {
+      const size_t node = (home + v) % numNodes;
+      size_t c;
+      while ((c = next[node]++) < chunks[node].size()) {
+        kernel(chunks[node][c].first, chunks[node][c].second);
+      }
+    }
+  }, partitioner::STATIC);
+}
+void numa_on_each_node(const std::function<void(int)> &f)
+{
+  if (!numaMode) {
+    f(0);
+    return;
+  }
+  const Topology &topo = GetTopology();
+  const size_t numNodes = numa_num_nodes();
+  std::vector<std::thread> threads;
+  for (size_t n = 0; n < numNodes; ++n) {
+    const int cpu = topo.nodeCpus[n][0];
+    threads.emplace_back([&f, n, cpu]() {
+      PinToCpu(cpu);
+      threadNode = static_cast<int>(n);
+      f(static_cast<int>(n));
+    });
+  }
+  for (auto &t : threads) { t.join(); }
+}
+}
+}
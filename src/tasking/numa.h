@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------
+///
+/// \file       numa.h
+/// \author     Qi WU
+///
+/// \brief NUMA mode of the tasking library. When it is on, workers are
+///        pinned to cores and grouped by memory node, work stealing prefers
+///        victims of the same node and large buffers are first touched by
+///        the workers that will use them. The topology is read from
+///        /sys/devices/system/node; without it (or outside of Linux) the
+///        machine is seen as a single node.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_NUMA_H
+#define QARAY_NUMA_H
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace qaray {
+namespace tasking {
+//! Turn the NUMA mode on or off, must be called before tasking::init()
+void set_numa_mode(bool enable);
+bool get_numa_mode();
+//! Keep one copy of read-mostly scene data (meshes and BVHs) per node
+void set_numa_replication(bool enable);
+bool get_numa_replication();
+//! Number of memory nodes, 1 when the NUMA mode is off
+size_t numa_num_nodes();
+//! Node that worker w out of n is placed on. Workers are spread over the
+//! nodes in contiguous groups, proportionally to the cores of each node.
+int numa_worker_node(size_t w, size_t n);
+//! Pin the calling thread to the core of worker w out of n (no-op when the
+//! NUMA mode is off)
+void numa_pin_worker(size_t w, size_t n);
+//! Node of the core running the calling thread, cached per thread
+int numa_this_node();
+//! Call touch(begin, end) over [0, n) in parallel and record in 'owner' the
+//! node of the thread that touched every index
+void numa_first_touch(size_t n,
+                      const std::function<void(size_t, size_t)> &touch,
+                      std::vector<int> &owner);
+//! Call kernel(begin, end) over [0, owner.size()) in parallel, handing index
+//! i to a worker of node owner[i] whenever one is available
+void numa_parallel_for(const std::vector<int> &owner, size_t grain,
+                       const std::function<void(size_t, size_t)> &kernel);
+//! Call f(node) once for every node, from a thread pinned to that node
+void numa_on_each_node(const std::function<void(int)> &f);
+}
+}
+
+#endif //QARAY_NUMA_H
@@ -26,6 +26,9 @@
 ///--------------------------------------------------------------------------//
 
 #include "parallel_for.h"
+#include "numa.h"
+#include <algorithm>
+#include <thread>
 
 namespace qaray {
 namespace tasking {
@@ -44,6 +47,8 @@ size_t init_num_of_threads()
   {
     num_of_threads = static_cast<size_t>(omp_get_num_threads());
   }
+#elif defined(USE_NATIVE_TASKING)
+  num_of_threads = std::max(1u, std::thread::hardware_concurrency());
 #endif
   return num_of_threads;
 }
@@ -64,6 +69,13 @@ void init()
   tbb::task_scheduler_init init(static_cast<int>(threadSize));
 #elif defined(USE_OMP)
   omp_set_num_threads(threadSize);
+  if (get_numa_mode()) {
+#   pragma omp parallel
+    numa_pin_worker(static_cast<size_t>(omp_get_thread_num()),
+                    static_cast<size_t>(omp_get_num_threads()));
+  }
+#elif defined(USE_NATIVE_TASKING)
+  native::start(threadSize);
 #endif
 }
 //---------------------------------------------------------------------------//
@@ -78,8 +90,20 @@ void parallel_for(size_t start, size_t end, size_t step,
 #if defined(USE_TBB)
   tbb::parallel_for(start, end, step, T);
 #elif defined(USE_OMP)
+  // iterate over a count, '+=' with an arbitrary step is not a canonical
+  // OpenMP loop
+  if (start >= end || step == 0) { return; }
+  const auto count = static_cast<long long>((end - start + step - 1) / step);
 # pragma omp parallel for
-  for (size_t i = start; i < end; i += step) { T(i); }
+  for (long long k = 0; k < count; ++k) { T(start + k * step); }
+#elif defined(USE_NATIVE_TASKING)
+  if (start >= end || step == 0) { return; }
+  const size_t count = (end - start + step - 1) / step;
+  const size_t grain =
+      std::max<size_t>(1, count / (8 * native::num_workers()));
+  native::parallel_range(size_t(0), count, grain, [&](size_t b, size_t e) {
+    for (size_t k = b; k < e; ++k) { T(start + k * step); }
+  });
 #else
   for (size_t i = start; i < end; i += step) { T(i); }
 #endif
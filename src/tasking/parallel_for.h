@@ -42,6 +42,7 @@
 #else
 # undef USE_TBB
 # undef USE_OMP
+# undef USE_NATIVE_TASKING
 #endif
 
 #ifdef USE_TBB
@@ -53,6 +54,9 @@
 #ifdef USE_OMP
 # include <omp.h>
 #endif
+#ifdef USE_NATIVE_TASKING
+# include "native_pool.h"
+#endif
 
 namespace qaray {
 namespace tasking {
@@ -85,6 +89,12 @@ struct ThreadLocalStorage {
     return *list[tid];
   }
 };
+#elif defined(USE_NATIVE_TASKING)
+template<typename T>
+struct ThreadLocalStorage : public native::ThreadLocalStorage<T> {
+  explicit ThreadLocalStorage(const T &t) :
+      native::ThreadLocalStorage<T>(t) {};
+};
 #else
 template<typename T>
 struct ThreadLocalStorage {
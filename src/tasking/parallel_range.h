@@ -0,0 +1,218 @@
+//------------------------------------------------------------------------------
+///
+/// \file       parallel_range.h
+/// \author     Qi WU
+///
+/// \brief Header-only range based parallel_for and parallel_reduce. The
+///        body is a template argument, so there is no type-erased call per
+///        index and nothing is allocated for the captured state. Work is
+///        handed out in sub-ranges of at least 'grain' indices.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_PARALLEL_RANGE_H
+#define QARAY_PARALLEL_RANGE_H
+#pragma once
+
+#include <algorithm>
+#include "parallel_for.h"
+
+#ifdef USE_TBB
+# include <tbb/blocked_range.h>
+# include <tbb/partitioner.h>
+# include <tbb/parallel_reduce.h>
+#endif
+
+namespace qaray {
+namespace tasking {
+//---------------------------------------------------------------------------//
+//! Half-open index range [begin, end) that is split into chunks of at
+//! least 'grain' indices
+template<typename Index>
+class blocked_range {
+ private:
+  Index b, e;
+  size_t g;
+ public:
+  blocked_range(Index begin, Index end, size_t grain = 1)
+      : b(begin), e(end), g(grain > 0 ? grain : 1) {}
+  Index begin() const { return b; }
+  Index end() const { return e; }
+  size_t grainsize() const { return g; }
+  size_t size() const { return e > b ? static_cast<size_t>(e - b) : 0; }
+  bool empty() const { return !(b < e); }
+  //! number of grain sized chunks and the sub-range of chunk c
+  size_t num_chunks() const { return (size() + g - 1) / g; }
+  blocked_range chunk(size_t c) const
+  {
+    const Index cb = b + static_cast<Index>(c * g);
+    const Index ce = std::min(e, static_cast<Index>(cb + g));
+    return blocked_range(cb, ce, g);
+  }
+};
+//---------------------------------------------------------------------------//
+//! How chunks are assigned to threads. AUTO lets the backend merge chunks
+//! adaptively, SIMPLE hands out one chunk at a time and STATIC gives every
+//! thread an equal contiguous share.
+enum class partitioner { AUTO, SIMPLE, STATIC };
+#if defined(USE_NATIVE_TASKING)
+//---------------------------------------------------------------------------//
+//! Smallest piece the native pool splits a range into
+template<typename Index>
+size_t native_grain(const blocked_range<Index> &range, partitioner part)
+{
+  const size_t n = native::num_workers();
+  switch (part) {
+    case partitioner::SIMPLE: return range.grainsize();
+    case partitioner::STATIC:
+      return std::max(range.grainsize(), (range.size() + n - 1) / n);
+    default: return std::max(range.grainsize(), range.size() / (8 * n));
+  }
+}
+#endif
+//---------------------------------------------------------------------------//
+//! body(const blocked_range<Index> &subrange)
+template<typename Index, typename Body>
+void parallel_for(const blocked_range<Index> &range, const Body &body,
+                  partitioner part = partitioner::AUTO)
+{
+  if (range.empty()) { return; }
+#if defined(USE_TBB)
+  const tbb::blocked_range<Index>
+      r(range.begin(), range.end(), range.grainsize());
+  auto kernel = [&](const tbb::blocked_range<Index> &sub) {
+    body(blocked_range<Index>(sub.begin(), sub.end(), range.grainsize()));
+  };
+  switch (part) {
+    case partitioner::SIMPLE:
+      tbb::parallel_for(r, kernel, tbb::simple_partitioner());
+      break;
+# if TBB_INTERFACE_VERSION >= 9100
+    case partitioner::STATIC:
+      tbb::parallel_for(r, kernel, tbb::static_partitioner());
+      break;
+# endif
+    default:tbb::parallel_for(r, kernel, tbb::auto_partitioner());
+  }
+#elif defined(USE_OMP)
+  const auto n = static_cast<long long>(range.num_chunks());
+  switch (part) {
+    case partitioner::SIMPLE:
+#   pragma omp parallel for schedule(dynamic, 1)
+      for (long long c = 0; c < n; ++c) { body(range.chunk(c)); }
+      break;
+    case partitioner::STATIC:
+#   pragma omp parallel for schedule(static)
+      for (long long c = 0; c < n; ++c) { body(range.chunk(c)); }
+      break;
+    default:
+#   pragma omp parallel for schedule(guided)
+      for (long long c = 0; c < n; ++c) { body(range.chunk(c)); }
+  }
+#elif defined(USE_NATIVE_TASKING)
+  native::parallel_range(range.begin(), range.end(), native_grain(range, part),
+                         [&](Index b, Index e) {
+                           body(blocked_range<Index>(b, e, range.grainsize()));
+                         });
+#else
+  body(range);
+#endif
+}
+//---------------------------------------------------------------------------//
+//! Value body(const blocked_range<Index> &subrange, Value init)
+//! Value join(const Value &a, const Value &b)
+template<typename Index, typename Value, typename Body, typename Join>
+Value parallel_reduce(const blocked_range<Index> &range,
+                      const Value &identity,
+                      const Body &body,
+                      const Join &join,
+                      partitioner part = partitioner::AUTO)
+{
+  if (range.empty()) { return identity; }
+#if defined(USE_TBB)
+  const tbb::blocked_range<Index>
+      r(range.begin(), range.end(), range.grainsize());
+  auto kernel = [&](const tbb::blocked_range<Index> &sub, Value v) {
+    return body(blocked_range<Index>(sub.begin(), sub.end(),
+                                     range.grainsize()), v);
+  };
+  switch (part) {
+    case partitioner::SIMPLE:
+      return tbb::parallel_reduce(r, identity, kernel, join,
+                                  tbb::simple_partitioner());
+# if TBB_INTERFACE_VERSION >= 9100
+    case partitioner::STATIC:
+      return tbb::parallel_reduce(r, identity, kernel, join,
+                                  tbb::static_partitioner());
+# endif
+    default:
+      return tbb::parallel_reduce(r, identity, kernel, join,
+                                  tbb::auto_partitioner());
+  }
+#elif defined(USE_OMP)
+  const auto n = static_cast<long long>(range.num_chunks());
+  std::vector<Value> partial(static_cast<size_t>(omp_get_max_threads()),
+                             identity);
+  switch (part) {
+    case partitioner::SIMPLE:
+#   pragma omp parallel for schedule(dynamic, 1)
+      for (long long c = 0; c < n; ++c) {
+        Value &v = partial[omp_get_thread_num()];
+        v = body(range.chunk(c), v);
+      }
+      break;
+    case partitioner::STATIC:
+#   pragma omp parallel for schedule(static)
+      for (long long c = 0; c < n; ++c) {
+        Value &v = partial[omp_get_thread_num()];
+        v = body(range.chunk(c), v);
+      }
+      break;
+    default:
+#   pragma omp parallel for schedule(guided)
+      for (long long c = 0; c < n; ++c) {
+        Value &v = partial[omp_get_thread_num()];
+        v = body(range.chunk(c), v);
+      }
+  }
+  Value result = identity;
+  for (const auto &v : partial) { result = join(result, v); }
+  return result;
+#elif defined(USE_NATIVE_TASKING)
+  // one partial per piece, joined in order so the result does not depend on
+  // which worker ran which piece
+  const blocked_range<Index>
+      pieces(range.begin(), range.end(), native_grain(range, part));
+  std::vector<Value> partial(pieces.num_chunks(), identity);
+  native::parallel_range(size_t(0), partial.size(), 1,
+                         [&](size_t b, size_t e) {
+                           for (size_t c = b; c < e; ++c) {
+                             const blocked_range<Index> sub = pieces.chunk(c);
+                             partial[c] = body(blocked_range<Index>(
+                                 sub.begin(), sub.end(), range.grainsize()),
+                                               identity);
+                           }
+                         });
+  Value result = identity;
+  for (const auto &v : partial) { result = join(result, v); }
+  return result;
+#else
+  return body(range, identity);
+#endif
+}
+//---------------------------------------------------------------------------//
+//! Index based convenience form: kernel(i) for i in [begin, end)
+template<typename Index, typename Kernel>
+void parallel_for_each(Index begin, Index end, size_t grain,
+                       const Kernel &kernel,
+                       partitioner part = partitioner::AUTO)
+{
+  parallel_for(blocked_range<Index>(begin, end, grain),
+               [&](const blocked_range<Index> &r) {
+                 for (Index i = r.begin(); i < r.end(); ++i) { kernel(i); }
+               }, part);
+}
+}
+}
+
+#endif //QARAY_PARALLEL_RANGE_H
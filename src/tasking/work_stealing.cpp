@@ -0,0 +1,199 @@
+//------------------------------------------------------------------------------
+///
+/// \file       work_stealing.cpp
+/// \author     Qi WU
+///
+/// \brief Work-stealing loop over a list of work items
+///
+//------------------------------------------------------------------------------
+
+#include "work_stealing.h"
+#include "parallel_range.h"
+#include "numa.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+
+namespace qaray {
+namespace tasking {
+//---------------------------------------------------------------------------//
+namespace {
+struct WorkerQueue {
+  std::mutex lock;
+  int node = 0;
+  std::atomic<bool> claimed{false};
+  std::deque<size_t> items;
+  //! the owner walks its block front to back
+  bool Pop(size_t &item)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (items.empty()) { return false; }
+    item = items.front();
+    items.pop_front();
+    return true;
+  }
+  //! thieves take the item farthest away from the owner
+  bool Steal(size_t &item)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (items.empty()) { return false; }
+    item = items.back();
+    items.pop_back();
+    return true;
+  }
+};
+}
+//---------------------------------------------------------------------------//
+void work_stealing_for(const std::vector<size_t> &items,
+                       const std::function<void(size_t)> &kernel,
+                       std::vector<WorkerStats> *stats,
+                       const std::vector<int> *itemNode)
+{
+  const size_t numWorkers = std::max(size_t(1), get_num_of_threads());
+  const size_t numNodes = numa_num_nodes();
+  const bool numa = numNodes > 1;
+  std::vector<WorkerQueue> queues(numWorkers);
+  std::vector<std::vector<size_t>> nodeWorkers(numNodes);
+  for (size_t w = 0; w < numWorkers; ++w) {
+    queues[w].node = numa_worker_node(w, numWorkers);
+    nodeWorkers[queues[w].node].push_back(w);
+  }
+  // contiguous blocks of the list, one per worker
+  auto Distribute = [&](const std::vector<size_t> &list,
+                        const std::vector<size_t> &workers) {
+    for (size_t k = 0; k < workers.size(); ++k) {
+      const size_t begin = k * list.size() / workers.size();
+      const size_t end = (k + 1) * list.size() / workers.size();
+      queues[workers[k]].items.assign(list.begin() + begin,
+                                      list.begin() + end);
+    }
+  };
+  if (numa && itemNode) {
+    // items go to the workers of their node
+    std::vector<std::vector<size_t>> nodeItems(numNodes);
+    for (auto item : items) {
+      size_t node = static_cast<size_t>((*itemNode)[item]) % numNodes;
+      if (nodeWorkers[node].empty()) { node = queues[0].node; }
+      nodeItems[node].push_back(item);
+    }
+    for (size_t n = 0; n < numNodes; ++n) {
+      Distribute(nodeItems[n], nodeWorkers[n]);
+    }
+  } else {
+    std::vector<size_t> workers(numWorkers);
+    for (size_t w = 0; w < numWorkers; ++w) { workers[w] = w; }
+    Distribute(items, workers);
+  }
+  if (stats) { stats->assign(numWorkers, WorkerStats()); }
+  // one task per worker
+  parallel_for_each(size_t(0), numWorkers, 1, [&](size_t task) {
+    // in NUMA mode a task adopts a queue of the node it runs on
+    size_t w = task;
+    if (numa) {
+      const int node = numa_this_node();
+      bool found = false;
+      for (size_t pass = 0; pass < 2 && !found; ++pass) {
+        for (size_t q = 0; q < numWorkers && !found; ++q) {
+          if (pass == 0 && queues[q].node != node) { continue; }
+          bool expected = false;
+          if (queues[q].claimed.compare_exchange_strong(expected, true)) {
+            w = q;
+            found = true;
+          }
+        }
+      }
+    }
+    WorkerStats local;
+    auto Run = [&](size_t item) {
+      auto t0 = std::chrono::steady_clock::now();
+      kernel(item);
+      auto t1 = std::chrono::steady_clock::now();
+      local.busyTime += std::chrono::duration<double>(t1 - t0).count();
+      ++local.numItems;
+    };
+    size_t item;
+    while (queues[w].Pop(item)) { Run(item); }
+    // visit the neighbours first, their items are the closest to ours;
+    // in NUMA mode the workers of our node come before everyone else
+    for (size_t pass = 0; pass < (numa ? 2u : 1u); ++pass) {
+      for (size_t v = 1; v < numWorkers; ++v) {
+        const size_t victim = (w + v) % numWorkers;
+        if (numa && (queues[victim].node == queues[w].node) != (pass == 0)) {
+          continue;
+        }
+        while (queues[victim].Steal(item)) {
+          ++local.numSteals;
+          Run(item);
+        }
+      }
+    }
+    if (stats) { (*stats)[w] = local; }
+  }, partitioner::STATIC);
+}
+//---------------------------------------------------------------------------//
+void dynamic_for(const std::function<bool(std::vector<size_t> &)> &refill,
+                 size_t prefetch,
+                 const std::function<void(size_t)> &kernel,
+                 std::vector<WorkerStats> *stats)
+{
+  const size_t numWorkers = std::max(size_t(1), get_num_of_threads());
+  std::mutex lock;
+  std::condition_variable wakeup;
+  std::deque<size_t> queue;
+  bool refilling = false, exhausted = false;
+  if (stats) { stats->assign(numWorkers, WorkerStats()); }
+  parallel_for_each(size_t(0), numWorkers, 1, [&](size_t w) {
+    WorkerStats local;
+    std::vector<size_t> chunk;
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+      if (queue.size() <= prefetch && !exhausted && !refilling) {
+        refilling = true;
+        guard.unlock();
+        chunk.clear();
+        const bool more = !has_stop_signal() && refill(chunk);
+        guard.lock();
+        queue.insert(queue.end(), chunk.begin(), chunk.end());
+        exhausted = !more;
+        refilling = false;
+        wakeup.notify_all();
+        continue;
+      }
+      if (queue.empty()) {
+        if (exhausted) { break; }
+        wakeup.wait(guard);
+        continue;
+      }
+      const size_t item = queue.front();
+      queue.pop_front();
+      guard.unlock();
+      auto t0 = std::chrono::steady_clock::now();
+      kernel(item);
+      auto t1 = std::chrono::steady_clock::now();
+      local.busyTime += std::chrono::duration<double>(t1 - t0).count();
+      ++local.numItems;
+      guard.lock();
+    }
+    if (stats) { (*stats)[w] = local; }
+  }, partitioner::STATIC);
+}
+//---------------------------------------------------------------------------//
+void print_worker_stats(const std::vector<WorkerStats> &stats)
+{
+  if (stats.empty()) { return; }
+  double maxTime = 0., sumTime = 0.;
+  for (size_t w = 0; w < stats.size(); ++w) {
+    printf("  worker %3zu: %6zu items, %5zu stolen, busy %.4f s\n",
+           w, stats[w].numItems, stats[w].numSteals, stats[w].busyTime);
+    maxTime = std::max(maxTime, stats[w].busyTime);
+    sumTime += stats[w].busyTime;
+  }
+  const double avgTime = sumTime / stats.size();
+  printf("  imbalance (max / mean busy time): %.3f\n",
+         avgTime > 0. ? maxTime / avgTime : 1.);
+}
+}
+}
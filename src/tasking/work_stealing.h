@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+///
+/// \file       work_stealing.h
+/// \author     Qi WU
+///
+/// \brief Work-stealing loop over a list of work items. Items are split in
+///        contiguous blocks, one per worker, so that the order of the list is
+///        preserved locally. Idle workers steal from the far end of the
+///        other workers' blocks. In NUMA mode, items can be given a home
+///        node: they are then queued on the workers of that node, and
+///        thieves look at the workers of their own node first.
+///        dynamic_for is the variant for items that are only known chunk by
+///        chunk, e.g. tiles shared with other processes.
+///
+//------------------------------------------------------------------------------
+
+#ifndef QARAY_WORK_STEALING_H
+#define QARAY_WORK_STEALING_H
+#pragma once
+
+#include "parallel_for.h"
+
+namespace qaray {
+namespace tasking {
+//! Per worker statistics of one work_stealing_for call
+struct WorkerStats {
+  size_t numItems = 0;  //!< number of items processed by the worker
+  size_t numSteals = 0; //!< number of items taken from other workers
+  double busyTime = 0.; //!< seconds spent inside the kernel
+};
+//! Calls kernel(item) for every item of the list. Per worker statistics are
+//! written into 'stats' when it is not null. 'itemNode', indexed by item
+//! value, gives the preferred memory node of every item.
+void work_stealing_for(const std::vector<size_t> &items,
+                       const std::function<void(size_t)> &kernel,
+                       std::vector<WorkerStats> *stats = nullptr,
+                       const std::vector<int> *itemNode = nullptr);
+//! Calls kernel(item) for the items handed out in chunks by 'refill', which
+//! appends the next chunk to its argument and returns false after the last
+//! one. Refill is called by one worker at a time as soon as 'prefetch' or
+//! fewer items are queued, the other workers keep going in the meantime.
+void dynamic_for(const std::function<bool(std::vector<size_t> &)> &refill,
+                 size_t prefetch,
+                 const std::function<void(size_t)> &kernel,
+                 std::vector<WorkerStats> *stats = nullptr);
+//! Print a summary of the statistics: items, steals and busy time per
+//! worker and the imbalance (max / mean busy time)
+void print_worker_stats(const std::vector<WorkerStats> &stats);
+}
+}
+
+#endif //QARAY_WORK_STEALING_H
@@ -14,12 +14,18 @@
 
 //-------------------------------------------------------------------------------
 
-int ReadLine(FILE *fp, int size, char *buffer)
+// Reads one line of the file contents starting at 'pos'
+int ReadLine(const std::vector<char> &contents, size_t &pos, int size,
+             char *buffer)
 {
   int i;
   for (i = 0; i < size; i++) {
-    buffer[i] = fgetc(fp);
-    if (feof(fp) || buffer[i] == '\n' || buffer[i] == '\r') {
+    if (pos >= contents.size()) {
+      buffer[i] = '\0';
+      return i + 1;
+    }
+    buffer[i] = contents[pos++];
+    if (buffer[i] == '\n' || buffer[i] == '\r') {
       buffer[i] = '\0';
       return i + 1;
     }
@@ -29,26 +35,29 @@ int ReadLine(FILE *fp, int size, char *buffer)
 
 //-------------------------------------------------------------------------------
 
-bool LoadPPM(FILE *fp, int &width, int &height, std::vector<Color3c> &data)
+bool LoadPPM(const std::vector<char> &contents, int &width, int &height,
+             std::vector<Color3c> &data)
 {
   const int bufferSize = 1024;
   char buffer[bufferSize];
-  ReadLine(fp, bufferSize, buffer);
+  size_t pos = 0;
+  ReadLine(contents, pos, bufferSize, buffer);
   if (buffer[0] != 'P' && buffer[1] != '6') return false;
 
-  ReadLine(fp, bufferSize, buffer);
-  while (buffer[0] == '#') ReadLine(fp, bufferSize, buffer);  // skip comments
+  ReadLine(contents, pos, bufferSize, buffer);
+  while (buffer[0] == '#') ReadLine(contents, pos, bufferSize, buffer);  // skip comments
 
   sscanf(buffer, "%d %d", &width, &height);
 
-  ReadLine(fp, bufferSize, buffer);
-  while (buffer[0] == '#') ReadLine(fp, bufferSize, buffer);  // skip comments
+  ReadLine(contents, pos, bufferSize, buffer);
+  while (buffer[0] == '#') ReadLine(contents, pos, bufferSize, buffer);  // skip comments
 
   // last read line should be "255\n"
 
   data.resize(static_cast<unsigned int>(width * height));
-  size_t error = fread(data.data(), sizeof(Color3c),
-                       static_cast<unsigned int>(width * height), fp);
+  const size_t bytes = MIN(data.size() * sizeof(Color3c),
+                           contents.size() - MIN(pos, contents.size()));
+  if (bytes > 0) memcpy(data.data(), contents.data() + pos, bytes);
 
   return true;
 }
@@ -56,8 +65,27 @@ bool LoadPPM(FILE *fp, int &width, int &height, std::vector<Color3c> &data)
 //-------------------------------------------------------------------------------
 
 bool TextureFile::Load()
+{
+  const char *name = GetName();
+  if (name[0] == '\0') return false;
+
+  FILE *fp = fopen(name, "rb");
+  if (!fp) return false;
+  std::vector<char> contents;
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    contents.insert(contents.end(), buffer, buffer + n);
+  }
+  fclose(fp);
+
+  return Load(contents);
+}
+
+bool TextureFile::Load(const std::vector<char> &contents)
 {
   data.clear();
+  pixels = NULL;
   width = 0;
   height = 0;
   const char *name = GetName();
@@ -74,7 +102,9 @@ bool TextureFile::Load()
   if (strncmp(ext, "png", 3) == 0) {
     std::vector<unsigned char> d;
     unsigned int w, h;
-    unsigned int error = lodepng::decode(d, w, h, name, LCT_RGB);
+    unsigned int error = lodepng::decode(
+        d, w, h, reinterpret_cast<const unsigned char *>(contents.data()),
+        contents.size(), LCT_RGB);
     if (error == 0) {
       width = w;
       height = h;
@@ -83,15 +113,45 @@ bool TextureFile::Load()
     }
     success = (error == 0);
   } else if (strncmp(ext, "ppm", 3) == 0) {
-    FILE *fp = fopen(name, "rb");
-    if (!fp) return false;
-    success = LoadPPM(fp, width, height, data);
-    fclose(fp);
+    success = LoadPPM(contents, width, height, data);
   }
+  pixels = data.data();
 
   return success;
 }
 
+bool TextureFile::Share(NodeSharing &sharing)
+{
+  size_t bytes = 0;
+  const char *shared;
+  if (sharing.IsLoader()) {
+    SharedBlockWriter out;
+    if (width > 0 && height > 0) {
+      const int size[2] = {width, height};
+      out.Put(size, 2);
+      out.Put(data);
+    }
+    bytes = out.Data().size();
+    shared = sharing.Share(out.Data().data(), bytes);
+  } else {
+    shared = sharing.Share(NULL, bytes);
+  }
+  std::vector<Color3c>().swap(data);
+  pixels = NULL;
+  width = height = 0;
+  SharedBlockReader in(shared, bytes);
+  size_t n, numPixels;
+  const int *size = in.Get<int>(n);
+  const Color3c *p = in.Get<Color3c>(numPixels);
+  if (!in.Good() || n != 2 || numPixels != size_t(size[0]) * size[1]) {
+    return false;
+  }
+  pixels = p;
+  width = size[0];
+  height = size[1];
+  return true;
+}
+
 //-------------------------------------------------------------------------------
 
 Color3f TextureFile::Sample(const Point3 &uvw) const
@@ -118,10 +178,10 @@ Color3f TextureFile::Sample(const Point3 &uvw) const
   if (iyp >= height) iyp -= height;
 
   return
-      ToColor(data[iy * width + ix]) * ((1 - fx) * (1 - fy)) +
-          ToColor(data[iy * width + ixp]) * (fx * (1 - fy)) +
-          ToColor(data[iyp * width + ix]) * ((1 - fx) * fy) +
-          ToColor(data[iyp * width + ixp]) * (fx * fy);
+      ToColor(pixels[iy * width + ix]) * ((1 - fx) * (1 - fy)) +
+          ToColor(pixels[iy * width + ixp]) * (fx * (1 - fy)) +
+          ToColor(pixels[iyp * width + ix]) * ((1 - fx) * fy) +
+          ToColor(pixels[iyp * width + ixp]) * (fx * fy);
 }
 
 //-------------------------------------------------------------------------------
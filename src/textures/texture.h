@@ -13,21 +13,32 @@
 #define _TEXTURE_H_INCLUDED_
 
 #include "scene/scene.h"
+#include "core/sharing.h"
 
 //-------------------------------------------------------------------------------
 
 class TextureFile : public Texture {
  public:
-  TextureFile() : width(0), height(0), viewportTextureID(0) {}
+  TextureFile() : pixels(NULL), width(0), height(0), viewportTextureID(0) {}
 
   bool Load();
 
+  // Decode the contents of the file, when the caller has read them already
+  bool Load(const std::vector<char> &contents);
+
+  // Move the pixels into memory shared by the ranks of the host, collective
+  // over these ranks (see NodeSharing). The loader shares the texture it
+  // loaded, the others get its copy. Returns false on all ranks when the
+  // loader has no texture.
+  bool Share(NodeSharing &sharing);
+
   virtual Color3f Sample(const Point3 &uvw) const;
 
   virtual bool SetViewportTexture() const;
 
  private:
   std::vector<Color3c> data;
+  const Color3c *pixels;  // data, or the shared copy of the pixels
   int width, height;
   mutable unsigned int viewportTextureID;
 };